@@ -21,6 +21,7 @@
 #include <errno.h>
 #include <assert.h>
 #include <glib.h>
+#include <glib-unix.h>
 
 guint g_new_msec_timer(GMainContext *context,
                        guint msec,
@@ -51,3 +52,19 @@ guint g_new_sec_timer(GMainContext *context,
 
         return g_source_attach(src, context);
 }
+
+guint g_new_psi_watch(GMainContext *context,
+                      int fd,
+                      GUnixFDSourceFunc func,
+                      gpointer data,
+                      GDestroyNotify notify) {
+        g_autoptr(GSource) src = NULL;
+
+        g_assert(fd >= 0);
+        g_assert(func);
+
+        src = g_unix_fd_source_new(fd, G_IO_PRI);
+        g_source_set_callback(src, (GSourceFunc) func, data, notify);
+
+        return g_source_attach(src, context);
+}
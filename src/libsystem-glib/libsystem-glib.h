@@ -30,6 +30,7 @@
 #pragma once
 
 #include <glib.h>
+#include <glib-unix.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -130,6 +131,34 @@ guint g_new_sec_timer(GMainContext *context,
                       gpointer data,
                       GDestroyNotify notify);
 
+/**
+ * @brief Create PSI trigger watch source and attach it to
+ * GMainContext. The fd is watched for G_IO_PRI, which the kernel
+ * raises when the trigger fires.
+ *
+ * @param context GMainContext to be attached created source.
+ *
+ * @param fd PSI trigger fd from proc_psi_trigger_open() or
+ * cgroup_psi_trigger_open(). The fd is not closed by the source.
+ *
+ * @param func Callback function on trigger event. G_IO_ERR is set
+ * to the condition if the monitored cgroup is removed. If this
+ * function return false, the source will be removed.
+ *
+ * @param data data to pass to func
+ *
+ * @param notify Specifies the type of function which is called when a
+ * data element is destroyed. It is passed the pointer to the data
+ * element and should free any memory and resources allocated for it.
+ *
+ * @return attached sourced id. This id can be destroyed by g_source_destroy().
+ */
+guint g_new_psi_watch(GMainContext *context,
+                      int fd,
+                      GUnixFDSourceFunc func,
+                      gpointer data,
+                      GDestroyNotify notify);
+
 #ifdef __cplusplus
 }
 #endif
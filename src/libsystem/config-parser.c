@@ -24,6 +24,8 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "libsystem.h"
 #include "config-parser.h"
@@ -105,9 +107,10 @@ static int config_parse_table(
 
 int config_parse(const char *filename, void *table) {
 
-        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_close_ int fd = -1;
+        _cleanup_line_reader_done_ struct line_reader reader = LINE_READER_INIT(-1);
         char *sections[MAX_SECTION] = { 0 };
-        char *section = NULL, *n, *e, l[LINE_MAX];
+        char *section = NULL, *n, *e, *l;
         size_t len;
         int i, r, num_section = 0;
         bool already;
@@ -115,20 +118,21 @@ int config_parse(const char *filename, void *table) {
 
         assert(filename);
 
-        f = fopen(filename, "r");
-        if (!f)
+        fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
                 return -errno;
 
-        while (!feof(f)) {
-                _cleanup_free_ char *lvalue = NULL, *rvalue = NULL;
+        reader.fd = fd;
 
-                if (fgets(l, LINE_MAX, f) == NULL) {
-                        if (feof(f))
-                                break;
+        for (;;) {
+                _cleanup_free_ char *lvalue = NULL, *rvalue = NULL;
 
-                        r = -errno;
+                /* No limit of the line length */
+                r = line_reader_next(&reader, &l, &len);
+                if (r < 0)
                         goto finish;
-                }
+                if (r == 0)
+                        break;
 
                 line++;
                 truncate_nl(l);
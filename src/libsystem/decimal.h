@@ -0,0 +1,155 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal decimal conversions without stdio, for the sysfs and
+ * procfs attribute readers and writers. This header is not
+ * installed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "libsystem.h"
+
+/* Same as "%" PRIu64. Return the length, buf is not null
+ * terminated. buf has to be DECIMAL_STR_MAX(uint64_t) at least. */
+static inline size_t decimal_format_uint64(char *buf, uint64_t u) {
+        char t[DECIMAL_STR_MAX(uint64_t)], *p = t + sizeof(t);
+        size_t l;
+
+        do {
+                *--p = '0' + u % 10;
+                u /= 10;
+        } while (u);
+
+        l = t + sizeof(t) - p;
+        memcpy(buf, p, l);
+
+        return l;
+}
+
+static inline size_t decimal_format_int64(char *buf, int64_t i) {
+        if (i < 0) {
+                buf[0] = '-';
+                return 1 + decimal_format_uint64(buf + 1, -(uint64_t) i);
+        }
+
+        return decimal_format_uint64(buf, i);
+}
+
+/* isspace(3) and isdigit(3) of the "C" locale, which fscanf(3)
+ * follows here. Bytes over 0x7f are neither. */
+static inline bool decimal_is_space(char c) {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool decimal_is_digit(char c) {
+        return c >= '0' && c <= '9';
+}
+
+/*
+ * Parse decimal digits and return the pointer next to the last one.
+ * Overflowed value is saturated to UINT64_MAX and *overflow is set,
+ * otherwise *overflow is not touched. Only values over
+ * UINT64_MAX / 10 take the second compare. This is shared with
+ * scan_u64() of the /proc parsers.
+ */
+static inline const char *decimal_scan_digits(const char *p, const char *end, uint64_t *v, bool *overflow) {
+        uint64_t n = 0;
+
+        for (; p < end; p++) {
+                unsigned int c = (unsigned char) *p - '0';
+
+                if (c > 9)
+                        break;
+
+                if (n >= UINT64_MAX / 10 &&
+                    (n > UINT64_MAX / 10 || c > UINT64_MAX % 10)) {
+                        *overflow = true;
+                        n = UINT64_MAX;
+                        continue;
+                }
+
+                n = n * 10 + c;
+        }
+
+        *v = n;
+
+        return p;
+}
+
+/* A number parsed by decimal_scan() */
+struct decimal {
+        /* absolute value, UINT64_MAX if overflowed */
+        uint64_t u;
+        bool negative;
+        bool overflow;
+};
+
+/*
+ * Parse a decimal number as fscanf(3) does. Leading white spaces are
+ * skipped and a sign is allowed. Overflowed value is saturated as
+ * strtoull(3).
+ *
+ * Return 1 on success, 0 if no digit is found, or EOF if there is
+ * nothing but white spaces.
+ */
+static inline int decimal_scan(const char *p, const char *end, struct decimal *d) {
+        while (p < end && decimal_is_space(*p))
+                p++;
+
+        if (p == end)
+                return EOF;
+
+        d->negative = *p == '-';
+        if (*p == '-' || *p == '+')
+                p++;
+
+        if (p == end || !decimal_is_digit(*p))
+                return 0;
+
+        d->overflow = false;
+        (void) decimal_scan_digits(p, end, &d->u, &d->overflow);
+
+        return 1;
+}
+
+/* Saturate as strtoll(3) */
+static inline int64_t decimal_to_int64(const struct decimal *d) {
+        if (d->negative)
+                return d->u > (uint64_t) INT64_MAX + 1 ? INT64_MIN : (int64_t) -d->u;
+
+        return d->u > INT64_MAX ? INT64_MAX : (int64_t) d->u;
+}
+
+/* As strtoull(3), a negative value is negated in uint64_t, so "-1" is
+ * UINT64_MAX and "-18446744073709551615" is 1. An overflow is
+ * UINT64_MAX whatever the sign is. */
+static inline uint64_t decimal_to_uint64(const struct decimal *d) {
+        if (d->overflow)
+                return UINT64_MAX;
+
+        return d->negative ? -d->u : d->u;
+}
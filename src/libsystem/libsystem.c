@@ -30,20 +30,25 @@
 #include <mntent.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 
 #include "libsystem.h"
+#include "decimal.h"
+#include "uring.h"
+#include "work-pool.h"
 
-static int _errno_old;
+/* errno is thread local, so the saved one is kept on the stack of
+ * each call, not in a shared variable. STORE_RESET_ERRNO declares
+ * _errno_old and can be used once in a scope. */
+#define STORE_RESET_ERRNO                       \
+        int _errno_old = errno;                 \
+        errno = 0
 
-#define STORE_RESET_ERRNO do {          \
-        _errno_old = errno;             \
-        errno = 0;                      \
-} while (0)
-
-#define RESTORE_ERRNO do {              \
-        errno = _errno_old;             \
-        _errno_old = 0;                 \
-} while (0)
+#define RESTORE_ERRNO                           \
+        errno = _errno_old
 
 bool streq_ptr(const char *a, const char *b) {
 
@@ -409,41 +414,304 @@ bool is_number(const char *s, int l) {
         return true;
 }
 
-static int do_copy_internal(const char *src, const char *dst, mode_t mode, bool force) {
-        _cleanup_close_ int rfd = -1, wfd = -1;
-        char buf[1024];
-        ssize_t red;
+#ifndef HAVE_COPY_FILE_RANGE
+static inline ssize_t missing_copy_file_range(int fd_in, loff_t *off_in,
+                                              int fd_out, loff_t *off_out,
+                                              size_t len, unsigned int flags) {
+#ifdef __NR_copy_file_range
+        return syscall(__NR_copy_file_range, fd_in, off_in, fd_out, off_out, len, flags);
+#else
+        errno = ENOSYS;
+        return -1;
+#endif
+}
+
+#define copy_file_range missing_copy_file_range
+#endif
+
+#ifndef FICLONE
+#define FICLONE         _IOW(0x94, 9, int)
+#endif
+
+/* Size of the bounce buffer of the last resort read/write loop */
+#define COPY_BUF_SIZE   (128 * 1024)
+/* Upper bound of a single copy_file_range() or sendfile() call */
+#define COPY_CHUNK_MAX  (1024 * 1024 * 1024)
+
+enum copy_method {
+        COPY_METHOD_COPY_FILE_RANGE,
+        COPY_METHOD_SENDFILE,
+        COPY_METHOD_READ_WRITE,
+};
+
+struct copy_state {
+        enum copy_method method;
+        void *buf;
+};
+
+static void copy_state_done(struct copy_state *st) {
+        free(st->buf);
+}
+
+/* Errors which mean the method is not supported for the given fds */
+static bool copy_should_fallback(int err) {
+        switch (err) {
+        case ENOSYS:
+        case EXDEV:
+        case EINVAL:
+        case EOPNOTSUPP:
+        case ENOTTY:
+        case EBADF:
+        case ETXTBSY:
+                return true;
+        default:
+                return false;
+        }
+}
+
+static int copy_alloc_buf(struct copy_state *st) {
         int r;
 
-        assert(src);
-        assert(dst);
+        if (st->buf)
+                return 0;
+
+        r = posix_memalign(&st->buf, sysconf(_SC_PAGESIZE), COPY_BUF_SIZE);
+        if (r > 0) {
+                st->buf = NULL;
+                return -r;
+        }
+
+        return 0;
+}
 
-        if (!force) {
-                r = access(dst, F_OK);
-                if (r == 0)
-                        return -EALREADY;
-                else if (errno != ENOENT)
+static int write_all_at(int fd, const char *buf, size_t len, off_t offset) {
+        ssize_t n;
+
+        while (len > 0) {
+                n = pwrite(fd, buf, len, offset);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
                         return -errno;
+                }
+                if (n == 0)
+                        return -EIO;
+
+                buf += n;
+                len -= n;
+                offset += n;
         }
 
-        wfd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, mode);
-        if (wfd < 0)
-                return -errno;
+        return 0;
+}
 
-        rfd = open(src, O_RDONLY);
-        if (rfd < 0)
+/*
+ * Copy [offset, offset + len) of rfd to the same offset of wfd. Each
+ * method is tried in order and a method which is not supported by the
+ * kernel or the file systems is not tried again for this copy.
+ *
+ * Return bytes copied, which is less than len only when the source
+ * is shrunken during the copy, or -errno on failure.
+ */
+static ssize_t copy_range(int rfd, int wfd, off_t offset, size_t len, struct copy_state *st) {
+        size_t left = len;
+        ssize_t n;
+        int r;
+
+        while (left > 0) {
+                size_t chunk = left < COPY_CHUNK_MAX ? left : COPY_CHUNK_MAX;
+
+                switch (st->method) {
+                case COPY_METHOD_COPY_FILE_RANGE: {
+                        loff_t in = offset, out = offset;
+
+                        n = copy_file_range(rfd, &in, wfd, &out, chunk, 0);
+                        if (n < 0 && copy_should_fallback(errno)) {
+                                st->method = COPY_METHOD_SENDFILE;
+                                continue;
+                        }
+                        break;
+                }
+                case COPY_METHOD_SENDFILE: {
+                        off_t in = offset;
+
+                        if (lseek(wfd, offset, SEEK_SET) < 0)
+                                return -errno;
+
+                        n = sendfile(wfd, rfd, &in, chunk);
+                        if (n < 0 && copy_should_fallback(errno)) {
+                                st->method = COPY_METHOD_READ_WRITE;
+                                continue;
+                        }
+                        break;
+                }
+                case COPY_METHOD_READ_WRITE:
+                default:
+                        r = copy_alloc_buf(st);
+                        if (r < 0)
+                                return r;
+
+                        if (chunk > COPY_BUF_SIZE)
+                                chunk = COPY_BUF_SIZE;
+
+                        n = pread(rfd, st->buf, chunk, offset);
+                        if (n > 0) {
+                                r = write_all_at(wfd, st->buf, n, offset);
+                                if (r < 0)
+                                        return r;
+                        }
+                        break;
+                }
+
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+
+                /* source is truncated under us */
+                if (n == 0)
+                        break;
+
+                offset += n;
+                left -= n;
+        }
+
+        return len - left;
+}
+
+/* Copy from the current offset of rfd which has no known size, such
+ * as pipes or procfs files, until the end of file. */
+static int copy_stream(int rfd, int wfd, struct copy_state *st) {
+        ssize_t n;
+        int r;
+
+        r = copy_alloc_buf(st);
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                size_t left;
+                char *p;
+
+                n = read(rfd, st->buf, COPY_BUF_SIZE);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                if (n == 0)
+                        return 0;
+
+                for (p = st->buf, left = n; left > 0; p += n, left -= n) {
+                        n = write(wfd, p, left);
+                        if (n < 0) {
+                                if (errno == EINTR) {
+                                        n = 0;
+                                        continue;
+                                }
+                                return -errno;
+                        }
+                        if (n == 0)
+                                return -EIO;
+                }
+        }
+}
+
+int copy_bytes(int rfd, int wfd, enum copy_flags flags) {
+        _cleanup_(copy_state_done) struct copy_state st = {
+                .method = COPY_METHOD_COPY_FILE_RANGE,
+        };
+        struct stat sb;
+        off_t offset, data, hole;
+        ssize_t n;
+
+        if (rfd < 0 || wfd < 0)
+                return -EBADF;
+
+        if (fstat(rfd, &sb) < 0)
                 return -errno;
 
-        while ((red = read(rfd, buf, 1024)) > 0)
-                if (write(wfd, buf, red) != red)
+        /* procfs and sysfs report zero size, never trust it */
+        if (!S_ISREG(sb.st_mode) || sb.st_size == 0)
+                return copy_stream(rfd, wfd, &st);
+
+        if (flags & COPY_REFLINK) {
+                if (ioctl(wfd, FICLONE, rfd) >= 0)
+                        return 0;
+
+                /* not supported here, do a real copy */
+                if (!copy_should_fallback(errno))
                         return -errno;
+        }
+
+        /* st_blocks counts metadata and preallocated blocks too, it
+         * cannot tell if there are holes. Always ask the file system. */
+        for (offset = 0; offset < sb.st_size; offset = hole) {
+                data = lseek(rfd, offset, SEEK_DATA);
+                if (data < 0) {
+                        /* ENXIO: no more data, the rest is a hole */
+                        if (errno == ENXIO)
+                                break;
+                        if (errno != EINVAL && errno != EOPNOTSUPP)
+                                return -errno;
+
+                        /* no hole support, copy whole file */
+                        data = offset;
+                        hole = sb.st_size;
+                } else {
+                        hole = lseek(rfd, data, SEEK_HOLE);
+                        if (hole < 0)
+                                hole = sb.st_size;
+                }
+
+                if (data >= sb.st_size)
+                        break;
+                if (hole > sb.st_size)
+                        hole = sb.st_size;
+
+                n = copy_range(rfd, wfd, data, hole - data, &st);
+                if (n < 0)
+                        return n;
 
-        if (red < 0)
+                /* source is shrunken */
+                if (n < hole - data) {
+                        sb.st_size = data + n;
+                        break;
+                }
+        }
+
+        /* Extend the destination over trailing hole */
+        if (ftruncate(wfd, sb.st_size) < 0)
                 return -errno;
 
         return 0;
 }
 
+int do_copy_full(const char *src, const char *dst, mode_t mode, enum copy_flags flags) {
+        _cleanup_close_ int rfd = -1, wfd = -1;
+
+        assert(src);
+        assert(dst);
+
+        rfd = open(src, O_RDONLY | O_CLOEXEC);
+        if (rfd < 0)
+                return -errno;
+
+        if (flags & COPY_FORCE)
+                wfd = open(dst, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, mode);
+        else
+                wfd = open(dst, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, mode);
+        if (wfd < 0)
+                return errno == EEXIST ? -EALREADY : -errno;
+
+        return copy_bytes(rfd, wfd, flags);
+}
+
+static int do_copy_internal(const char *src, const char *dst, mode_t mode, bool force) {
+        return do_copy_full(src, dst, mode, force ? COPY_FORCE : 0);
+}
+
 int do_copy_mode(const char *src, const char *dst, mode_t mode) {
 
         assert(src);
@@ -476,175 +744,1767 @@ int do_copy_force(const char *src, const char *dst) {
         return do_copy_internal(src, dst, 0644, true);
 }
 
-int do_mkdir(const char *path, mode_t mode) {
-        char d[PATH_MAX];
-        size_t s, l;
-        int r, p;
+/* Bound of the file copy threads of do_copy_tree() */
+#define COPY_TREE_THREADS_MAX   8
 
-        assert(path);
+struct copy_tree_item {
+        /* relative to the source and destination roots */
+        char *path;
+        struct stat st;
+};
+
+struct copy_tree {
+        int sfd;
+        int dfd;
+        enum copy_flags flags;
+        /* destination root, not to be copied into itself */
+        dev_t dst_dev;
+        ino_t dst_ino;
+
+        struct copy_tree_item *files;
+        size_t n_files;
+        size_t n_files_allocated;
+
+        struct copy_tree_item *dirs;
+        size_t n_dirs;
+        size_t n_dirs_allocated;
+};
+
+static void copy_tree_done(struct copy_tree *t) {
+        size_t i;
+
+        for (i = 0; i < t->n_files; i++)
+                free(t->files[i].path);
+        free(t->files);
+
+        for (i = 0; i < t->n_dirs; i++)
+                free(t->dirs[i].path);
+        free(t->dirs);
+}
 
-        l = strlen(path);
+static int copy_tree_add(struct copy_tree_item **items, size_t *n, size_t *allocated,
+                         const char *path, const struct stat *st) {
+        struct copy_tree_item *item;
 
-        for (p = 0, s = 0; p < l; p += s + 1) {
-                s = strcspn(path + p, "/");
-                if (!s)
-                        continue;
+        if (*n >= *allocated) {
+                size_t a = *allocated ? *allocated * 2 : 64;
 
-                assert(PATH_MAX > p + s + 1);
+                item = realloc(*items, a * sizeof(struct copy_tree_item));
+                if (!item)
+                        return -ENOMEM;
 
-                r = snprintf(d, p + s + 1, "%s", path);
-                if (r < 0)
-                        return r;
+                *items = item;
+                *allocated = a;
+        }
 
-                r = mkdir(d, mode);
-                if (r < 0 && errno != EEXIST)
+        item = &(*items)[*n];
+        item->path = strdup(path);
+        if (!item->path)
+                return -ENOMEM;
+        item->st = *st;
+        (*n)++;
+
+        return 0;
+}
+
+static int copy_tree_times(int dfd, const char *name, const struct stat *st, int at_flags) {
+        struct timespec ts[2] = { st->st_atim, st->st_mtim };
+
+        if (utimensat(dfd, name, ts, at_flags) < 0)
+                return -errno;
+
+        return 0;
+}
+
+/* Copy a node which is not a regular file or a directory. They are
+ * cheap enough to be done while walking. */
+static int copy_tree_special(int sfd, int dfd, const char *name, const struct stat *st, enum copy_flags flags) {
+        int r;
+
+        if (flags & COPY_FORCE) {
+                r = unlinkat(dfd, name, 0);
+                if (r < 0 && errno != ENOENT)
                         return -errno;
         }
 
-        return 0;
+        if (S_ISLNK(st->st_mode)) {
+                _cleanup_free_ char *target = NULL;
+                size_t l = st->st_size > 0 ? st->st_size + 1 : PATH_MAX;
+                ssize_t n;
+
+                target = new(char, l);
+                if (!target)
+                        return -ENOMEM;
+
+                n = readlinkat(sfd, name, target, l);
+                if (n < 0)
+                        return -errno;
+                if ((size_t) n >= l)
+                        return -ENAMETOOLONG;
+                target[n] = 0;
+
+                r = symlinkat(target, dfd, name);
+        } else
+                r = mknodat(dfd, name, st->st_mode, st->st_rdev);
+        if (r < 0)
+                return errno == EEXIST ? -EALREADY : -errno;
+
+        (void) fchownat(dfd, name, st->st_uid, st->st_gid, AT_SYMLINK_NOFOLLOW);
+
+        return copy_tree_times(dfd, name, st, AT_SYMLINK_NOFOLLOW);
 }
 
-int rmdir_recursive(const char *path) {
+static int copy_tree_walk(struct copy_tree *t, int sfd, int dfd, const char *prefix) {
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
-        int r;
-
-        assert(path);
+        int fd, r;
 
-        d = opendir(path);
-        if (!d)
+        fd = dup(sfd);
+        if (fd < 0)
                 return -errno;
 
+        d = fdopendir(fd);
+        if (!d) {
+                r = -errno;
+                close(fd);
+                return r;
+        }
+
         FOREACH_DIRENT(de, d, return -errno) {
-                _cleanup_free_ char *p = NULL;
+                _cleanup_free_ char *path = NULL;
+                struct stat st;
+
+                if (fstatat(sfd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+                        return -errno;
 
-                r = asprintf(&p, "%s/%s", path, de->d_name);
+                if (prefix)
+                        r = asprintf(&path, "%s/%s", prefix, de->d_name);
+                else
+                        r = asprintf(&path, "%s", de->d_name);
                 if (r < 0)
                         return -ENOMEM;
 
-                if (de->d_type == DT_DIR) {
-                        r = rmdir_recursive(p);
+                if (S_ISREG(st.st_mode)) {
+                        r = copy_tree_add(&t->files, &t->n_files, &t->n_files_allocated, path, &st);
+                        if (r < 0)
+                                return r;
+                } else if (S_ISDIR(st.st_mode)) {
+                        if (st.st_dev == t->dst_dev && st.st_ino == t->dst_ino)
+                                continue;
+
+                        /* Writable until the contents are copied */
+                        r = mkdirat(dfd, de->d_name, 0700);
+                        if (r < 0 && (errno != EEXIST || !(t->flags & COPY_FORCE)))
+                                return errno == EEXIST ? -EALREADY : -errno;
+
+                        /* walked later by copy_tree_walk_dir() */
+                        r = copy_tree_add(&t->dirs, &t->n_dirs, &t->n_dirs_allocated, path, &st);
                         if (r < 0)
                                 return r;
                 } else {
-                        r = unlink(p);
+                        r = copy_tree_special(sfd, dfd, de->d_name, &st, t->flags);
                         if (r < 0)
                                 return r;
                 }
         }
 
-        return rmdir(path);
+        return 0;
 }
 
-char *strdup_unquote(const char *str, const char *quotes) {
-        size_t l;
-
-        assert(str);
+/*
+ * Walk the index-th directory of t->dirs. Directories are walked in
+ * the order they are found rather than recursively, so only the fds
+ * of one directory are open at a time however deep the tree is.
+ */
+static int copy_tree_walk_dir(struct copy_tree *t, size_t index) {
+        _cleanup_close_ int sfd = -1, dfd = -1;
+        /* t->dirs may be moved, the path string is not */
+        const char *path = t->dirs[index].path;
 
-        l = strlen(str);
-        if (l < 2)
-                return strdup(str);
+        sfd = openat(t->sfd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (sfd < 0)
+                return -errno;
 
-        if (strchr(quotes, str[0]) && str[0] == str[l - 1])
-                return strndup(str + 1, l - 2);
+        dfd = openat(t->dfd, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dfd < 0)
+                return -errno;
 
-        return strdup(str);
+        return copy_tree_walk(t, sfd, dfd, path);
 }
 
-int write_str_to_file(FILE *f, const char *str, enum file_write_flags flags) {
-        int r = 0;
+static int copy_tree_file(size_t index, void *buf, void *userdata) {
+        struct copy_tree *t = userdata;
+        const struct copy_tree_item *f = &t->files[index];
+        struct timespec ts[2] = { f->st.st_atim, f->st.st_mtim };
+        _cleanup_close_ int rfd = -1, wfd = -1;
+        int r;
 
-        assert(f);
-        assert(str);
+        rfd = openat(t->sfd, f->path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+        if (rfd < 0)
+                return -errno;
 
-        STORE_RESET_ERRNO;
+        if (t->flags & COPY_FORCE) {
+                wfd = openat(t->dfd, f->path, O_CREAT | O_WRONLY | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
 
-        (void) fputs(str, f);
-        if ((flags & FILE_WRITE_NEWLINE_IF_NOT) && !endswith(str, "\n"))
-                (void) fputc('\n', f);
+                /* read-only copy of the last time */
+                if (wfd < 0 && errno == EACCES && unlinkat(t->dfd, f->path, 0) >= 0)
+                        wfd = openat(t->dfd, f->path, O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, 0600);
+        } else
+                wfd = openat(t->dfd, f->path, O_CREAT | O_EXCL | O_WRONLY | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (wfd < 0)
+                return errno == EEXIST ? -EALREADY : -errno;
 
-        if (flags & FILE_WRITE_WITH_FFLUSH)
-                (void) fflush(f);
+        r = copy_bytes(rfd, wfd, t->flags);
+        if (r < 0)
+                return r;
 
-        if (ferror(f))
-                r = errno ? -errno : -EIO;
+        /* Only root can give the file away, keep going if not */
+        (void) fchown(wfd, f->st.st_uid, f->st.st_gid);
 
-        RESTORE_ERRNO;
+        if (fchmod(wfd, f->st.st_mode & 07777) < 0)
+                return -errno;
 
-        return r;
-}
+        if (futimens(wfd, ts) < 0)
+                return -errno;
 
-int write_str_to_path(const char *path, const char *str, enum file_write_flags flags) {
-        _cleanup_fclose_ FILE *f = NULL;
+        return 0;
+}
 
-        assert(path);
-        assert(str);
+static int copy_tree_dir_attr(int dfd, const char *name, const struct stat *st) {
+        (void) fchownat(dfd, name, st->st_uid, st->st_gid, 0);
 
-        if (flags & FILE_WRITE_APPEND)
-                f = fopen(path, "ae");
-        else
-                f = fopen(path, "we");
-        if (!f)
+        if (fchmodat(dfd, name, st->st_mode & 07777, 0) < 0)
                 return -errno;
 
-        return write_str_to_file(f, str, flags);
+        return copy_tree_times(dfd, name, st, 0);
 }
 
-int read_one_line_from_file(FILE *f, char **line) {
-        char t[LINE_MAX], *c;
+int do_copy_tree(const char *src, const char *dst, enum copy_flags flags) {
+        _cleanup_(copy_tree_done) struct copy_tree t = {
+                .flags = flags,
+        };
+        _cleanup_close_ int sfd = -1, dfd = -1;
+        struct stat sst, dst_st;
+        size_t i;
+        int r;
 
-        assert(f);
-        assert(line);
+        assert(src);
+        assert(dst);
 
-        STORE_RESET_ERRNO;
+        sfd = open(src, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (sfd < 0)
+                return -errno;
+
+        if (fstat(sfd, &sst) < 0)
+                return -errno;
 
-        if (!fgets(t, sizeof(t), f)) {
+        r = mkdir(dst, 0700);
+        if (r < 0 && (errno != EEXIST || !(flags & COPY_FORCE)))
+                return errno == EEXIST ? -EALREADY : -errno;
 
-                if (ferror(f)) {
-                        int r;
+        dfd = open(dst, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd < 0)
+                return -errno;
 
-                        r = errno ? -errno : -EIO;
-                        RESTORE_ERRNO;
+        if (fstat(dfd, &dst_st) < 0)
+                return -errno;
+
+        t.sfd = sfd;
+        t.dfd = dfd;
+        t.dst_dev = dst_st.st_dev;
+        t.dst_ino = dst_st.st_ino;
+
+        r = copy_tree_walk(&t, sfd, dfd, NULL);
+        if (r < 0)
+                return r;
+
+        /* n_dirs grows while walking */
+        for (i = 0; i < t.n_dirs; i++) {
+                r = copy_tree_walk_dir(&t, i);
+                if (r < 0)
                         return r;
-                }
+        }
 
-                t[0] = 0;
+        r = work_pool_run(t.n_files, COPY_TREE_THREADS_MAX, 0, copy_tree_file, &t);
+        if (r < 0)
+                return r;
+
+        /* Children first, copying them touches the parents' mtime */
+        for (i = t.n_dirs; i > 0; i--) {
+                r = copy_tree_dir_attr(dfd, t.dirs[i - 1].path, &t.dirs[i - 1].st);
+                if (r < 0)
+                        return r;
         }
 
-        RESTORE_ERRNO;
+        if (flags & COPY_SYNC) {
+                if (syncfs(dfd) < 0)
+                        return -errno;
+        }
 
-        c = strdup(t);
-        if (!c)
-                return -ENOMEM;
+        (void) fchown(dfd, sst.st_uid, sst.st_gid);
 
-        *line = truncate_nl(c);
+        if (fchmod(dfd, sst.st_mode & 07777) < 0)
+                return -errno;
+
+        if (futimens(dfd, (struct timespec[2]) { sst.st_atim, sst.st_mtim }) < 0)
+                return -errno;
 
         return 0;
 }
 
-int read_one_line_from_path(const char *path, char **line) {
-        _cleanup_fclose_ FILE *f = NULL;
+#define URING_COPY_SLOTS        16
+#define URING_COPY_BUF_SIZE     (128 * 1024)
+/* each slot has two opens and two closes in flight at most */
+#define URING_COPY_ENTRIES      (URING_COPY_SLOTS * 4)
+
+enum uring_copy_op {
+        URING_COPY_OPEN_SRC,
+        URING_COPY_OPEN_DST,
+        URING_COPY_READ,
+        URING_COPY_WRITE,
+        URING_COPY_CLOSE,
+};
+
+#define URING_COPY_DATA(slot, op)       (((uint64_t) (slot) << 8) | (op))
+
+struct uring_copy_slot {
+        size_t index;
+        int rfd;
+        int wfd;
+        /* opens in flight */
+        unsigned int n_open;
+        int error;
+        uint64_t offset;
+        unsigned int len;
+        unsigned int done;
+        char *buf;
+};
+
+struct copy_many {
+        const struct copy_pair *pairs;
+        size_t n_pairs;
+        mode_t mode;
+        enum copy_flags flags;
+        int *status;
+        /* the first error, accessed atomically */
+        int error;
+};
+
+static void copy_many_set_status(struct copy_many *m, size_t index, int r) {
+        int zero = 0;
+
+        if (m->status)
+                m->status[index] = r;
+
+        if (r < 0)
+                __atomic_compare_exchange_n(&m->error, &zero, r, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
 
-        assert(path);
-        assert(line);
+static int copy_many_one(size_t index, void *buf, void *userdata) {
+        struct copy_many *m = userdata;
 
-        f = fopen(path, "re");
-        if (!f)
-                return -errno;
+        copy_many_set_status(m, index, do_copy_full(m->pairs[index].src, m->pairs[index].dst, m->mode, m->flags));
 
-        return read_one_line_from_file(f, line);
+        /* go on with the others */
+        return 0;
 }
 
-#define DEFINE_WRITE_NUM_TO_FILE(type, format)                          \
-        int write_##type##_to_file(FILE *f,                             \
-                                   type##_t u,                          \
-                                   enum file_write_flags flags) {       \
-                int r = 0;                                              \
-                                                                        \
-                assert(f);                                              \
-                                                                        \
-                STORE_RESET_ERRNO;                                      \
-                                                                        \
+static int uring_copy_start(struct uring *u, struct copy_many *m, struct uring_copy_slot *slot,
+                            unsigned int id, size_t index) {
+        int wflags, r;
+
+        slot->index = index;
+        slot->rfd = slot->wfd = -1;
+        slot->error = 0;
+        slot->offset = 0;
+        slot->n_open = 2;
+
+        if (m->flags & COPY_FORCE)
+                wflags = O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC;
+        else
+                wflags = O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC;
+
+        r = uring_prep_openat(u, AT_FDCWD, m->pairs[index].src, O_RDONLY | O_CLOEXEC, 0,
+                              URING_COPY_DATA(id, URING_COPY_OPEN_SRC));
+        if (r < 0)
+                return r;
+
+        /* Do not create the destination if the source is missing */
+        uring_link(u);
+
+        return uring_prep_openat(u, AT_FDCWD, m->pairs[index].dst, wflags, m->mode,
+                                 URING_COPY_DATA(id, URING_COPY_OPEN_DST));
+}
+
+/* Close the files of the slot and take the next pair if any */
+static int uring_copy_finish(struct uring *u, struct copy_many *m, struct uring_copy_slot *slot,
+                             unsigned int id, size_t *next) {
+        int r;
+
+        if (slot->rfd >= 0) {
+                r = uring_prep_close(u, slot->rfd, URING_COPY_DATA(id, URING_COPY_CLOSE));
+                if (r < 0)
+                        return r;
+                slot->rfd = -1;
+        }
+
+        if (slot->wfd >= 0) {
+                r = uring_prep_close(u, slot->wfd, URING_COPY_DATA(id, URING_COPY_CLOSE));
+                if (r < 0)
+                        return r;
+                slot->wfd = -1;
+        }
+
+        copy_many_set_status(m, slot->index, slot->error);
+
+        if (*next >= m->n_pairs)
+                return 0;
+
+        return uring_copy_start(u, m, slot, id, (*next)++);
+}
+
+static int uring_copy_complete(struct uring *u, struct copy_many *m, struct uring_copy_slot *slot,
+                               unsigned int id, enum uring_copy_op op, int32_t res, size_t *next) {
+
+        switch (op) {
+        case URING_COPY_OPEN_SRC:
+        case URING_COPY_OPEN_DST:
+                if (res >= 0) {
+                        if (op == URING_COPY_OPEN_SRC)
+                                slot->rfd = res;
+                        else
+                                slot->wfd = res;
+                } else if (slot->error == 0)
+                        /* -ECANCELED of the destination follows the error of the source */
+                        slot->error = (op == URING_COPY_OPEN_DST && res == -EEXIST) ? -EALREADY : res;
+
+                if (--slot->n_open > 0)
+                        return 0;
+
+                if (slot->error < 0)
+                        return uring_copy_finish(u, m, slot, id, next);
+
+                return uring_prep_read(u, slot->rfd, slot->buf, URING_COPY_BUF_SIZE, slot->offset,
+                                       URING_COPY_DATA(id, URING_COPY_READ));
+
+        case URING_COPY_READ:
+                /* end of file or error */
+                if (res <= 0) {
+                        slot->error = res;
+                        return uring_copy_finish(u, m, slot, id, next);
+                }
+
+                slot->len = res;
+                slot->done = 0;
+
+                return uring_prep_write(u, slot->wfd, slot->buf, slot->len, slot->offset,
+                                        URING_COPY_DATA(id, URING_COPY_WRITE));
+
+        case URING_COPY_WRITE:
+                if (res <= 0) {
+                        slot->error = res < 0 ? res : -EIO;
+                        return uring_copy_finish(u, m, slot, id, next);
+                }
+
+                slot->done += res;
+                if (slot->done < slot->len)
+                        return uring_prep_write(u, slot->wfd, slot->buf + slot->done, slot->len - slot->done,
+                                                slot->offset + slot->done, URING_COPY_DATA(id, URING_COPY_WRITE));
+
+                slot->offset += slot->len;
+
+                return uring_prep_read(u, slot->rfd, slot->buf, URING_COPY_BUF_SIZE, slot->offset,
+                                       URING_COPY_DATA(id, URING_COPY_READ));
+
+        case URING_COPY_CLOSE:
+        default:
+                return 0;
+        }
+}
+
+static int copy_many_uring(struct uring *u, struct copy_many *m) {
+        struct uring_copy_slot slots[URING_COPY_SLOTS];
+        _cleanup_free_ void *bufs = NULL;
+        unsigned int i, n_slots = 0;
+        size_t next = 0;
+        int r;
+
+        r = posix_memalign(&bufs, sysconf(_SC_PAGESIZE), (size_t) URING_COPY_SLOTS * URING_COPY_BUF_SIZE);
+        if (r > 0) {
+                bufs = NULL;
+                return -r;
+        }
+
+        for (; n_slots < URING_COPY_SLOTS && next < m->n_pairs; n_slots++) {
+                slots[n_slots].buf = (char *) bufs + (size_t) n_slots * URING_COPY_BUF_SIZE;
+
+                r = uring_copy_start(u, m, &slots[n_slots], n_slots, next++);
+                if (r < 0)
+                        break;
+        }
+
+        while (r >= 0 && uring_pending(u) > 0) {
+                uint64_t data;
+                int32_t res;
+
+                r = uring_wait(u, &data, &res);
+                if (r < 0)
+                        break;
+
+                i = data >> 8;
+                assert(i < n_slots);
+
+                r = uring_copy_complete(u, m, &slots[i], i, data & 0xff, res, &next);
+        }
+
+        if (r < 0) {
+                /* Let the kernel drop the buffers before they are freed */
+                while (uring_pending(u) > 0) {
+                        uint64_t data;
+                        int32_t res;
+
+                        if (uring_wait(u, &data, &res) < 0)
+                                break;
+
+                        i = data >> 8;
+                        if (i < n_slots && (data & 0xff) <= URING_COPY_OPEN_DST && res >= 0)
+                                close(res);
+                }
+
+                for (i = 0; i < n_slots; i++) {
+                        if (slots[i].rfd >= 0)
+                                close(slots[i].rfd);
+                        if (slots[i].wfd >= 0)
+                                close(slots[i].wfd);
+                }
+
+                return r;
+        }
+
+        return 0;
+}
+
+int do_copy_many(const struct copy_pair *pairs, size_t n, mode_t mode, enum copy_flags flags, int *status) {
+        struct copy_many m = {
+                .pairs = pairs,
+                .n_pairs = n,
+                .mode = mode,
+                .flags = flags,
+                .status = status,
+        };
+        int r;
+
+        assert(pairs || n == 0);
+
+        if (n == 0)
+                return 0;
+
+        /* Reflink is done by ioctl, which io_uring does not have */
+        if ((flags & COPY_URING) && !(flags & COPY_REFLINK)) {
+                _cleanup_uring_free_ struct uring *u = NULL;
+
+                r = uring_new(URING_COPY_ENTRIES, &u);
+                if (r >= 0) {
+                        r = copy_many_uring(u, &m);
+                        if (r < 0)
+                                return r;
+
+                        return m.error;
+                }
+        }
+
+        r = work_pool_run(n, COPY_TREE_THREADS_MAX, 0, copy_many_one, &m);
+        if (r < 0)
+                return r;
+
+        return m.error;
+}
+
+int do_mkdir(const char *path, mode_t mode) {
+        char d[PATH_MAX];
+        size_t s, l;
+        int r, p;
+
+        assert(path);
+
+        l = strlen(path);
+
+        for (p = 0, s = 0; p < l; p += s + 1) {
+                s = strcspn(path + p, "/");
+                if (!s)
+                        continue;
+
+                assert(PATH_MAX > p + s + 1);
+
+                r = snprintf(d, p + s + 1, "%s", path);
+                if (r < 0)
+                        return r;
+
+                r = mkdir(d, mode);
+                if (r < 0 && errno != EEXIST)
+                        return -errno;
+        }
+
+        return 0;
+}
+
+struct linux_dirent64 {
+        uint64_t d_ino;
+        int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+};
+
+/* getdents64() buffer, shared by all depths of rmdir_recursive() */
+#define RMDIR_BUF_SIZE  (32 * 1024)
+/* unlinks in flight with RMDIR_URING */
+#define RMDIR_URING_ENTRIES     256
+
+struct rmdir_frame {
+        int fd;
+        /* name of this directory in the parent */
+        char name[NAME_MAX + 1];
+        /* subdirectories of the last read, entered before reading on */
+        char *pending;
+        size_t pending_len;
+        size_t pending_off;
+        size_t pending_allocated;
+};
+
+struct rmdir_stack {
+        struct rmdir_frame *frames;
+        size_t n_frames;
+        size_t n_allocated;
+        /* batch the unlinks of a buffer if not NULL */
+        struct uring *uring;
+};
+
+static void rmdir_stack_done(struct rmdir_stack *s) {
+        size_t i;
+
+        for (i = 0; i < s->n_frames; i++) {
+                close(s->frames[i].fd);
+                free(s->frames[i].pending);
+        }
+
+        free(s->frames);
+}
+
+static int rmdir_stack_push(struct rmdir_stack *s, int fd, const char *name) {
+        struct rmdir_frame *f;
+
+        if (s->n_frames >= s->n_allocated) {
+                size_t a = s->n_allocated ? s->n_allocated * 2 : 16;
+
+                f = realloc(s->frames, a * sizeof(struct rmdir_frame));
+                if (!f)
+                        return -ENOMEM;
+
+                s->frames = f;
+                s->n_allocated = a;
+        }
+
+        f = &s->frames[s->n_frames++];
+        *f = (struct rmdir_frame) { .fd = fd };
+        snprintf(f->name, sizeof(f->name), "%s", name);
+
+        return 0;
+}
+
+static int rmdir_frame_add_pending(struct rmdir_frame *f, const char *name) {
+        size_t l = strlen(name) + 1;
+
+        if (f->pending_len + l > f->pending_allocated) {
+                size_t a = f->pending_allocated ? f->pending_allocated * 2 : 256;
+                char *p;
+
+                while (a < f->pending_len + l)
+                        a *= 2;
+
+                p = realloc(f->pending, a);
+                if (!p)
+                        return -ENOMEM;
+
+                f->pending = p;
+                f->pending_allocated = a;
+        }
+
+        memcpy(f->pending + f->pending_len, name, l);
+        f->pending_len += l;
+
+        return 0;
+}
+
+/* Wait all the queued unlinks */
+static int rmdir_uring_drain(struct uring *u) {
+        int r = 0, q;
+
+        while (uring_pending(u) > 0) {
+                uint64_t data;
+                int32_t res;
+
+                q = uring_wait(u, &data, &res);
+                if (q < 0)
+                        return q;
+
+                if (res < 0 && res != -ENOENT && r == 0)
+                        r = res;
+        }
+
+        return r;
+}
+
+static int rmdir_unlink(struct rmdir_stack *s, int dfd, const char *name) {
+        int r;
+
+        if (s->uring) {
+                r = uring_prep_unlinkat(s->uring, dfd, name, 0, 0);
+                if (r != -EBUSY)
+                        return r;
+
+                r = rmdir_uring_drain(s->uring);
+                if (r < 0)
+                        return r;
+
+                return uring_prep_unlinkat(s->uring, dfd, name, 0, 0);
+        }
+
+        if (unlinkat(dfd, name, 0) < 0 && errno != ENOENT)
+                return -errno;
+
+        return 0;
+}
+
+/*
+ * Remove the entries of the directory on the top of the stack, which
+ * are in buf. Subdirectories are only recorded in the frame, they are
+ * entered once the whole buffer is done, so the parent is never read
+ * again from the start.
+ */
+static int rmdir_entries_internal(struct rmdir_stack *s, const char *buf, size_t len) {
+        struct rmdir_frame *top = &s->frames[s->n_frames - 1];
+        const struct linux_dirent64 *de;
+        size_t i;
+        int r;
+
+        for (i = 0; i < len; i += de->d_reclen) {
+                unsigned char type;
+
+                de = (const struct linux_dirent64 *) (buf + i);
+
+                if (streq(de->d_name, ".") || streq(de->d_name, ".."))
+                        continue;
+
+                type = de->d_type;
+                if (type == DT_UNKNOWN) {
+                        struct stat st;
+
+                        if (fstatat(top->fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+                                if (errno == ENOENT)
+                                        continue;
+                                return -errno;
+                        }
+
+                        type = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+                }
+
+                if (type == DT_DIR)
+                        r = rmdir_frame_add_pending(top, de->d_name);
+                else
+                        r = rmdir_unlink(s, top->fd, de->d_name);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+/* Push the subdirectory name of the directory dfd */
+static int rmdir_enter(struct rmdir_stack *s, int dfd, const char *name) {
+        int fd, r;
+
+        /* Never follow a symlink replaced with the directory */
+        fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0) {
+                if (errno == ENOENT)
+                        return 0;
+                if (errno != ENOTDIR && errno != ELOOP)
+                        return -errno;
+
+                /* not a directory any more */
+                if (unlinkat(dfd, name, 0) < 0 && errno != ENOENT)
+                        return -errno;
+                return 0;
+        }
+
+        r = rmdir_stack_push(s, fd, name);
+        if (r < 0)
+                close(fd);
+
+        return r;
+}
+
+static int rmdir_entries(struct rmdir_stack *s, const char *buf, size_t len) {
+        int r, q;
+
+        r = rmdir_entries_internal(s, buf, len);
+        if (!s->uring)
+                return r;
+
+        /* The names in buf are used by the queued unlinks */
+        q = rmdir_uring_drain(s->uring);
+
+        return r < 0 ? r : (q < 0 ? q : r);
+}
+
+int rmdir_recursive_full(const char *path, enum rmdir_flags flags) {
+        _cleanup_(rmdir_stack_done) struct rmdir_stack s = {};
+        _cleanup_uring_free_ struct uring *u = NULL;
+        _cleanup_free_ char *buf = NULL;
+        int fd, r;
+
+        assert(path);
+
+        /* Go on without it if not available */
+        if ((flags & RMDIR_URING) && uring_new(RMDIR_URING_ENTRIES, &u) >= 0)
+                s.uring = u;
+
+        buf = new(char, RMDIR_BUF_SIZE);
+        if (!buf)
+                return -ENOMEM;
+
+        fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        r = rmdir_stack_push(&s, fd, "");
+        if (r < 0) {
+                close(fd);
+                return r;
+        }
+
+        while (s.n_frames > 0) {
+                struct rmdir_frame *top = &s.frames[s.n_frames - 1];
+                long n;
+
+                if (top->pending_off < top->pending_len) {
+                        const char *name = top->pending + top->pending_off;
+
+                        top->pending_off += strlen(name) + 1;
+
+                        /* frames may move, name stays in top->pending */
+                        r = rmdir_enter(&s, top->fd, name);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+                top->pending_off = top->pending_len = 0;
+
+                n = syscall(__NR_getdents64, top->fd, buf, RMDIR_BUF_SIZE);
+                if (n < 0)
+                        return -errno;
+
+                if (n > 0) {
+                        r = rmdir_entries(&s, buf, n);
+                        if (r < 0)
+                                return r;
+                        continue;
+                }
+
+                /* Empty now, remove it from the parent */
+                close(top->fd);
+                free(top->pending);
+                s.n_frames--;
+
+                if (s.n_frames == 0)
+                        break;
+
+                if (unlinkat(s.frames[s.n_frames - 1].fd, top->name, AT_REMOVEDIR) < 0 &&
+                    errno != ENOENT)
+                        return -errno;
+        }
+
+        if (rmdir(path) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int rmdir_recursive(const char *path) {
+        return rmdir_recursive_full(path, 0);
+}
+
+char *strdup_unquote(const char *str, const char *quotes) {
+        size_t l;
+
+        assert(str);
+
+        l = strlen(str);
+        if (l < 2)
+                return strdup(str);
+
+        if (strchr(quotes, str[0]) && str[0] == str[l - 1])
+                return strndup(str + 1, l - 2);
+
+        return strdup(str);
+}
+
+struct atomic_file {
+        /* parent directory of the target */
+        int dfd;
+        int fd;
+        /* last component of the target */
+        char *base;
+        /* name of the temporary file in dfd, NULL for unnamed
+         * O_TMPFILE one or after renamed */
+        char *tmp;
+};
+
+#define ATOMIC_FILE_INIT { .dfd = -1, .fd = -1 }
+
+static void atomic_file_done(struct atomic_file *a) {
+        /* not committed */
+        if (a->tmp)
+                (void) unlinkat(a->dfd, a->tmp, 0);
+
+        if (a->fd >= 0)
+                close(a->fd);
+        if (a->dfd >= 0)
+                close(a->dfd);
+
+        free(a->base);
+        free(a->tmp);
+}
+
+static int atomic_file_tmp_name(struct atomic_file *a) {
+        static uint64_t counter;
+        uint64_t u;
+
+        free(a->tmp);
+
+        u = ((uint64_t) getpid() << 32) ^ now_usec(CLOCK_MONOTONIC) ^
+                (__atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED) << 16);
+
+        if (asprintf(&a->tmp, ".#%s%016" PRIx64, a->base, u) < 0) {
+                a->tmp = NULL;
+                return -ENOMEM;
+        }
+
+        return 0;
+}
+
+/*
+ * Create an unnamed temporary file in the directory of path. If the
+ * file system does not support O_TMPFILE, a named one is used. The
+ * mode of the existing target is kept. A symbolic link is resolved
+ * first, so that the file it points to is replaced, not the link, as
+ * the non-atomic write goes through the link.
+ */
+static int atomic_file_open(struct atomic_file *a, const char *path) {
+        _cleanup_free_ char *dir = NULL, *resolved = NULL;
+        const char *e;
+        struct stat st;
+        bool keep_mode;
+        mode_t mode = 0644;
+        int r;
+
+        assert(a);
+        assert(path);
+
+        if (lstat(path, &st) >= 0 && S_ISLNK(st.st_mode)) {
+                /* ENOENT for a dangling link */
+                resolved = realpath(path, NULL);
+                if (!resolved)
+                        return -errno;
+
+                path = resolved;
+        }
+
+        e = strrchr(path, '/');
+        if (!e) {
+                dir = strdup(".");
+                a->base = strdup(path);
+        } else {
+                dir = e == path ? strdup("/") : strndup(path, e - path);
+                a->base = strdup(e + 1);
+        }
+        if (!dir || !a->base)
+                return -ENOMEM;
+
+        if (!a->base[0])
+                return -EISDIR;
+
+        a->dfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (a->dfd < 0)
+                return -errno;
+
+        keep_mode = fstatat(a->dfd, a->base, &st, AT_SYMLINK_NOFOLLOW) >= 0;
+        if (keep_mode)
+                mode = st.st_mode & 07777;
+        else if (errno != ENOENT)
+                return -errno;
+
+        a->fd = openat(a->dfd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC, mode);
+        if (a->fd < 0) {
+                if (errno != EOPNOTSUPP && errno != EISDIR && errno != EINVAL)
+                        return -errno;
+
+                do {
+                        r = atomic_file_tmp_name(a);
+                        if (r < 0)
+                                return r;
+
+                        a->fd = openat(a->dfd, a->tmp, O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, mode);
+                } while (a->fd < 0 && errno == EEXIST);
+
+                if (a->fd < 0) {
+                        r = -errno;
+                        free(a->tmp);
+                        a->tmp = NULL;
+                        return r;
+                }
+        }
+
+        /* umask is applied on creation */
+        if (keep_mode && fchmod(a->fd, mode) < 0)
+                return -errno;
+
+        return 0;
+}
+
+static int atomic_file_write(struct atomic_file *a, const char *buf, size_t len, bool newline) {
+        ssize_t n;
+
+        while (len > 0) {
+                n = write(a->fd, buf, len);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+
+                buf += n;
+                len -= n;
+        }
+
+        if (newline)
+                return atomic_file_write(a, "\n", 1, false);
+
+        return 0;
+}
+
+/* Make the data durable and give the temporary file the target
+ * name. The directory has to be synced by the caller. */
+static int atomic_file_commit(struct atomic_file *a) {
+        char proc[sizeof("/proc/self/fd/") + DECIMAL_STR_MAX(int)];
+        int r;
+
+        if (fsync(a->fd) < 0)
+                return -errno;
+
+        if (!a->tmp) {
+                /* linkat(AT_EMPTY_PATH) needs CAP_DAC_READ_SEARCH */
+                snprintf(proc, sizeof(proc), "/proc/self/fd/%d", a->fd);
+
+                do {
+                        r = atomic_file_tmp_name(a);
+                        if (r < 0)
+                                return r;
+
+                        r = linkat(AT_FDCWD, proc, a->dfd, a->tmp, AT_SYMLINK_FOLLOW);
+                } while (r < 0 && errno == EEXIST);
+
+                if (r < 0) {
+                        r = -errno;
+                        free(a->tmp);
+                        a->tmp = NULL;
+                        return r;
+                }
+        }
+
+        if (renameat(a->dfd, a->tmp, a->dfd, a->base) < 0)
+                return -errno;
+
+        free(a->tmp);
+        a->tmp = NULL;
+
+        return 0;
+}
+
+static int write_buf_to_path_atomic(const char *path, const char *buf, size_t len,
+                                    bool newline, enum file_write_flags flags) {
+        _cleanup_(atomic_file_done) struct atomic_file a = ATOMIC_FILE_INIT;
+        int r;
+
+        /* Appending needs the old contents, which is not atomic */
+        if (flags & FILE_WRITE_APPEND)
+                return -EINVAL;
+
+        r = atomic_file_open(&a, path);
+        if (r < 0)
+                return r;
+
+        r = atomic_file_write(&a, buf, len, newline);
+        if (r < 0)
+                return r;
+
+        r = atomic_file_commit(&a);
+        if (r < 0)
+                return r;
+
+        if (fsync(a.dfd) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int write_str_to_path_batch(const struct file_write_entry *entries, size_t n, enum file_write_flags flags) {
+        struct atomic_file *a;
+        size_t i, j;
+        int r = 0;
+
+        assert(entries || n == 0);
+
+        if (flags & FILE_WRITE_APPEND)
+                return -EINVAL;
+
+        if (n == 0)
+                return 0;
+
+        a = new(struct atomic_file, n);
+        if (!a)
+                return -ENOMEM;
+
+        for (i = 0; i < n; i++)
+                a[i] = (struct atomic_file) ATOMIC_FILE_INIT;
+
+        /* All the data is durable before any target is replaced */
+        for (i = 0; i < n; i++) {
+                const char *str = entries[i].str;
+                bool newline = (flags & FILE_WRITE_NEWLINE_IF_NOT) && !endswith(str, "\n");
+
+                assert(entries[i].path);
+                assert(str);
+
+                r = atomic_file_open(&a[i], entries[i].path);
+                if (r < 0)
+                        goto finish;
+
+                r = atomic_file_write(&a[i], str, strlen(str), newline);
+                if (r < 0)
+                        goto finish;
+
+                if (fsync(a[i].fd) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+        }
+
+        for (i = 0; i < n; i++) {
+                /* fsync() again is cheap for the clean file */
+                r = atomic_file_commit(&a[i]);
+                if (r < 0)
+                        goto finish;
+        }
+
+        /* Once for each directory */
+        for (i = 0; i < n; i++) {
+                struct stat st, st2;
+                bool synced = false;
+
+                if (fstat(a[i].dfd, &st) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+
+                for (j = 0; j < i && !synced; j++)
+                        synced = fstat(a[j].dfd, &st2) >= 0 &&
+                                st.st_dev == st2.st_dev && st.st_ino == st2.st_ino;
+
+                if (!synced && fsync(a[i].dfd) < 0) {
+                        r = -errno;
+                        goto finish;
+                }
+        }
+
+finish:
+        for (i = 0; i < n; i++)
+                atomic_file_done(&a[i]);
+        free(a);
+
+        return r;
+}
+
+/*
+ * Write buf and the newline with a single writev(2), so that sysfs
+ * gets them in one store. path is relative to dfd, which is AT_FDCWD
+ * or a directory.
+ */
+static int write_buf_to_path_at(int dfd, const char *path, const char *buf, size_t len,
+                                bool newline, enum file_write_flags flags) {
+        _cleanup_close_ int fd = -1;
+        struct iovec iov[2] = {
+                { .iov_base = (void *) buf, .iov_len = len },
+                { .iov_base = (void *) "\n", .iov_len = newline ? 1 : 0 },
+        };
+        struct iovec *v = iov;
+        int n_iov = ELEMENTSOF(iov);
+        ssize_t n;
+
+        fd = openat(dfd, path, O_WRONLY | O_CREAT | O_NOCTTY | O_CLOEXEC |
+                    ((flags & FILE_WRITE_APPEND) ? O_APPEND : O_TRUNC), 0666);
+        if (fd < 0)
+                return -errno;
+
+        for (;;) {
+                for (; n_iov > 0 && v->iov_len == 0; v++, n_iov--)
+                        ;
+                if (n_iov == 0)
+                        return 0;
+
+                n = writev(fd, v, n_iov);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+                if (n == 0)
+                        return -EIO;
+
+                /* short write */
+                for (; n_iov > 0 && (size_t) n >= v->iov_len; v++, n_iov--)
+                        n -= v->iov_len;
+                if (n_iov > 0) {
+                        v->iov_base = (char *) v->iov_base + n;
+                        v->iov_len -= n;
+                }
+        }
+}
+
+static int write_buf_to_path(const char *path, const char *buf, size_t len,
+                             bool newline, enum file_write_flags flags) {
+        if (flags & FILE_WRITE_ATOMIC)
+                return write_buf_to_path_atomic(path, buf, len, newline, flags);
+
+        return write_buf_to_path_at(AT_FDCWD, path, buf, len, newline, flags);
+}
+
+/* The first number of a sysfs or procfs file is read by a single
+ * read(2), which is enough for the number and some white spaces. */
+#define NUM_FILE_BUF_SIZE       64
+
+static int read_decimal_from_path(const char *path, struct decimal *d) {
+        _cleanup_close_ int fd = -1;
+        char buf[NUM_FILE_BUF_SIZE];
+        ssize_t n;
+
+        fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        do {
+                n = read(fd, buf, sizeof(buf));
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+                return -errno;
+
+        return decimal_scan(buf, buf + n, d);
+}
+
+static int read_int64_from_path_internal(const char *path, int64_t *i) {
+        struct decimal d;
+        int r;
+
+        r = read_decimal_from_path(path, &d);
+        if (r > 0)
+                *i = decimal_to_int64(&d);
+
+        return r;
+}
+
+static int read_uint64_from_path_internal(const char *path, uint64_t *u) {
+        struct decimal d;
+        int r;
+
+        r = read_decimal_from_path(path, &d);
+        if (r > 0)
+                *u = decimal_to_uint64(&d);
+
+        return r;
+}
+
+int write_str_to_file(FILE *f, const char *str, enum file_write_flags flags) {
+        int r = 0;
+
+        assert(f);
+        assert(str);
+
+        STORE_RESET_ERRNO;
+
+        (void) fputs(str, f);
+        if ((flags & FILE_WRITE_NEWLINE_IF_NOT) && !endswith(str, "\n"))
+                (void) fputc('\n', f);
+
+        if (flags & FILE_WRITE_WITH_FFLUSH)
+                (void) fflush(f);
+
+        if (ferror(f))
+                r = errno ? -errno : -EIO;
+
+        RESTORE_ERRNO;
+
+        return r;
+}
+
+int write_str_to_path(const char *path, const char *str, enum file_write_flags flags) {
+        assert(path);
+        assert(str);
+
+        return write_buf_to_path(path, str, strlen(str),
+                                 (flags & FILE_WRITE_NEWLINE_IF_NOT) && !endswith(str, "\n"),
+                                 flags);
+}
+
+#define ATTR_BATCH_THREADS_MAX  8
+
+/* A directory of the attributes. path is not null terminated. */
+struct attr_batch_dir {
+        const char *path;
+        size_t len;
+        /* O_PATH descriptor, opened by the first write */
+        int fd;
+        bool opened;
+        /* the first entry in this directory */
+        size_t first;
+};
+
+struct attr_batch {
+        const struct file_write_entry *entries;
+        size_t n_entries;
+        enum file_write_flags flags;
+        int *status;
+        struct attr_batch_dir *dirs;
+        size_t n_dirs;
+        /* directory of each entry */
+        size_t *dir_of;
+        /* next entry in the same directory, n_entries at the end */
+        size_t *next;
+        /* the first error, accessed atomically */
+        int error;
+};
+
+static void attr_batch_set_status(struct attr_batch *b, size_t index, int r) {
+        int zero = 0;
+
+        if (b->status)
+                b->status[index] = r;
+
+        if (r < 0)
+                __atomic_compare_exchange_n(&b->error, &zero, r, false,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int attr_batch_group(struct attr_batch *b) {
+        size_t *last;
+        size_t i, d;
+
+        last = new(size_t, b->n_entries);
+        if (!last)
+                return -ENOMEM;
+
+        for (i = 0; i < b->n_entries; i++) {
+                const char *path = b->entries[i].path, *slash;
+                const char *dir;
+                size_t len;
+
+                assert(path);
+                assert(b->entries[i].str);
+
+                slash = strrchr(path, '/');
+                if (!slash) {
+                        dir = ".";
+                        len = 1;
+                } else {
+                        dir = path;
+                        len = slash == path ? 1 : (size_t) (slash - path);
+                }
+
+                /* Profiles touch a few dozens of directories at most */
+                for (d = 0; d < b->n_dirs; d++)
+                        if (b->dirs[d].len == len && strneq(b->dirs[d].path, dir, len))
+                                break;
+
+                if (d == b->n_dirs) {
+                        b->dirs[d] = (struct attr_batch_dir) {
+                                .path = dir,
+                                .len = len,
+                                .fd = -1,
+                                .first = i,
+                        };
+                        b->n_dirs++;
+                } else
+                        b->next[last[d]] = i;
+
+                b->dir_of[i] = d;
+                b->next[i] = b->n_entries;
+                last[d] = i;
+        }
+
+        free(last);
+
+        return 0;
+}
+
+static int attr_batch_dir_fd(struct attr_batch_dir *d) {
+        char path[PATH_MAX];
+
+        if (d->opened)
+                return d->fd;
+
+        d->opened = true;
+
+        if (d->len >= sizeof(path)) {
+                d->fd = -ENAMETOOLONG;
+                return d->fd;
+        }
+
+        memcpy(path, d->path, d->len);
+        path[d->len] = '\0';
+
+        d->fd = open(path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (d->fd < 0)
+                d->fd = -errno;
+
+        return d->fd;
+}
+
+static void attr_batch_write(struct attr_batch *b, size_t index) {
+        const char *path = b->entries[index].path, *str = b->entries[index].str, *base;
+        int dfd, r;
+
+        dfd = attr_batch_dir_fd(&b->dirs[b->dir_of[index]]);
+        if (dfd < 0) {
+                attr_batch_set_status(b, index, dfd);
+                return;
+        }
+
+        base = strrchr(path, '/');
+        base = base ? base + 1 : path;
+
+        r = write_buf_to_path_at(dfd, base, str, strlen(str),
+                                 (b->flags & FILE_WRITE_NEWLINE_IF_NOT) && !endswith(str, "\n"),
+                                 b->flags);
+        attr_batch_set_status(b, index, r);
+}
+
+static int attr_batch_write_dir(size_t index, void *buf, void *userdata) {
+        struct attr_batch *b = userdata;
+        size_t i;
+
+        for (i = b->dirs[index].first; i < b->n_entries; i = b->next[i])
+                attr_batch_write(b, i);
+
+        /* go on with the others */
+        return 0;
+}
+
+int write_attrs_batch(const struct file_write_entry *entries, size_t n, enum file_write_flags flags, int *status) {
+        _cleanup_free_ struct attr_batch_dir *dirs = NULL;
+        _cleanup_free_ size_t *dir_of = NULL, *next = NULL;
+        struct attr_batch b = {
+                .entries = entries,
+                .n_entries = n,
+                .flags = flags,
+                .status = status,
+        };
+        size_t i;
+        int r;
+
+        assert(entries || n == 0);
+
+        if (flags & FILE_WRITE_ATOMIC)
+                return -EINVAL;
+
+        if (n == 0)
+                return 0;
+
+        dirs = new(struct attr_batch_dir, n);
+        dir_of = new(size_t, n);
+        next = new(size_t, n);
+        if (!dirs || !dir_of || !next)
+                return -ENOMEM;
+
+        b.dirs = dirs;
+        b.dir_of = dir_of;
+        b.next = next;
+
+        r = attr_batch_group(&b);
+        if (r < 0)
+                return r;
+
+        if (flags & FILE_WRITE_PARALLEL) {
+                /* The writes are cpu bound in the kernel, more
+                 * threads than cpus only add the switches */
+                long c = sysconf(_SC_NPROCESSORS_ONLN);
+                unsigned int n_threads = c > 0 && c < ATTR_BATCH_THREADS_MAX ? c : ATTR_BATCH_THREADS_MAX;
+
+                r = work_pool_run(b.n_dirs, n_threads, 0, attr_batch_write_dir, &b);
+        } else
+                for (i = 0; i < n; i++)
+                        attr_batch_write(&b, i);
+
+        for (i = 0; i < b.n_dirs; i++)
+                if (dirs[i].fd >= 0)
+                        close(dirs[i].fd);
+
+        if (r < 0)
+                return r;
+
+        return b.error;
+}
+
+int read_one_line_from_file(FILE *f, char **line) {
+        _cleanup_free_ char *c = NULL;
+        size_t size = 0;
+        int r = 0;
+
+        assert(f);
+        assert(line);
+
+        STORE_RESET_ERRNO;
+
+        /* No limit of the line length */
+        if (getline(&c, &size, f) < 0) {
+                if (ferror(f))
+                        r = errno ? -errno : -EIO;
+                else if (!c)
+                        r = -ENOMEM;
+                else
+                        c[0] = 0;
+        }
+
+        RESTORE_ERRNO;
+
+        if (r < 0)
+                return r;
+
+        *line = truncate_nl(c);
+        c = NULL;
+
+        return 0;
+}
+
+int read_one_line_from_path(const char *path, char **line) {
+        _cleanup_close_ int fd = -1;
+        _cleanup_line_reader_done_ struct line_reader r = LINE_READER_INIT(-1);
+        char *l = NULL, *c;
+        size_t len = 0;
+        int ret;
+
+        assert(path);
+        assert(line);
+
+        fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        r.fd = fd;
+
+        ret = line_reader_next(&r, &l, &len);
+        if (ret < 0)
+                return ret;
+
+        c = ret > 0 ? strndup(l, len) : strdup("");
+        if (!c)
+                return -ENOMEM;
+
+        *line = truncate_nl(c);
+
+        return 0;
+}
+
+/* Files of procfs and sysfs have no size, they are read from this */
+#define READ_FULL_BUF_SIZE      4096
+
+int read_full_fd(int fd, char **buf, size_t *len) {
+        _cleanup_free_ char *b = NULL;
+        size_t l = 0, size = READ_FULL_BUF_SIZE;
+        struct stat st;
+        ssize_t n;
+
+        assert(fd >= 0);
+        assert(buf);
+
+        if (fstat(fd, &st) < 0)
+                return -errno;
+
+        /* One read for the contents and one to see the end */
+        if (S_ISREG(st.st_mode) && st.st_size > 0) {
+                if ((uint64_t) st.st_size > SIZE_MAX / 2)
+                        return -EFBIG;
+
+                size = st.st_size + 2;
+        }
+
+        for (;;) {
+                if (!b || size - l < 2) {
+                        char *t;
+
+                        if (b) {
+                                if (size > SIZE_MAX / 2)
+                                        return -EFBIG;
+                                size *= 2;
+                        }
+
+                        t = realloc(b, size);
+                        if (!t)
+                                return -ENOMEM;
+                        b = t;
+                }
+
+                n = read(fd, b + l, size - l - 1);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+
+                if (n == 0)
+                        break;
+
+                l += n;
+        }
+
+        b[l] = '\0';
+        *buf = b;
+        b = NULL;
+
+        if (len)
+                *len = l;
+
+        return 0;
+}
+
+int read_full_file(const char *path, char **buf, size_t *len) {
+        _cleanup_close_ int fd = -1;
+
+        assert(path);
+        assert(buf);
+
+        fd = open(path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        return read_full_fd(fd, buf, len);
+}
+
+#define LINE_READER_BUF_SIZE    4096
+
+static int line_reader_fill(struct line_reader *r) {
+        size_t keep;
+        ssize_t n;
+
+        keep = r->keep < r->pos ? r->keep : r->pos;
+        if (keep > 0) {
+                memmove(r->buf, r->buf + keep, r->len - keep);
+                r->len -= keep;
+                r->pos -= keep;
+                if (r->keep != (size_t) -1)
+                        r->keep -= keep;
+        }
+
+        /* Leave a byte to terminate the last line */
+        if (r->len + 1 >= r->size) {
+                size_t size;
+                char *t;
+
+                if (!r->alloc)
+                        return -ENOBUFS;
+
+                size = r->size ? r->size * 2 : LINE_READER_BUF_SIZE;
+                t = realloc(r->buf, size);
+                if (!t)
+                        return -ENOMEM;
+
+                r->buf = t;
+                r->size = size;
+        }
+
+        do {
+                n = read(r->fd, r->buf + r->len, r->size - 1 - r->len);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+                return -errno;
+
+        if (n == 0)
+                r->eof = true;
+
+        r->len += n;
+        r->buf[r->len] = 0;
+
+        return 0;
+}
+
+int line_reader_next(struct line_reader *r, char **line, size_t *len) {
+        int ret;
+
+        assert(r);
+        assert(line);
+        assert(len);
+
+        for (;;) {
+                if (r->buf) {
+                        char *s, *e;
+
+                        s = r->buf + r->pos;
+                        e = memchr(s, '\n', r->len - r->pos);
+                        if (e) {
+                                *e = 0;
+                                *line = s;
+                                *len = e - s;
+                                r->pos += *len + 1;
+                                return 1;
+                        }
+
+                        if (r->eof) {
+                                if (r->pos == r->len)
+                                        return 0;
+
+                                *line = s;
+                                *len = r->len - r->pos;
+                                r->pos = r->len;
+                                return 1;
+                        }
+                }
+
+                ret = line_reader_fill(r);
+                if (ret < 0)
+                        return ret;
+        }
+}
+
+void line_reader_done(struct line_reader *r) {
+        assert(r);
+
+        if (r->alloc) {
+                free(r->buf);
+                r->buf = NULL;
+                r->size = 0;
+        }
+}
+
+#define DEFINE_WRITE_NUM_TO_FILE(type, format)                          \
+        int write_##type##_to_file(FILE *f,                             \
+                                   type##_t u,                          \
+                                   enum file_write_flags flags) {       \
+                int r = 0;                                              \
+                                                                        \
+                assert(f);                                              \
+                                                                        \
+                STORE_RESET_ERRNO;                                      \
+                                                                        \
                 (void) fprintf(f, format, u);                           \
                 if (flags & FILE_WRITE_NEWLINE_IF_NOT)                  \
                         (void) fputc('\n', f);                          \
@@ -660,27 +2520,25 @@ int read_one_line_from_path(const char *path, char **line) {
                 return r;                                               \
         }
 
-#define DEFINE_WRITE_NUM_TO_PATH(type)                                  \
+#define DEFINE_WRITE_NUM_TO_PATH(type, kind)                            \
         int write_##type##_to_path(const char *path,                    \
                                    type##_t u,                          \
                                    enum file_write_flags flags) {       \
-                _cleanup_fclose_ FILE *f = NULL;                        \
+                char buf[DECIMAL_STR_MAX(type##_t) + 1];                \
+                size_t l;                                               \
                                                                         \
                 assert(path);                                           \
                                                                         \
-                if (flags & FILE_WRITE_APPEND)                          \
-                        f = fopen(path, "ae");                          \
-                else                                                    \
-                        f = fopen(path, "we");                          \
-                if (!f)                                                 \
-                        return -errno;                                  \
+                l = decimal_format_##kind(buf, u);                      \
+                if (flags & FILE_WRITE_NEWLINE_IF_NOT)                  \
+                        buf[l++] = '\n';                                \
                                                                         \
-                return write_##type##_to_file(f, u, flags);             \
+                return write_buf_to_path(path, buf, l, false, flags);   \
         }
 
-#define DEFINE_WRITE_NUM_DUAL(type, format)     \
-        DEFINE_WRITE_NUM_TO_FILE(type, format); \
-        DEFINE_WRITE_NUM_TO_PATH(type)
+#define DEFINE_WRITE_NUM_DUAL(type, kind, format) \
+        DEFINE_WRITE_NUM_TO_FILE(type, format);   \
+        DEFINE_WRITE_NUM_TO_PATH(type, kind)
 
 #define DEFINE_READ_NUM_FROM_FILE(type, format)                 \
         int read_##type##_from_file(FILE *f, type##_t *num) {   \
@@ -700,32 +2558,34 @@ int read_one_line_from_path(const char *path, char **line) {
                 return r;                                       \
         }
 
-#define DEFINE_READ_NUM_FROM_PATH(type)                                 \
+#define DEFINE_READ_NUM_FROM_PATH(type, kind)                           \
         int read_##type##_from_path(const char *path, type##_t *num) {  \
-                _cleanup_fclose_ FILE *f = NULL;                        \
+                kind##_t v;                                             \
+                int r;                                                  \
                                                                         \
                 assert(path);                                           \
                 assert(num);                                            \
                                                                         \
-                f = fopen(path, "re");                                  \
-                if (!f)                                                 \
-                        return -errno;                                  \
+                r = read_##kind##_from_path_internal(path, &v);         \
+                if (r > 0)                                              \
+                        *num = (type##_t) v;                            \
                                                                         \
-                return read_##type##_from_file(f, num);                 \
+                return r;                                               \
         }
 
-#define DEFINE_READ_NUM_DUAL(type, format)              \
+#define DEFINE_READ_NUM_DUAL(type, kind, format)        \
         DEFINE_READ_NUM_FROM_FILE(type, format);        \
-        DEFINE_READ_NUM_FROM_PATH(type)
+        DEFINE_READ_NUM_FROM_PATH(type, kind)
 
-#define DEFINE_READ_WRITE_NUM_DUAL(type, r_format, w_format)    \
-        DEFINE_READ_NUM_DUAL(type, r_format);                   \
-        DEFINE_WRITE_NUM_DUAL(type, w_format)
+/* kind is the 64 bit type which the path functions convert with */
+#define DEFINE_READ_WRITE_NUM_DUAL(type, kind, r_format, w_format)      \
+        DEFINE_READ_NUM_DUAL(type, kind, r_format);                     \
+        DEFINE_WRITE_NUM_DUAL(type, kind, w_format)
 
-DEFINE_READ_WRITE_NUM_DUAL(int32, "%d", "%d");
-DEFINE_READ_WRITE_NUM_DUAL(uint32, "%u", "%u");
-DEFINE_READ_WRITE_NUM_DUAL(int64, "%" SCNd64, "%" PRId64);
-DEFINE_READ_WRITE_NUM_DUAL(uint64, "%" SCNu64, "%" PRIu64);
+DEFINE_READ_WRITE_NUM_DUAL(int32, int64, "%d", "%d");
+DEFINE_READ_WRITE_NUM_DUAL(uint32, uint64, "%u", "%u");
+DEFINE_READ_WRITE_NUM_DUAL(int64, int64, "%" SCNd64, "%" PRId64);
+DEFINE_READ_WRITE_NUM_DUAL(uint64, uint64, "%" SCNu64, "%" PRIu64);
 
 int write_int_to_file(FILE *f, int num, enum file_write_flags flags) {
 
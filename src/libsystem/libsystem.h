@@ -242,6 +242,17 @@ char *path_kill_slashes(char *path);
  */
 #define ELEMENTSOF(x) (sizeof(x)/sizeof((x)[0]))
 
+/**
+ * Get maximum string length of decimal integer type including sign
+ * and terminating null. The result is an upper bound which is
+ * suitable for buffer size.
+ */
+#define DECIMAL_STR_MAX(type)                                           \
+        (2 + (sizeof(type) <= 1 ? 3 :                                   \
+              sizeof(type) <= 2 ? 5 :                                   \
+              sizeof(type) <= 4 ? 10 :                                  \
+              sizeof(type) <= 8 ? 20 : sizeof(int[-2 * (sizeof(type) > 8)])))
+
 /**
  * Iterate for each struct reference.
  */
@@ -273,6 +284,55 @@ char *path_kill_slashes(char *path);
  */
 bool is_number(const char *s, int l);
 
+/**
+ * flags for copy_bytes() and do_copy_full()
+ */
+enum copy_flags {
+        /** Overwrite the destination if it exists. */
+        COPY_FORCE                      = 1 << 0,
+        /** Try to share the extents with FICLONE ioctl first. If the
+         * file system does not support it, the data is copied. */
+        COPY_REFLINK                    = 1 << 1,
+        /** Flush the destination file system once when all the files
+         * are copied. Only for do_copy_tree(). */
+        COPY_SYNC                       = 1 << 2,
+        /** Batch the opens, reads and writes of many files on
+         * io_uring if the kernel supports it. Only for
+         * do_copy_many(). */
+        COPY_URING                      = 1 << 3,
+};
+
+/**
+ * @brief Copy data of a file descriptor to another. If rfd is a
+ * regular file, whole file is copied to the same offsets of wfd with
+ * copy_file_range(2), sendfile(2) or read/write in the order of
+ * availability. Holes of the source are not written, so wfd should be
+ * an empty file to keep them sparse. For the other types such like
+ * pipes or procfs files, data is read from the current offset of rfd
+ * until end of file and written to the current offset of wfd.
+ *
+ * @param rfd source file descriptor
+ * @param wfd destination file descriptor
+ * @param flags optional ::COPY_REFLINK. ::COPY_FORCE is ignored.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int copy_bytes(int rfd, int wfd, enum copy_flags flags);
+
+/**
+ * @brief copy a file with mode and flags. See copy_bytes() for how
+ * the data is copied.
+ *
+ * @param src source file path
+ * @param dst destination file path
+ * @param mode destination file mode, if the file is created
+ * @param flags combination of ::copy_flags
+ *
+ * @return 0 on success, -errno on failure. -EALREADY if destination
+ * file exist and ::COPY_FORCE is not given.
+ */
+int do_copy_full(const char *src, const char *dst, mode_t mode, enum copy_flags flags);
+
 /**
  * @brief copy a file with mode, if destination file exists, return
  * error.
@@ -321,6 +381,55 @@ int do_copy(const char *src, const char *dst);
  */
 int do_copy_force(const char *src, const char *dst);
 
+/**
+ * @brief Copy a directory tree. Regular files are copied on up to 8
+ * threads in the way of copy_bytes(). Directories, symbolic links and
+ * special files are recreated. Modes and timestamps are preserved,
+ * and so are owners if permitted. Hard links are copied as separated
+ * files. Symbolic links are not followed.
+ *
+ * @param src source directory path
+ * @param dst destination directory path
+ * @param flags combination of ::copy_flags. With ::COPY_FORCE, dst
+ * and its subdirectories may exist and existing files are
+ * overwritten. With ::COPY_SYNC, the destination file system is
+ * synced once at the end.
+ *
+ * @return 0 on success, -errno on failure. -EALREADY if destination
+ * exists and ::COPY_FORCE is not given. On failure, partially copied
+ * tree is left.
+ */
+int do_copy_tree(const char *src, const char *dst, enum copy_flags flags);
+
+/**
+ * A pair of files for do_copy_many()
+ */
+struct copy_pair {
+        /** source file path */
+        const char *src;
+        /** destination file path */
+        const char *dst;
+};
+
+/**
+ * @brief Copy many files at once. By default, the files are copied
+ * by do_copy_full() on up to 8 threads. With ::COPY_URING, up to 16
+ * files are copied at once on a single thread with io_uring, which
+ * saves most of the syscalls for small files. If io_uring is not
+ * available or ::COPY_REFLINK is given, the default way is used.
+ *
+ * @param pairs array of files to copy
+ * @param n number of pairs
+ * @param mode destination file mode, if the file is created
+ * @param flags combination of ::copy_flags
+ * @param status if not NULL, array of n where the result of each
+ * copy is stored, 0 or -errno as do_copy_full().
+ *
+ * @return 0 if all the files are copied, the first error of the
+ * copies or -errno on the other failure.
+ */
+int do_copy_many(const struct copy_pair *pairs, size_t n, mode_t mode, enum copy_flags flags, int *status);
+
 /**
  * @brief Make a directory. If parent directories are also absent,
  * make them also. Corresponding with "mkdir -p".
@@ -333,14 +442,37 @@ int do_copy_force(const char *src, const char *dst);
 int do_mkdir(const char *path, mode_t mode);
 
 /**
- * @brief Remove all elements in path recursivly.
+ * @brief Remove all elements in path recursivly, and path
+ * itself. Symbolic links are removed, not followed. The tree is
+ * walked without recursion, so deep nesting is limited only by the
+ * number of open files.
  *
- * @param path Path to make directory.
+ * @param path Path of directory to remove.
  *
- * @return 0 on success, -errno on failure.
+ * @return 0 on success, -errno on failure. -ELOOP if path is a
+ * symbolic link.
  */
 int rmdir_recursive(const char *path);
 
+/**
+ * flags for rmdir_recursive_full()
+ */
+enum rmdir_flags {
+        /** Batch the unlinks of files on io_uring if the kernel
+         * supports it. */
+        RMDIR_URING                     = 1 << 0,
+};
+
+/**
+ * @brief rmdir_recursive() with flags.
+ *
+ * @param path Path of directory to remove.
+ * @param flags combination of ::rmdir_flags
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int rmdir_recursive_full(const char *path, enum rmdir_flags flags);
+
 /**
  * @defgroup FILE_READ_WRITE_GROUP File Read/Write utility
  *
@@ -359,6 +491,20 @@ enum file_write_flags {
         FILE_WRITE_WITH_FFLUSH          =  1 << 1,
         /** Open file as append mode. */
         FILE_WRITE_APPEND               =  1 << 2,
+        /** Only for write_*_to_path(). Write to a temporary file in
+         * the same directory, fsync(2) it, rename it over the path
+         * and fsync(2) the directory. After a crash, the path has
+         * either old or new contents. The mode of the existing file
+         * is kept. If the path is a symbolic link, the file it points
+         * to is replaced and the link is kept, and a dangling link
+         * fails with -ENOENT. Can not be used with
+         * ::FILE_WRITE_APPEND. */
+        FILE_WRITE_ATOMIC               =  1 << 3,
+        /** Only for write_attrs_batch(). Write the files of each
+         * directory on up to 8 threads, but not more than the online
+         * cpus. The files in a directory are
+         * still written in order, but the directories are not. */
+        FILE_WRITE_PARALLEL             =  1 << 4,
 };
 
 /**
@@ -389,6 +535,57 @@ int write_str_to_file(FILE *f, const char *str, enum file_write_flags flags);
  */
 int write_str_to_path(const char *path, const char *str, enum file_write_flags flags);
 
+/**
+ * A file and its contents for write_str_to_path_batch() and
+ * write_attrs_batch()
+ */
+struct file_write_entry {
+        /** File path. */
+        const char *path;
+        /** Strings to write. */
+        const char *str;
+};
+
+/**
+ * @brief Write strings to many paths like ::FILE_WRITE_ATOMIC. All
+ * the temporary files are synced before any path is replaced, and
+ * each directory is synced once at the end, instead of once for each
+ * file. Each path is replaced atomically, but a crash during the
+ * renames may leave some paths replaced and the others not.
+ *
+ * @param entries Array of paths and strings to write.
+ * @param n Number of entries.
+ * @param flags Optional flags to write file. ::FILE_WRITE_ATOMIC is
+ * implied and ::FILE_WRITE_APPEND is not allowed.
+ *
+ * @return 0 on success, -errno on failure. On failure before the
+ * renames, no path is changed.
+ */
+int write_str_to_path_batch(const struct file_write_entry *entries, size_t n, enum file_write_flags flags);
+
+/**
+ * @brief Write strings to many attribute files of sysfs, procfs or
+ * cgroupfs, such as a performance profile. The entries are grouped
+ * by directory, and each directory is opened once. The files are
+ * opened relative to it with openat(2), which skips the lookup of
+ * the leading path for each file.
+ *
+ * The entries are written in the given order unless
+ * ::FILE_WRITE_PARALLEL is set. A failed write does not stop the
+ * others.
+ *
+ * @param entries Array of paths and strings to write.
+ * @param n Number of entries.
+ * @param flags Optional flags to write file. ::FILE_WRITE_ATOMIC is
+ * not allowed.
+ * @param status If not NULL, array of n where the result of each
+ * write is stored, 0 or -errno as write_str_to_path().
+ *
+ * @return 0 if all the entries are written, the first error of the
+ * writes or -errno on the other failure.
+ */
+int write_attrs_batch(const struct file_write_entry *entries, size_t n, enum file_write_flags flags, int *status);
+
 /**
  * @brief Write signed decimal integer to FILE.
  *
@@ -650,7 +847,8 @@ int write_unsigned_long_long_int_to_file(FILE *f, unsigned long long int num, en
 int write_unsigned_long_long_int_to_path(const char *path, unsigned long long int num, enum file_write_flags flags);
 
 /**
- * @brief Read the first line from FILE
+ * @brief Read the first line from FILE. The line is not limited in
+ * length.
  *
  * @param f File pointer.
  * @param line Duplicated string line is filled. This value has to
@@ -661,7 +859,8 @@ int write_unsigned_long_long_int_to_path(const char *path, unsigned long long in
 int read_one_line_from_file(FILE *f, char **line);
 
 /**
- * @brief Read the first line from path
+ * @brief Read the first line from path. The line is not limited in
+ * length.
  *
  * @param path File path.
  * @param line Duplicated string line is filled. This value has to
@@ -671,6 +870,107 @@ int read_one_line_from_file(FILE *f, char **line);
  */
 int read_one_line_from_path(const char *path, char **line);
 
+/**
+ * @brief Read the whole file from the current offset. For a regular
+ * file, the buffer is sized by fstat(2) and filled by a single
+ * read(2). For procfs, sysfs or a pipe, which have no size, the
+ * buffer grows twice from 4KiB.
+ *
+ * @param fd File descriptor.
+ * @param buf Null terminated contents are filled. This value has to
+ * be free-ed by caller.
+ * @param len If not NULL, length of the contents is filled, without
+ * the terminating null.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int read_full_fd(int fd, char **buf, size_t *len);
+
+/**
+ * @brief Read the whole file. See read_full_fd().
+ *
+ * @param path File path.
+ * @param buf Null terminated contents are filled. This value has to
+ * be free-ed by caller.
+ * @param len If not NULL, length of the contents is filled, without
+ * the terminating null.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int read_full_file(const char *path, char **buf, size_t *len);
+
+/**
+ * Line reader of a file descriptor. Each line is given as a pointer
+ * into the buffer of the reader, so no line is copied or allocated.
+ * Initialize with #LINE_READER_INIT or #LINE_READER_INIT_BUF. The
+ * members are private except keep.
+ * @code{.c}
+ {
+         _cleanup_close_ int fd = open("/proc/self/mountinfo", O_RDONLY | O_CLOEXEC);
+         _cleanup_line_reader_done_ struct line_reader r = LINE_READER_INIT(fd);
+         char *line;
+         size_t len;
+
+         while (line_reader_next(&r, &line, &len) > 0)
+                 ...
+ }
+ * @endcode
+ */
+struct line_reader {
+        int fd;
+        char *buf;
+        size_t size;
+        size_t len;
+        size_t pos;
+        /** Offset of a line in buf which has to be kept valid over
+         * the next calls, or (size_t) -1. The line may be moved in
+         * buf, so it has to be referred by the offset. */
+        size_t keep;
+        bool eof;
+        /** buf is allocated by the reader and grows as needed */
+        bool alloc;
+};
+
+/**
+ * Initializer of a line reader with a buffer which grows as long as
+ * the longest line. line_reader_done() frees the buffer.
+ */
+#define LINE_READER_INIT(_fd)                                           \
+        { .fd = (_fd), .keep = (size_t) -1, .alloc = true }
+
+/**
+ * Initializer of a line reader with the given buffer. A line longer
+ * than size - 1 fails with -ENOBUFS.
+ */
+#define LINE_READER_INIT_BUF(_fd, _buf, _size)                          \
+        { .fd = (_fd), .buf = (_buf), .size = (_size), .keep = (size_t) -1 }
+
+/**
+ * @brief Get the next line. The line is null terminated without the
+ * line-end, and valid until the next call.
+ *
+ * @param r a line reader
+ * @param line The line is filled.
+ * @param len Length of the line is filled.
+ *
+ * @return 1 on a line, 0 on the end of file, -errno on failure.
+ */
+int line_reader_next(struct line_reader *r, char **line, size_t *len);
+
+/**
+ * @brief Free the buffer of a line reader. The file descriptor is
+ * not closed.
+ *
+ * @param r a line reader
+ */
+void line_reader_done(struct line_reader *r);
+
+/**
+ * Declare struct line_reader with cleanup attribute. The buffer is
+ * freed on going out the scope.
+ */
+#define _cleanup_line_reader_done_ _cleanup_(line_reader_done)
+
 /**
  * @brief Read signed decimal integer from FILE.
  *
@@ -1544,6 +1844,15 @@ int timestr_to_sec(const char *format, const char *time, time_t *sec);
  */
 void msec_to_timeval(uint64_t msec, struct timeval *tv);
 
+/**
+ * @brief Get current time of given clock in microsecond
+ *
+ * @param clock clock id such like CLOCK_MONOTONIC
+ *
+ * @return current time in microsecond
+ */
+uint64_t now_usec(clockid_t clock);
+
 /**
  * @brief Check string is float.
  *
@@ -0,0 +1,104 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The list of /proc/meminfo keys. enum meminfo_id, enum meminfo_mask,
+ * the id to string table and the gperf lookup are all generated from
+ * this list. Do not include this file directly, use proc.h.
+ *
+ * MEMINFO_KEY(id, key) is a key which has enum meminfo_mask, new keys
+ * have to be added with MEMINFO_KEY_EXT(id, key) at the end of the
+ * list. Those are only able to be selected by struct meminfo_bitset
+ * as the 64 bit mask is running out, and struct meminfo is sized by
+ * the MEMINFO_KEY() entries only. Each line has to be a single
+ * MEMINFO_KEY or MEMINFO_KEY_EXT, the gperf file is generated with
+ * sed.
+ */
+
+#ifndef MEMINFO_KEY_EXT
+#define MEMINFO_KEY_EXT(id, key) MEMINFO_KEY(id, key)
+#endif
+
+MEMINFO_KEY(MEM_TOTAL, "MemTotal")
+MEMINFO_KEY(MEM_FREE, "MemFree")
+MEMINFO_KEY(MEM_AVAILABLE, "MemAvailable")
+MEMINFO_KEY(BUFFERS, "Buffers")
+MEMINFO_KEY(CACHED, "Cached")
+MEMINFO_KEY(SWAP_CACHED, "SwapCached")
+MEMINFO_KEY(ACTIVE, "Active")
+MEMINFO_KEY(INACTIVE, "Inactive")
+MEMINFO_KEY(ACTIVE_ANON, "Active(anon)")
+MEMINFO_KEY(INACTIVE_ANON, "Inactive(anon)")
+MEMINFO_KEY(ACTIVE_FILE, "Active(file)")
+MEMINFO_KEY(INACTIVE_FILE, "Inactive(file)")
+MEMINFO_KEY(UNEVICTABLE, "Unevictable")
+MEMINFO_KEY(MLOCKED, "Mlocked")
+MEMINFO_KEY(HIGH_TOTAL, "HighTotal")
+MEMINFO_KEY(HIGH_FREE, "HighFree")
+MEMINFO_KEY(LOW_TOTAL, "LowTotal")
+MEMINFO_KEY(LOW_FREE, "LowFree")
+MEMINFO_KEY(SWAP_TOTAL, "SwapTotal")
+MEMINFO_KEY(SWAP_FREE, "SwapFree")
+MEMINFO_KEY(DIRTY, "Dirty")
+MEMINFO_KEY(WRITEBACK, "Writeback")
+MEMINFO_KEY(ANON_PAGES, "AnonPages")
+MEMINFO_KEY(MAPPED, "Mapped")
+MEMINFO_KEY(SHMEM, "Shmem")
+MEMINFO_KEY(SLAB, "Slab")
+MEMINFO_KEY(SRECLAIMABLE, "SReclaimable")
+MEMINFO_KEY(SUNRECLAIM, "SUnreclaim")
+MEMINFO_KEY(KERNEL_STACK, "KernelStack")
+MEMINFO_KEY(PAGE_TABLES, "PageTables")
+MEMINFO_KEY(NFS_UNSTABLE, "NFS_Unstable")
+MEMINFO_KEY(BOUNCE, "Bounce")
+MEMINFO_KEY(WRITEBACK_TMP, "WritebackTmp")
+MEMINFO_KEY(COMMIT_LIMIT, "CommitLimit")
+MEMINFO_KEY(COMMITTED_AS, "Committed_AS")
+MEMINFO_KEY(VMALLOC_TOTAL, "VmallocTotal")
+MEMINFO_KEY(VMALLOC_USED, "VmallocUsed")
+MEMINFO_KEY(VMALLOC_CHUNK, "VmallocChunk")
+MEMINFO_KEY_EXT(ZSWAP, "Zswap")
+MEMINFO_KEY_EXT(ZSWAPPED, "Zswapped")
+MEMINFO_KEY_EXT(KRECLAIMABLE, "KReclaimable")
+MEMINFO_KEY_EXT(SHADOW_CALL_STACK, "ShadowCallStack")
+MEMINFO_KEY_EXT(SEC_PAGE_TABLES, "SecPageTables")
+MEMINFO_KEY_EXT(PERCPU, "Percpu")
+MEMINFO_KEY_EXT(HARDWARE_CORRUPTED, "HardwareCorrupted")
+MEMINFO_KEY_EXT(ANON_HUGE_PAGES, "AnonHugePages")
+MEMINFO_KEY_EXT(SHMEM_HUGE_PAGES, "ShmemHugePages")
+MEMINFO_KEY_EXT(SHMEM_PMD_MAPPED, "ShmemPmdMapped")
+MEMINFO_KEY_EXT(FILE_HUGE_PAGES, "FileHugePages")
+MEMINFO_KEY_EXT(FILE_PMD_MAPPED, "FilePmdMapped")
+MEMINFO_KEY_EXT(CMA_TOTAL, "CmaTotal")
+MEMINFO_KEY_EXT(CMA_FREE, "CmaFree")
+MEMINFO_KEY_EXT(UNACCEPTED, "Unaccepted")
+MEMINFO_KEY_EXT(BALLOON, "Balloon")
+MEMINFO_KEY_EXT(HUGE_PAGES_TOTAL, "HugePages_Total")
+MEMINFO_KEY_EXT(HUGE_PAGES_FREE, "HugePages_Free")
+MEMINFO_KEY_EXT(HUGE_PAGES_RSVD, "HugePages_Rsvd")
+MEMINFO_KEY_EXT(HUGE_PAGES_SURP, "HugePages_Surp")
+MEMINFO_KEY_EXT(HUGEPAGESIZE, "Hugepagesize")
+MEMINFO_KEY_EXT(HUGETLB, "Hugetlb")
+MEMINFO_KEY_EXT(DIRECT_MAP_4K, "DirectMap4k")
+MEMINFO_KEY_EXT(DIRECT_MAP_4M, "DirectMap4M")
+MEMINFO_KEY_EXT(DIRECT_MAP_2M, "DirectMap2M")
+MEMINFO_KEY_EXT(DIRECT_MAP_1G, "DirectMap1G")
+
+#undef MEMINFO_KEY_EXT
@@ -0,0 +1,187 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal scanner for "Key:   value kB" formatted /proc files. This
+ * header is not installed.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "proc.h"
+#include "decimal.h"
+
+#define SCAN_ONES       0x0101010101010101ULL
+#define SCAN_HIGHS      0x8080808080808080ULL
+
+/* Set the high bit of each byte which is zero. Bits above the first
+ * zero byte may be false positive, but the lowest one is exact. */
+static inline uint64_t scan_zero_bytes(uint64_t x) {
+        return (x - SCAN_ONES) & ~x & SCAN_HIGHS;
+}
+
+static inline uint64_t scan_load64(const char *p) {
+        uint64_t x;
+
+        memcpy(&x, p, sizeof(x));
+
+        return x;
+}
+
+/* Find the first a or b in [p, end). Return end if not found. */
+static inline const char *scan_find2(const char *p, const char *end, char a, char b) {
+#ifdef __SSE2__
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+
+        for (; end - p >= 16; p += 16) {
+                __m128i x = _mm_loadu_si128((const __m128i *) p);
+                int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+                                                       _mm_cmpeq_epi8(x, vb)));
+                if (m)
+                        return p + __builtin_ctz(m);
+        }
+#elif __BYTE_ORDER == __LITTLE_ENDIAN
+        const uint64_t pa = SCAN_ONES * (unsigned char) a;
+        const uint64_t pb = SCAN_ONES * (unsigned char) b;
+
+        for (; end - p >= 8; p += 8) {
+                uint64_t x = scan_load64(p);
+                uint64_t m = scan_zero_bytes(x ^ pa) | scan_zero_bytes(x ^ pb);
+
+                if (m)
+                        return p + (__builtin_ctzll(m) >> 3);
+        }
+#endif
+
+        for (; p < end; p++)
+                if (*p == a || *p == b)
+                        return p;
+
+        return end;
+}
+
+/* Find the first c in [p, end). Return end if not found. */
+static inline const char *scan_find(const char *p, const char *end, char c) {
+        return scan_find2(p, end, c, c);
+}
+
+static inline const char *scan_skip_blank(const char *p, const char *end) {
+        while (p < end && (*p == ' ' || *p == '\t'))
+                p++;
+
+        return p;
+}
+
+/* Parse decimal digits, saturated at UINT64_MAX. Return the pointer
+ * next to the last digit. */
+static inline const char *scan_u64(const char *p, const char *end, uint64_t *v) {
+        bool overflow;
+
+        return decimal_scan_digits(p, end, v, &overflow);
+}
+
+/* Parse hexadecimal digits in lower case, such like smaps address. */
+static inline const char *scan_x64(const char *p, const char *end, uint64_t *v) {
+        uint64_t n = 0;
+
+        for (; p < end; p++) {
+                unsigned int d = (unsigned char) *p - '0';
+
+                if (d > 9) {
+                        d = (unsigned char) *p - 'a';
+                        if (d > 5)
+                                break;
+                        d += 10;
+                }
+
+                n = (n << 4) | d;
+        }
+
+        *v = n;
+
+        return p;
+}
+
+/*
+ * A record of "Key<sep>   value" line. For "MemTotal:  100 kB",
+ * key is "MemTotal" and value is 100. The key is not null terminated.
+ */
+struct proc_scan_record {
+        const char *key;
+        size_t key_len;
+        uint64_t value;
+        /* pointer next to the value digits */
+        const char *value_end;
+        const char *line;
+        const char *line_end;
+};
+
+/*
+ * Scan the next line in [*p, end). If the line has no sep, key_len is
+ * 0 and value is not parsed. *p is moved to the next line.
+ *
+ * Return 1 on a line, 0 on end of buffer.
+ */
+static inline int proc_scan_next(const char **p, const char *end, char sep, struct proc_scan_record *rec) {
+        const char *s = *p, *e;
+
+        if (s >= end)
+                return 0;
+
+        rec->line = s;
+
+        e = scan_find2(s, end, sep, '\n');
+        if (e == end || *e == '\n') {
+                rec->key = NULL;
+                rec->key_len = 0;
+                rec->line_end = e;
+                *p = e < end ? e + 1 : end;
+                return 1;
+        }
+
+        rec->key = s;
+        rec->key_len = e - s;
+
+        s = scan_skip_blank(e + 1, end);
+        rec->value_end = scan_u64(s, end, &rec->value);
+
+        e = scan_find(rec->value_end, end, '\n');
+        rec->line_end = e;
+        *p = e < end ? e + 1 : end;
+
+        return 1;
+}
+
+/* Lookups with string length, defined in gperf generated files */
+enum smap_id smap_string_len_to_id(const char *str, size_t len);
+enum meminfo_id meminfo_string_len_to_id(const char *str, size_t len);
+enum proc_status_id proc_status_string_len_to_id(const char *str, size_t len);
+enum cgroup_memory_stat_id cgroup_memory_stat_string_len_to_id(const char *str, size_t len);
+enum cgroup_cpu_stat_id cgroup_cpu_stat_string_len_to_id(const char *str, size_t len);
+enum cgroup_io_stat_id cgroup_io_stat_string_len_to_id(const char *str, size_t len);
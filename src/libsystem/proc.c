@@ -23,398 +23,2392 @@
 #include <errno.h>
 #include <assert.h>
 #include <limits.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
 
 #include "libsystem.h"
 #include "proc.h"
+#include "proc-scan.h"
+#include "work-pool.h"
+
+struct proc_cmdline_entry {
+        const char *key;
+        /* NULL if no '=' */
+        const char *value;
+        /* position in cmdline, the last one wins for same keys */
+        size_t order;
+};
+
+struct proc_cmdline {
+        char *buf;
+        size_t n_entry;
+        struct proc_cmdline_entry *entries;
+};
+
+/* Split an argument in place as same as next_arg() of the kernel.
+ * Return the next argument. */
+static char *cmdline_next_arg(char *args, char **key, char **value) {
+        size_t i, equals = 0;
+        bool in_quote = false, quoted = false;
+
+        if (*args == '"') {
+                args++;
+                in_quote = true;
+                quoted = true;
+        }
+
+        for (i = 0; args[i]; i++) {
+                if (strchr(WHITESPACE, args[i]) && !in_quote)
+                        break;
+
+                if (equals == 0 && args[i] == '=')
+                        equals = i;
+
+                if (args[i] == '"')
+                        in_quote = !in_quote;
+        }
+
+        *key = args;
+        if (!equals)
+                *value = NULL;
+        else {
+                args[equals] = '\0';
+                *value = args + equals + 1;
+
+                /* Don't include quotes in value */
+                if (**value == '"') {
+                        (*value)++;
+                        if (args[i - 1] == '"')
+                                args[i - 1] = '\0';
+                }
+        }
+
+        if (quoted && i > 0 && args[i - 1] == '"')
+                args[i - 1] = '\0';
+
+        if (args[i]) {
+                args[i] = '\0';
+                args += i + 1;
+        } else
+                args += i;
+
+        return args + strspn(args, WHITESPACE);
+}
+
+static int proc_cmdline_entry_compare(const void *a, const void *b) {
+        const struct proc_cmdline_entry *x = a, *y = b;
+        int r;
+
+        r = strcmp(x->key, y->key);
+        if (r)
+                return r;
+
+        return (x->order > y->order) - (x->order < y->order);
+}
+
+static int proc_cmdline_parse(char *buf, struct proc_cmdline **cmdline) {
+        _cleanup_free_ char *b = buf;
+        struct proc_cmdline *c;
+        size_t n = 0, n_max;
+        char *p;
+
+        /* an argument takes at least two characters with separator */
+        n_max = strlen(b) / 2 + 1;
+
+        c = new0(struct proc_cmdline, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->entries = new(struct proc_cmdline_entry, n_max);
+        if (!c->entries) {
+                free(c);
+                return -ENOMEM;
+        }
+
+        for (p = b + strspn(b, WHITESPACE); *p;) {
+                char *key, *value;
+
+                p = cmdline_next_arg(p, &key, &value);
+
+                /* "--" separates arguments for init */
+                if (!*key || (!value && streq(key, "--")))
+                        continue;
+
+                c->entries[n].key = key;
+                c->entries[n].value = value;
+                c->entries[n].order = n;
+                n++;
+        }
+
+        qsort(c->entries, n, sizeof(struct proc_cmdline_entry), proc_cmdline_entry_compare);
+
+        c->n_entry = n;
+        c->buf = b;
+        b = NULL;
+
+        *cmdline = c;
+
+        return 0;
+}
+
+int proc_cmdline_new_from_string(const char *str, struct proc_cmdline **cmdline) {
+        char *buf;
+
+        assert(str);
+        assert(cmdline);
+
+        buf = strdup(str);
+        if (!buf)
+                return -ENOMEM;
+
+        return proc_cmdline_parse(buf, cmdline);
+}
+
+int proc_cmdline_new(struct proc_cmdline **cmdline) {
+        char *buf = NULL;
+        int r;
+
+        assert(cmdline);
+
+        r = read_full_file("/proc/cmdline", &buf, NULL);
+        if (r < 0)
+                return r;
+
+        return proc_cmdline_parse(buf, cmdline);
+}
+
+void proc_cmdline_free(struct proc_cmdline *cmdline) {
+        if (!cmdline)
+                return;
+
+        free(cmdline->entries);
+        free(cmdline->buf);
+        free(cmdline);
+}
+
+size_t proc_cmdline_size(const struct proc_cmdline *cmdline) {
+        assert(cmdline);
+
+        return cmdline->n_entry;
+}
+
+int proc_cmdline_get(const struct proc_cmdline *cmdline, const char *key, const char **value) {
+        size_t l = 0, r, found = (size_t) -1;
+
+        assert(cmdline);
+        assert(key);
+
+        /* The last one of the same keys */
+        r = cmdline->n_entry;
+        while (l < r) {
+                size_t m = l + (r - l) / 2;
+                int c = strcmp(cmdline->entries[m].key, key);
+
+                if (c <= 0) {
+                        if (c == 0)
+                                found = m;
+                        l = m + 1;
+                } else
+                        r = m;
+        }
+
+        if (found == (size_t) -1)
+                return -ENOENT;
+
+        if (value)
+                *value = cmdline->entries[found].value;
+
+        return 0;
+}
+
+int proc_cmdline_get_bool(const struct proc_cmdline *cmdline, const char *key, bool *value) {
+        const char *v;
+        int r;
+
+        assert(value);
+
+        r = proc_cmdline_get(cmdline, key, &v);
+        if (r < 0)
+                return r;
+
+        /* "quiet" without value is true */
+        if (!v) {
+                *value = true;
+                return 0;
+        }
+
+        r = parse_boolean(v);
+        if (r < 0)
+                return r;
+
+        *value = r;
+
+        return 0;
+}
+
+int proc_cmdline_get_int(const struct proc_cmdline *cmdline, const char *key, int *value) {
+        const char *v;
+        char *e;
+        long l;
+        int r;
+
+        assert(value);
+
+        r = proc_cmdline_get(cmdline, key, &v);
+        if (r < 0)
+                return r;
+
+        if (!v || !*v)
+                return -EINVAL;
+
+        errno = 0;
+        l = strtol(v, &e, 0);
+        if (errno)
+                return -errno;
+
+        if (*e)
+                return -EINVAL;
+
+        if (l < INT_MIN || l > INT_MAX)
+                return -ERANGE;
+
+        *value = (int) l;
+
+        return 0;
+}
+
+int proc_cmdline_get_bytes(const struct proc_cmdline *cmdline, const char *key, size_t *value) {
+        const char *v;
+        int r;
+
+        assert(value);
+
+        r = proc_cmdline_get(cmdline, key, &v);
+        if (r < 0)
+                return r;
+
+        if (!v || !*v)
+                return -EINVAL;
+
+        return parse_bytes(v, value);
+}
+
+ssize_t proc_cmdline_get_str(char **buf, const char *op) {
+        _cleanup_proc_cmdline_free_ struct proc_cmdline *cmdline = NULL;
+        _cleanup_free_ char *key = NULL;
+        const char *v;
+        size_t l;
+        char *s;
+        int r;
+
+        assert(buf);
+        assert(op);
+
+        /* "foo=" is looked up as key "foo" */
+        l = strlen(op);
+        if (l > 0 && op[l - 1] == '=')
+                l--;
+
+        key = strndup(op, l);
+        if (!key)
+                return -ENOMEM;
+
+        r = proc_cmdline_new(&cmdline);
+        if (r < 0)
+                return r;
+
+        r = proc_cmdline_get(cmdline, key, &v);
+        if (r < 0)
+                return r;
+
+        s = strdup(v ? v : "");
+        if (!s)
+                return -ENOMEM;
+
+        *buf = s;
+
+        return strlen(s) + 1;
+}
+
+/* In old kernel, this symbol maybe NOT */
+#ifndef TASK_COMM_LEN
+#define TASK_COMM_LEN 16
+#endif
+
+/* Read <pid>/<name> relative to dfd, which is an opened /proc, with
+ * one read() and null terminate. Return the length read on success. */
+static ssize_t proc_read_at(int dfd, const char *pid, const char *name, char *buf, size_t size) {
+        char path[DECIMAL_STR_MAX(pid_t) + 16];
+        _cleanup_close_ int fd = -1;
+        ssize_t n;
+        int r;
+
+        assert(size > 0);
+
+        r = snprintf(path, sizeof(path), "%s/%s", pid, name);
+        if (r < 0 || (size_t) r >= sizeof(path))
+                return -EINVAL;
+
+        fd = openat(dfd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        n = read(fd, buf, size - 1);
+        if (n < 0)
+                return -errno;
+
+        buf[n] = '\0';
+
+        return n;
+}
+
+/* Read <pid>/comm relative to dfd. Return the length of comm on
+ * success. */
+static int proc_read_comm_at(int dfd, const char *pid, char comm[TASK_COMM_LEN]) {
+        char buf[TASK_COMM_LEN + 1];
+        ssize_t n;
+
+        n = proc_read_at(dfd, pid, "comm", buf, sizeof(buf));
+        if (n < 0)
+                return n;
+
+        if (n > 0 && buf[n - 1] == '\n')
+                n--;
+
+        if (n > TASK_COMM_LEN - 1)
+                n = TASK_COMM_LEN - 1;
+
+        memcpy(comm, buf, n);
+        comm[n] = '\0';
+
+        return n;
+}
+
+int proc_pid_of(const char *pname) {
+        _cleanup_closedir_ DIR *dir = NULL;
+        struct dirent *de;
+        int r;
+
+        dir = opendir("/proc");
+        if (!dir)
+                return -errno;
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                char comm[TASK_COMM_LEN];
+
+                if (de->d_type != DT_DIR)
+                        continue;
+
+                if (!is_number(de->d_name, strlen(de->d_name)))
+                        continue;
+
+                r = proc_read_comm_at(dirfd(dir), de->d_name, comm);
+                if (r < 0)
+                        continue;
+
+                if (strneq(pname, comm, TASK_COMM_LEN - 1))
+                        return atoi(de->d_name);
+        }
+
+        return 0;
+}
+
+static uint32_t string_hash(const char *s, size_t l) {
+        uint32_t h = 2166136261U;
+        size_t i;
+
+        /* FNV-1a */
+        for (i = 0; i < l; i++) {
+                h ^= (unsigned char) s[i];
+                h *= 16777619U;
+        }
+
+        return h;
+}
+
+#define COMM_INDEX_END          ((uint32_t) -1)
+#define COMM_INDEX_MIN_BUCKET   64
+
+struct comm_entry {
+        pid_t pid;
+        uint32_t hash;
+        /* next entry index in the same bucket */
+        uint32_t next;
+        unsigned int generation;
+        char comm[TASK_COMM_LEN];
+};
+
+struct proc_comm_index {
+        DIR *dir;
+        unsigned int generation;
+
+        /* sorted by pid */
+        struct comm_entry *entries;
+        size_t n_entry;
+        size_t n_allocated;
+
+        /* power of two */
+        uint32_t *buckets;
+        size_t n_bucket;
+};
+
+static int comm_entry_compare(const void *a, const void *b) {
+        const struct comm_entry *x = a, *y = b;
+
+        return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+static ssize_t comm_index_find_pid(const struct proc_comm_index *index, size_t n, pid_t pid) {
+        size_t l = 0, r = n;
+
+        while (l < r) {
+                size_t m = l + (r - l) / 2;
+
+                if (index->entries[m].pid < pid)
+                        l = m + 1;
+                else if (index->entries[m].pid > pid)
+                        r = m;
+                else
+                        return m;
+        }
+
+        return -1;
+}
+
+static int comm_index_rehash(struct proc_comm_index *index) {
+        size_t n = COMM_INDEX_MIN_BUCKET, i;
+
+        while (n < index->n_entry)
+                n <<= 1;
+
+        if (n != index->n_bucket) {
+                uint32_t *buckets;
+
+                buckets = realloc(index->buckets, sizeof(uint32_t) * n);
+                if (!buckets)
+                        return -ENOMEM;
+
+                index->buckets = buckets;
+                index->n_bucket = n;
+        }
+
+        memset(index->buckets, 0xff, sizeof(uint32_t) * index->n_bucket);
+
+        /* Insert in reverse to keep each chain in pid order */
+        for (i = index->n_entry; i > 0; i--) {
+                struct comm_entry *e = &index->entries[i - 1];
+                uint32_t *b = &index->buckets[e->hash & (index->n_bucket - 1)];
+
+                e->next = *b;
+                *b = i - 1;
+        }
+
+        return 0;
+}
+
+int proc_comm_index_refresh(struct proc_comm_index *index) {
+        struct dirent *de;
+        size_t n_old, i, j;
+        bool sorted = true;
+        int r;
+
+        assert(index);
+
+        index->generation++;
+        n_old = index->n_entry;
+
+        rewinddir(index->dir);
+
+        FOREACH_DIRENT(de, index->dir, return -errno) {
+                struct comm_entry *e;
+                ssize_t k;
+                pid_t pid;
+
+                if (de->d_type != DT_DIR)
+                        continue;
+
+                if (!is_number(de->d_name, strlen(de->d_name)))
+                        continue;
+
+                pid = (pid_t) atoi(de->d_name);
+
+                /* Known pid, comm is not read again */
+                k = comm_index_find_pid(index, n_old, pid);
+                if (k >= 0) {
+                        index->entries[k].generation = index->generation;
+                        continue;
+                }
+
+                if (index->n_entry >= index->n_allocated) {
+                        size_t n = index->n_allocated ? index->n_allocated * 2 : COMM_INDEX_MIN_BUCKET;
+
+                        e = realloc(index->entries, sizeof(struct comm_entry) * n);
+                        if (!e)
+                                return -ENOMEM;
+
+                        index->entries = e;
+                        index->n_allocated = n;
+                }
+
+                e = &index->entries[index->n_entry];
+
+                r = proc_read_comm_at(dirfd(index->dir), de->d_name, e->comm);
+                if (r < 0)
+                        continue;
+
+                e->pid = pid;
+                e->hash = string_hash(e->comm, r);
+                e->generation = index->generation;
+                index->n_entry++;
+        }
+
+        /* Drop disappeared pids */
+        for (i = 0, j = 0; i < index->n_entry; i++) {
+                if (index->entries[i].generation != index->generation)
+                        continue;
+
+                if (j > 0 && index->entries[j - 1].pid > index->entries[i].pid)
+                        sorted = false;
+
+                if (i != j)
+                        index->entries[j] = index->entries[i];
+                j++;
+        }
+        index->n_entry = j;
+
+        if (!sorted)
+                qsort(index->entries, index->n_entry, sizeof(struct comm_entry), comm_entry_compare);
+
+        return comm_index_rehash(index);
+}
+
+int proc_comm_index_new(struct proc_comm_index **index) {
+        _cleanup_proc_comm_index_free_ struct proc_comm_index *c = NULL;
+        int r;
+
+        assert(index);
+
+        c = new0(struct proc_comm_index, 1);
+        if (!c)
+                return -ENOMEM;
+
+        c->dir = opendir("/proc");
+        if (!c->dir)
+                return -errno;
+
+        r = proc_comm_index_refresh(c);
+        if (r < 0)
+                return r;
+
+        *index = c;
+        c = NULL;
+
+        return 0;
+}
+
+void proc_comm_index_free(struct proc_comm_index *index) {
+        if (!index)
+                return;
+
+        if (index->dir)
+                closedir(index->dir);
+
+        free(index->entries);
+        free(index->buckets);
+        free(index);
+}
+
+size_t proc_comm_index_lookup(const struct proc_comm_index *index, const char *comm, pid_t *pids, size_t n_pids) {
+        size_t l, n = 0;
+        uint32_t h, i;
+
+        assert(index);
+        assert(comm);
+        assert(pids || n_pids == 0);
+
+        if (!index->n_bucket)
+                return 0;
+
+        l = strnlen(comm, TASK_COMM_LEN - 1);
+        h = string_hash(comm, l);
+
+        for (i = index->buckets[h & (index->n_bucket - 1)]; i != COMM_INDEX_END; i = index->entries[i].next) {
+                const struct comm_entry *e = &index->entries[i];
+
+                if (e->hash != h || strncmp(e->comm, comm, l) || e->comm[l])
+                        continue;
+
+                if (n < n_pids)
+                        pids[n] = e->pid;
+                n++;
+        }
+
+        return n;
+}
+
+/* Enough for a /proc/<pid>/stat line, comm is at most 15 characters */
+#define PROC_STAT_BUF_SIZE      1024
+
+/* Skip a space separated field */
+static inline const char *scan_skip_field(const char *p, const char *end) {
+        p = scan_find(p, end, ' ');
+
+        return p < end ? p + 1 : end;
+}
+
+static inline const char *scan_field_u64(const char *p, const char *end, uint64_t *v) {
+        p = scan_u64(p, end, v);
+
+        return p < end ? p + 1 : end;
+}
+
+/*
+ * "pid (comm) S ppid pgrp session tty_nr tpgid flags minflt cminflt
+ * majflt cmajflt utime stime cutime cstime priority nice num_threads
+ * itrealvalue starttime vsize rss ..."
+ */
+static int proc_stat_parse(const char *buf, size_t len, long page_kb, struct proc_snapshot_entry *e) {
+        const char *end = buf + len, *p, *q;
+        uint64_t v;
+        int i;
+
+        p = memchr(buf, '(', len);
+        if (!p)
+                return -EINVAL;
+        p++;
+
+        /* comm can have ')', so the last one ends comm */
+        q = memrchr(p, ')', end - p);
+        if (!q || end - q < 4)
+                return -EINVAL;
+
+        len = q - p;
+        if (len > sizeof(e->comm) - 1)
+                len = sizeof(e->comm) - 1;
+        memcpy(e->comm, p, len);
+        e->comm[len] = '\0';
+
+        e->state = q[2];
+        p = q + 4;
+
+        p = scan_field_u64(p, end, &v);
+        e->ppid = (pid_t) v;
+
+        /* pgrp .. cmajflt */
+        for (i = 0; i < 9; i++)
+                p = scan_skip_field(p, end);
+
+        p = scan_field_u64(p, end, &e->utime);
+        p = scan_field_u64(p, end, &e->stime);
+
+        /* cutime .. nice */
+        for (i = 0; i < 4; i++)
+                p = scan_skip_field(p, end);
+
+        p = scan_field_u64(p, end, &v);
+        e->num_threads = (unsigned int) v;
+
+        /* itrealvalue */
+        p = scan_skip_field(p, end);
+
+        p = scan_field_u64(p, end, &e->start_time);
+        p = scan_field_u64(p, end, &v);
+        e->vsize = v >> 10;
+        p = scan_field_u64(p, end, &v);
+        e->rss = v * page_kb;
+
+        return 0;
+}
+
+/* "size resident shared text lib data dt" in pages */
+static void proc_statm_parse(const char *buf, size_t len, long page_kb, struct proc_snapshot_entry *e) {
+        const char *end = buf + len, *p = buf;
+        uint64_t v;
+
+        p = scan_skip_field(p, end);
+        p = scan_skip_field(p, end);
+        p = scan_field_u64(p, end, &v);
+        e->shared = v * page_kb;
+        p = scan_field_u64(p, end, &v);
+        e->text = v * page_kb;
+        p = scan_skip_field(p, end);
+        p = scan_field_u64(p, end, &v);
+        e->data = v * page_kb;
+}
+
+static int proc_snapshot_entry_compare(const void *a, const void *b) {
+        const struct proc_snapshot_entry *x = a, *y = b;
+
+        return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+int proc_snapshot_take(struct proc_snapshot **snapshot, enum proc_snapshot_flags flags) {
+        _cleanup_proc_snapshot_free_ struct proc_snapshot *s = NULL;
+        _cleanup_closedir_ DIR *dir = NULL;
+        char buf[PROC_STAT_BUF_SIZE];
+        struct dirent *de;
+        size_t n_allocated = 0;
+        bool sorted = true;
+        long page_kb;
+
+        assert(snapshot);
+
+        page_kb = sysconf(_SC_PAGESIZE) >> 10;
+
+        s = new0(struct proc_snapshot, 1);
+        if (!s)
+                return -ENOMEM;
+
+        dir = opendir("/proc");
+        if (!dir)
+                return -errno;
+
+        s->timestamp = now_usec(CLOCK_MONOTONIC);
+
+        FOREACH_DIRENT(de, dir, return -errno) {
+                struct proc_snapshot_entry *e;
+                ssize_t n;
+
+                if (de->d_type != DT_DIR)
+                        continue;
+
+                if (!is_number(de->d_name, strlen(de->d_name)))
+                        continue;
+
+                if (s->n_proc >= n_allocated) {
+                        size_t na = n_allocated ? n_allocated * 2 : 256;
+
+                        e = realloc(s->procs, sizeof(struct proc_snapshot_entry) * na);
+                        if (!e)
+                                return -ENOMEM;
+
+                        s->procs = e;
+                        n_allocated = na;
+                }
+
+                e = &s->procs[s->n_proc];
+                memset(e, 0, sizeof(*e));
+                e->pid = (pid_t) atoi(de->d_name);
+
+                /* The process can be gone during the walk */
+                n = proc_read_at(dirfd(dir), de->d_name, "stat", buf, sizeof(buf));
+                if (n < 0)
+                        continue;
+
+                if (proc_stat_parse(buf, n, page_kb, e) < 0)
+                        continue;
+
+                if (flags & PROC_SNAPSHOT_STATM) {
+                        n = proc_read_at(dirfd(dir), de->d_name, "statm", buf, sizeof(buf));
+                        if (n < 0)
+                                continue;
+
+                        proc_statm_parse(buf, n, page_kb, e);
+                }
+
+                if (s->n_proc > 0 && s->procs[s->n_proc - 1].pid > e->pid)
+                        sorted = false;
+
+                s->n_proc++;
+        }
+
+        if (!sorted)
+                qsort(s->procs, s->n_proc, sizeof(struct proc_snapshot_entry), proc_snapshot_entry_compare);
+
+        *snapshot = s;
+        s = NULL;
+
+        return 0;
+}
+
+void proc_snapshot_free(struct proc_snapshot *snapshot) {
+        if (!snapshot)
+                return;
+
+        free(snapshot->procs);
+        free(snapshot);
+}
+
+const struct proc_snapshot_entry *proc_snapshot_find(const struct proc_snapshot *snapshot, pid_t pid) {
+        assert(snapshot);
+
+        return bsearch(&(struct proc_snapshot_entry) { .pid = pid },
+                       snapshot->procs, snapshot->n_proc,
+                       sizeof(struct proc_snapshot_entry),
+                       proc_snapshot_entry_compare);
+}
+
+int proc_snapshot_diff(const struct proc_snapshot *old, const struct proc_snapshot *new,
+                       struct proc_snapshot_delta **delta, size_t *n_delta) {
+        struct proc_snapshot_delta *d;
+        double ticks;
+        size_t i, j, n = 0;
+
+        assert(old);
+        assert(new);
+        assert(delta);
+        assert(n_delta);
+
+        if (new->timestamp <= old->timestamp)
+                return -EINVAL;
+
+        /* clock ticks elapsed between the snapshots */
+        ticks = (double) (new->timestamp - old->timestamp) * sysconf(_SC_CLK_TCK) / USEC_PER_SEC;
+
+        d = new(struct proc_snapshot_delta, new->n_proc ? new->n_proc : 1);
+        if (!d)
+                return -ENOMEM;
+
+        /* Both are sorted by pid, so merge them */
+        for (i = 0, j = 0; j < new->n_proc; j++) {
+                const struct proc_snapshot_entry *ne = &new->procs[j];
+                const struct proc_snapshot_entry *oe = NULL;
+                uint64_t cpu;
+
+                while (i < old->n_proc && old->procs[i].pid < ne->pid)
+                        i++;
+
+                /* pid reused if start time differs */
+                if (i < old->n_proc && old->procs[i].pid == ne->pid &&
+                    old->procs[i].start_time == ne->start_time)
+                        oe = &old->procs[i];
+
+                cpu = ne->utime + ne->stime;
+                if (oe)
+                        cpu = cpu > oe->utime + oe->stime ? cpu - (oe->utime + oe->stime) : 0;
+
+                d[n].pid = ne->pid;
+                d[n].is_new = !oe;
+                d[n].cpu_usage = cpu * 100.0 / ticks;
+                d[n].rss_delta = (int64_t) ne->rss - (int64_t) (oe ? oe->rss : 0);
+                n++;
+        }
+
+        *delta = d;
+        *n_delta = n;
+
+        return 0;
+}
+
+static void smap_free(struct smap *map) {
+        if (!map)
+                return;
+
+        if (map->mode)
+                free(map->mode);
+
+        if (map->name)
+                free(map->name);
+
+        free(map);
+}
+
+static inline void smap_freep(struct smap **map) {
+        if (*map)
+                smap_free(*map);
+}
+
+#define _cleanup_smap_free_ _cleanup_ (smap_freep)
+
+void smaps_free(struct smaps *maps) {
+        int i;
+
+        if (!maps)
+                return;
+
+        for (i = 0; i < maps->n_map; i++)
+                smap_free(maps->maps[i]);
+
+        free(maps->maps);
+        free(maps);
+}
+
+static int add_smap_to_smaps(struct smaps *maps, struct smap *map) {
+        int i;
+
+        assert(maps);
+        assert(map);
+
+        /* The array grows twice when n_map reaches power of two, so
+         * the capacity needs not to be stored. */
+        if ((maps->n_map & (maps->n_map - 1)) == 0) {
+                struct smap **new;
+
+                new = (struct smap **) realloc(maps->maps, sizeof(struct smap *) * (maps->n_map ? maps->n_map * 2 : 1));
+                if (!new)
+                        return -ENOMEM;
+
+                maps->maps = new;
+        }
+
+        maps->maps[maps->n_map++] = map;
+
+        for (i = 0; i < SMAPS_ID_MAX; i++)
+                maps->sum[i] += map->value[i];
+
+        return 0;
+}
+
+/* Large enough to hold many smaps records at once, a record is
+ * usually less than 1KiB. */
+#define SMAPS_BUF_SIZE  (32 * 1024)
+
+static inline bool smaps_is_header(const char *line) {
+        return (*line >= '0' && *line <= '9') || (*line >= 'a' && *line <= 'f');
+}
+
+/* Offsets of mode and name are relative to the header, because the
+ * header may be moved on buffer refill. */
+struct smaps_header {
+        uint64_t start;
+        uint64_t end;
+        size_t mode;
+        size_t mode_len;
+        size_t name;
+        size_t name_len;
+};
+
+static int smaps_parse_header(char *line, size_t l, struct smaps_header *h) {
+        char *p = line, *e;
+        int i;
+
+        e = (char *) scan_x64(p, line + l, &h->start);
+        if (e == p || *e != '-')
+                return -EINVAL;
+
+        p = e + 1;
+        e = (char *) scan_x64(p, line + l, &h->end);
+        if (e == p)
+                return -EINVAL;
+
+        p = e + strspn(e, " ");
+        h->mode = p - line;
+        h->mode_len = strcspn(p, " ");
+        if (!h->mode_len)
+                return -EINVAL;
+
+        p += h->mode_len;
+        if (*p)
+                *(p++) = 0;
+
+        /* skip offset, device and inode */
+        for (i = 0; i < 3; i++) {
+                p += strspn(p, " ");
+                p += strcspn(p, " ");
+        }
+
+        p += strspn(p, " ");
+        h->name = p - line;
+        h->name_len = l - h->name;
+
+        return 0;
+}
+
+static int smaps_foreach_fd(int fd, char *buf, size_t size, enum smap_mask mask,
+                            smap_foreach_func_t func, void *data) {
+        struct line_reader r = LINE_READER_INIT_BUF(fd, buf, size);
+        struct smaps_header h = {};
+        struct smap_view v;
+        char *line;
+        size_t l;
+        bool eof;
+        int ret;
+
+        assert(buf);
+        assert(size > 1);
+        assert(func);
+
+        for (;;) {
+                struct proc_scan_record rec;
+                const char *p;
+                enum smap_id id;
+
+                ret = line_reader_next(&r, &line, &l);
+                if (ret < 0)
+                        return ret;
+
+                eof = ret == 0;
+                if (eof || smaps_is_header(line)) {
+                        if (r.keep != (size_t) -1) {
+                                char *header = r.buf + r.keep;
+
+                                v.start = h.start;
+                                v.end = h.end;
+                                v.mode = header + h.mode;
+                                v.mode_len = h.mode_len;
+                                if (h.name_len) {
+                                        v.name = header + h.name;
+                                        v.name_len = h.name_len;
+                                } else {
+                                        v.name = "[anon]";
+                                        v.name_len = strlen("[anon]");
+                                }
+
+                                ret = func(&v, data);
+                                if (ret < 0)
+                                        return ret;
+                        }
+
+                        if (eof)
+                                break;
+
+                        r.keep = line - r.buf;
+                        memset(v.value, 0, sizeof(v.value));
+
+                        ret = smaps_parse_header(line, l, &h);
+                        if (ret < 0)
+                                return ret;
+
+                        continue;
+                }
+
+                if (r.keep == (size_t) -1)
+                        return -EINVAL;
+
+                p = line;
+                if (!proc_scan_next(&p, line + l, ':', &rec) || !rec.key_len)
+                        continue;
+
+                id = smap_string_len_to_id(rec.key, rec.key_len);
+                if (id < 0 || id >= SMAPS_ID_MAX)
+                        continue;
+
+                if (!(mask & (1 << id)))
+                        continue;
+
+                v.value[id] = rec.value;
+        }
+
+        return 0;
+}
+
+int proc_pid_foreach_smap(pid_t pid, enum smap_mask mask, smap_foreach_func_t func, void *data) {
+        _cleanup_close_ int fd = -1;
+        char path[sizeof("/proc//smaps") + DECIMAL_STR_MAX(pid_t)];
+        char buf[SMAPS_BUF_SIZE];
+
+        assert(func);
+
+        snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        return smaps_foreach_fd(fd, buf, sizeof(buf), mask, func, data);
+}
+
+static int smaps_sum_view(const struct smap_view *v, void *data) {
+        unsigned long long *sum = data;
+        int i;
+
+        for (i = 0; i < SMAPS_ID_MAX; i++)
+                sum[i] += v->value[i];
+
+        return 0;
+}
+
+/* Sum of all mappings with the given buffer. Try smaps_rollup first. */
+static int smaps_sum_buf(pid_t pid, enum smap_mask mask, char *buf, size_t size,
+                         unsigned long long sum[SMAPS_ID_MAX]) {
+        _cleanup_close_ int fd = -1;
+        char path[sizeof("/proc//smaps_rollup") + DECIMAL_STR_MAX(pid_t)];
+
+        memset(sum, 0, sizeof(unsigned long long) * SMAPS_ID_MAX);
+
+        /* smaps_rollup does not report the size of mappings, only
+         * full walk can sum it. */
+        if (!(mask & SMAPS_MASK_SIZE)) {
+                snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+
+                fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                        return smaps_foreach_fd(fd, buf, size, mask, smaps_sum_view, sum);
+
+                /* Old kernel, fall back to smaps */
+                if (errno != ENOENT)
+                        return -errno;
+        }
+
+        snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        return smaps_foreach_fd(fd, buf, size, mask, smaps_sum_view, sum);
+}
+
+int proc_pid_get_smaps_rollup(pid_t pid, enum smap_mask mask, unsigned long long sum[SMAPS_ID_MAX]) {
+        char buf[SMAPS_BUF_SIZE];
+
+        assert(sum);
+
+        return smaps_sum_buf(pid, mask, buf, sizeof(buf), sum);
+}
+
+struct smaps_many {
+        const pid_t *pids;
+        enum smap_mask mask;
+        struct smaps_result *results;
+};
+
+static int smaps_many_one(size_t index, void *buf, void *userdata) {
+        struct smaps_many *m = userdata;
+        struct smaps_result *result = &m->results[index];
+
+        result->pid = m->pids[index];
+        result->error = smaps_sum_buf(result->pid, m->mask, buf, SMAPS_BUF_SIZE, result->sum);
+
+        /* Error of a pid does not stop the others */
+        return 0;
+}
+
+int proc_get_smaps_many(const pid_t *pids, size_t n, enum smap_mask mask,
+                        unsigned int n_threads, struct smaps_result *results) {
+        struct smaps_many m = {
+                .pids = pids,
+                .mask = mask,
+                .results = results,
+        };
+
+        assert(pids || n == 0);
+        assert(results || n == 0);
+
+        return work_pool_run(n, n_threads, SMAPS_BUF_SIZE, smaps_many_one, &m);
+}
+
+static int smaps_add_view(const struct smap_view *v, void *data) {
+        _cleanup_smap_free_ struct smap *map = NULL;
+        struct smaps *maps = data;
+        int i, r;
+
+        map = new0(struct smap, 1);
+        if (!map)
+                return -ENOMEM;
+
+        map->start = v->start;
+        map->end = v->end;
+
+        map->mode = strndup(v->mode, v->mode_len);
+        if (!map->mode)
+                return -ENOMEM;
+
+        map->name = strndup(v->name, v->name_len);
+        if (!map->name)
+                return -ENOMEM;
+
+        for (i = 0; i < SMAPS_ID_MAX; i++)
+                map->value[i] = v->value[i];
+
+        r = add_smap_to_smaps(maps, map);
+        if (r < 0)
+                return r;
+
+        map = NULL;
+
+        return 0;
+}
+
+int proc_pid_get_smaps(pid_t pid, struct smaps **maps, enum smap_mask mask) {
+        _cleanup_smaps_free_ struct smaps *m = NULL;
+        int r;
+
+        assert(maps);
+
+        m = new0(struct smaps, 1);
+        if (!m)
+                return -ENOMEM;
+
+        r = proc_pid_foreach_smap(pid, mask, smaps_add_view, m);
+        if (r < 0)
+                return r;
+
+        *maps = m;
+        m = NULL;
+
+        return 0;
+}
+
+struct smaps_record {
+        uint64_t start;
+        uint64_t end;
+        uint32_t mode;
+        uint32_t name;
+};
+
+/* Temporary growable storage to build a snapshot. All of them are
+ * copied to a single arena at the end. */
+struct smaps_builder {
+        enum smap_mask mask;
+        int n_value;
+
+        struct smaps_record *records;
+        size_t n_record;
+        size_t n_record_allocated;
+
+        uint64_t *values;
+
+        char *strings;
+        size_t strings_size;
+        size_t strings_allocated;
+
+        /* Open addressing hash of string offsets. 0 is empty since
+         * the pool always starts with an empty string. */
+        uint32_t *hash;
+        size_t hash_size;
+        size_t n_hash;
+};
+
+static void smaps_builder_done(struct smaps_builder *b) {
+        free(b->records);
+        free(b->values);
+        free(b->strings);
+        free(b->hash);
+}
+
+static int smaps_builder_grow_hash(struct smaps_builder *b) {
+        uint32_t *hash;
+        size_t size, i;
+
+        size = b->hash_size ? b->hash_size * 2 : 64;
+
+        hash = new0(uint32_t, size);
+        if (!hash)
+                return -ENOMEM;
+
+        for (i = 0; i < b->hash_size; i++) {
+                const char *s;
+                size_t j;
+
+                if (!b->hash[i])
+                        continue;
+
+                s = b->strings + b->hash[i];
+                j = string_hash(s, strlen(s)) & (size - 1);
+                while (hash[j])
+                        j = (j + 1) & (size - 1);
+
+                hash[j] = b->hash[i];
+        }
+
+        free(b->hash);
+        b->hash = hash;
+        b->hash_size = size;
+
+        return 0;
+}
+
+static int smaps_builder_intern(struct smaps_builder *b, const char *s, size_t l, uint32_t *offset) {
+        size_t i;
+        int r;
+
+        if (!l) {
+                *offset = 0;
+                return 0;
+        }
+
+        if ((b->n_hash + 1) * 2 > b->hash_size) {
+                r = smaps_builder_grow_hash(b);
+                if (r < 0)
+                        return r;
+        }
+
+        for (i = string_hash(s, l) & (b->hash_size - 1); b->hash[i]; i = (i + 1) & (b->hash_size - 1)) {
+                const char *t = b->strings + b->hash[i];
+
+                if (strneq(t, s, l) && !t[l]) {
+                        *offset = b->hash[i];
+                        return 0;
+                }
+        }
+
+        if (b->strings_size + l + 1 > UINT32_MAX)
+                return -E2BIG;
+
+        if (b->strings_size + l + 1 > b->strings_allocated) {
+                size_t n = b->strings_allocated * 2;
+                char *strings;
+
+                if (n < b->strings_size + l + 1)
+                        n = b->strings_size + l + 1;
+
+                strings = realloc(b->strings, n);
+                if (!strings)
+                        return -ENOMEM;
+
+                b->strings = strings;
+                b->strings_allocated = n;
+        }
+
+        memcpy(b->strings + b->strings_size, s, l);
+        b->strings[b->strings_size + l] = 0;
+
+        b->hash[i] = b->strings_size;
+        b->n_hash++;
+
+        *offset = b->strings_size;
+        b->strings_size += l + 1;
+
+        return 0;
+}
+
+static int smaps_builder_add(const struct smap_view *v, void *data) {
+        struct smaps_builder *b = data;
+        struct smaps_record *rec;
+        uint64_t *val;
+        int i, r;
+
+        if (b->n_record == b->n_record_allocated) {
+                size_t n = b->n_record_allocated ? b->n_record_allocated * 2 : 256;
+                struct smaps_record *records;
+                uint64_t *values;
+
+                records = realloc(b->records, sizeof(struct smaps_record) * n);
+                if (!records)
+                        return -ENOMEM;
+                b->records = records;
+
+                values = realloc(b->values, sizeof(uint64_t) * b->n_value * n);
+                if (!values && b->n_value)
+                        return -ENOMEM;
+                b->values = values;
+
+                b->n_record_allocated = n;
+        }
+
+        rec = &b->records[b->n_record];
+        rec->start = v->start;
+        rec->end = v->end;
+
+        r = smaps_builder_intern(b, v->mode, v->mode_len, &rec->mode);
+        if (r < 0)
+                return r;
+
+        r = smaps_builder_intern(b, v->name, v->name_len, &rec->name);
+        if (r < 0)
+                return r;
+
+        val = b->values + b->n_value * b->n_record;
+        for (i = 0; i < SMAPS_ID_MAX; i++)
+                if (b->mask & (1 << i))
+                        *(val++) = v->value[i];
+
+        b->n_record++;
+
+        return 0;
+}
+
+static int smaps_snapshot_compare_addr(const void *a, const void *b, void *data) {
+        const struct smaps_snapshot *s = data;
+        uint64_t x = s->start[*(const uint32_t *) a];
+        uint64_t y = s->start[*(const uint32_t *) b];
+
+        return x < y ? -1 : x > y;
+}
+
+int proc_pid_get_smaps_snapshot(pid_t pid, struct smaps_snapshot **snapshot, enum smap_mask mask) {
+        _cleanup_(smaps_builder_done) struct smaps_builder b = {};
+        struct smaps_snapshot *s;
+        size_t n, size, i;
+        uint64_t *val;
+        bool sorted = true;
+        char *p;
+        int id, r;
+
+        assert(snapshot);
+
+        mask &= SMAPS_MASK_ALL;
+        b.mask = mask;
+        b.n_value = __builtin_popcount(mask);
+
+        /* offset 0 is reserved for the empty string */
+        b.strings = malloc(1);
+        if (!b.strings)
+                return -ENOMEM;
+        b.strings[0] = 0;
+        b.strings_size = b.strings_allocated = 1;
+
+        r = proc_pid_foreach_smap(pid, mask, smaps_builder_add, &b);
+        if (r < 0)
+                return r;
+
+        n = b.n_record;
+        size = sizeof(struct smaps_snapshot) +
+                sizeof(uint64_t) * n * (2 + b.n_value) +
+                sizeof(uint32_t) * n * 3 +
+                b.strings_size;
+
+        s = malloc(size);
+        if (!s)
+                return -ENOMEM;
+
+        memset(s, 0, sizeof(struct smaps_snapshot));
+        s->n_map = n;
+
+        p = (char *) (s + 1);
+        s->start = (uint64_t *) p;
+        p += sizeof(uint64_t) * n;
+        s->end = (uint64_t *) p;
+        p += sizeof(uint64_t) * n;
+        for (id = 0; id < SMAPS_ID_MAX; id++) {
+                if (!(mask & (1 << id)))
+                        continue;
+
+                s->value[id] = (uint64_t *) p;
+                p += sizeof(uint64_t) * n;
+        }
+        s->mode = (uint32_t *) p;
+        p += sizeof(uint32_t) * n;
+        s->name = (uint32_t *) p;
+        p += sizeof(uint32_t) * n;
+        s->by_addr = (uint32_t *) p;
+        p += sizeof(uint32_t) * n;
+        s->strings = p;
+        s->strings_size = b.strings_size;
+
+        for (i = 0, val = b.values; i < n; i++) {
+                s->start[i] = b.records[i].start;
+                s->end[i] = b.records[i].end;
+                s->mode[i] = b.records[i].mode;
+                s->name[i] = b.records[i].name;
+                s->by_addr[i] = i;
+
+                for (id = 0; id < SMAPS_ID_MAX; id++) {
+                        if (!s->value[id])
+                                continue;
+
+                        s->value[id][i] = *(val++);
+                        s->sum[id] += s->value[id][i];
+                }
+
+                if (i > 0 && s->start[i - 1] > s->start[i])
+                        sorted = false;
+        }
+
+        memcpy(s->strings, b.strings, b.strings_size);
+
+        /* The kernel prints mappings in address order, sort only if
+         * it is not. */
+        if (!sorted)
+                qsort_r(s->by_addr, n, sizeof(uint32_t), smaps_snapshot_compare_addr, s);
+
+        *snapshot = s;
+
+        return 0;
+}
+
+ssize_t smaps_find_by_addr(const struct smaps_snapshot *snapshot, uint64_t addr) {
+        size_t lo = 0, hi;
+
+        assert(snapshot);
+
+        hi = snapshot->n_map;
+
+        /* find the last mapping which starts at or before addr */
+        while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+
+                if (snapshot->start[snapshot->by_addr[mid]] <= addr)
+                        lo = mid + 1;
+                else
+                        hi = mid;
+        }
+
+        if (lo == 0)
+                return -ENOENT;
+
+        lo = snapshot->by_addr[lo - 1];
+        if (addr >= snapshot->end[lo])
+                return -ENOENT;
+
+        return lo;
+}
+
+/* The sizes of the public meminfo structs must not change */
+_Static_assert(MEMINFO_ID_VMALLOC_CHUNK + 1 == MEMINFO_ID_BASE_MAX,
+               "new meminfo keys have to be MEMINFO_KEY_EXT()");
+_Static_assert(MEMINFO_ID_MAX <= MEMINFO_BITSET_WORDS * 64,
+               "struct meminfo_bitset is full");
+
+static const char* const meminfo_string_lookup[MEMINFO_ID_MAX] = {
+#define MEMINFO_KEY(id, key) [MEMINFO_ID_##id] = key,
+#include "proc-meminfo-list.h"
+#undef MEMINFO_KEY
+};
+
+const char *meminfo_id_to_string(enum meminfo_id id) {
+        assert(id >= 0 && id < MEMINFO_ID_MAX);
+
+        return meminfo_string_lookup[id];
+}
+
+/* /proc/meminfo is about 1.5KiB, 8KiB is enough for new entries */
+#define MEMINFO_BUF_SIZE        (8 * 1024)
+
+/* Read from the beginning of fd until end of file or buffer full
+ * with pread(), so the same fd can be read again. The buffer is null
+ * terminated, so size - 1 bytes are read at most. */
+static ssize_t proc_read_fd(int fd, char *buf, size_t size) {
+        size_t len = 0;
+        ssize_t n;
+
+        assert(size > 0);
+
+        while (len < size - 1) {
+                n = pread(fd, buf + len, size - 1 - len, len);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+
+                if (n == 0)
+                        break;
+
+                len += n;
+        }
+
+        buf[len] = 0;
+
+        return len;
+}
+
+static void meminfo_parse(const char *buf, size_t len, uint64_t *value, size_t n_value, const struct meminfo_bitset *set) {
+        const char *p = buf, *end = buf + len;
+        struct meminfo_bitset remain = *set;
+        struct proc_scan_record rec;
+        uint64_t mem_free = 0, cached = 0;
+        bool mem_available;
+        int i, n_remain = 0;
+
+        memset(value, 0x0, sizeof(uint64_t) * n_value);
+
+        mem_available = meminfo_bitset_test(&remain, MEMINFO_ID_MEM_AVAILABLE);
+        if (mem_available) {
+                meminfo_bitset_set(&remain, MEMINFO_ID_MEM_FREE);
+                meminfo_bitset_set(&remain, MEMINFO_ID_CACHED);
+        }
+
+        for (i = 0; i < MEMINFO_BITSET_WORDS; i++)
+                n_remain += __builtin_popcountll(remain.bits[i]);
+
+        while (n_remain && proc_scan_next(&p, end, ':', &rec)) {
+                enum meminfo_id id;
+
+                if (!rec.key_len)
+                        continue;
+
+                id = meminfo_string_len_to_id(rec.key, rec.key_len);
+                if (id < 0 || id >= MEMINFO_ID_MAX)
+                        continue;
+
+                if (!meminfo_bitset_test(&remain, id))
+                        continue;
+
+                meminfo_bitset_unset(&remain, id);
+                n_remain--;
+
+                if (id == MEMINFO_ID_MEM_FREE)
+                        mem_free = rec.value;
+                else if (id == MEMINFO_ID_CACHED)
+                        cached = rec.value;
+
+                if ((size_t) id < n_value)
+                        value[id] = rec.value;
+        }
+
+        /* Old kernel does not have MemAvailable */
+        if (mem_available && meminfo_bitset_test(&remain, MEMINFO_ID_MEM_AVAILABLE) &&
+            MEMINFO_ID_MEM_AVAILABLE < n_value)
+                value[MEMINFO_ID_MEM_AVAILABLE] = mem_free + cached;
+}
+
+/* struct meminfo is 32 bit, saturate rather than wrap around */
+static void meminfo_from_meminfo64(struct meminfo *mi, const struct meminfo64 *mi64) {
+        int i;
+
+        for (i = 0; i < MEMINFO_ID_BASE_MAX; i++)
+                mi->value[i] = mi64->value[i] > UINT_MAX ? UINT_MAX : mi64->value[i];
+}
+
+int proc_get_meminfo64_bitset(uint64_t *value, size_t n_value, const struct meminfo_bitset *set, uint64_t *timestamp) {
+        _cleanup_close_ int fd = -1;
+        char buf[MEMINFO_BUF_SIZE];
+        ssize_t len;
+
+        assert(value || n_value == 0);
+        assert(set);
+
+        fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        if (timestamp)
+                *timestamp = now_usec(CLOCK_MONOTONIC);
+
+        len = proc_read_fd(fd, buf, sizeof(buf));
+        if (len < 0)
+                return len;
+
+        meminfo_parse(buf, len, value, n_value, set);
+
+        return 0;
+}
+
+int proc_get_meminfo64(struct meminfo64 *mi, enum meminfo_mask mask) {
+        struct meminfo_bitset set;
+
+        assert(mi);
+
+        meminfo_bitset_from_mask(&set, mask);
+
+        return proc_get_meminfo64_bitset(mi->value, ELEMENTSOF(mi->value), &set, &mi->timestamp);
+}
+
+int proc_get_meminfo(struct meminfo *mi, enum meminfo_mask mask) {
+        struct meminfo64 mi64;
+        int r;
+
+        assert(mi);
+
+        r = proc_get_meminfo64(&mi64, mask);
+        if (r < 0)
+                return r;
+
+        meminfo_from_meminfo64(mi, &mi64);
+
+        return 0;
+}
+
+int meminfo_delta(const struct meminfo64 *old, const struct meminfo64 *new, struct meminfo_rate *rate) {
+        double interval;
+        int i;
+
+        assert(old);
+        assert(new);
+        assert(rate);
+
+        if (new->timestamp <= old->timestamp)
+                return -EINVAL;
+
+        rate->interval = new->timestamp - old->timestamp;
+        interval = (double) rate->interval / USEC_PER_SEC;
+
+#define RATE(n, o) ((int64_t) (((double) (n) - (double) (o)) / interval))
+
+        for (i = 0; i < MEMINFO_ID_BASE_MAX; i++)
+                rate->value[i] = RATE(new->value[i], old->value[i]);
+
+        rate->swap_used = RATE(new->value[MEMINFO_ID_SWAP_TOTAL] - new->value[MEMINFO_ID_SWAP_FREE],
+                               old->value[MEMINFO_ID_SWAP_TOTAL] - old->value[MEMINFO_ID_SWAP_FREE]);
+        rate->dirty_writeback = RATE(new->value[MEMINFO_ID_DIRTY] + new->value[MEMINFO_ID_WRITEBACK],
+                                     old->value[MEMINFO_ID_DIRTY] + old->value[MEMINFO_ID_WRITEBACK]);
+
+#undef RATE
+
+        return 0;
+}
+
+struct meminfo_sampler {
+        int fd;
+        char buf[MEMINFO_BUF_SIZE];
+};
+
+int meminfo_sampler_new(struct meminfo_sampler **sampler) {
+        struct meminfo_sampler *s;
+
+        assert(sampler);
+
+        s = new0(struct meminfo_sampler, 1);
+        if (!s)
+                return -ENOMEM;
+
+        s->fd = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+        if (s->fd < 0) {
+                free(s);
+                return -errno;
+        }
+
+        *sampler = s;
+
+        return 0;
+}
+
+void meminfo_sampler_free(struct meminfo_sampler *sampler) {
+        if (!sampler)
+                return;
+
+        if (sampler->fd >= 0)
+                close(sampler->fd);
+
+        free(sampler);
+}
 
-ssize_t proc_cmdline_get_str(char **buf, const char *op) {
-        _cleanup_free_ char *cmdline = NULL;
-        char *s, *w, *state;
-        size_t l, ll;
+int meminfo_sampler_read64_bitset(struct meminfo_sampler *sampler, uint64_t *value, size_t n_value,
+                                  const struct meminfo_bitset *set, uint64_t *timestamp) {
+        ssize_t len;
+
+        assert(sampler);
+        assert(value || n_value == 0);
+        assert(set);
+
+        if (timestamp)
+                *timestamp = now_usec(CLOCK_MONOTONIC);
+
+        len = proc_read_fd(sampler->fd, sampler->buf, sizeof(sampler->buf));
+        if (len < 0)
+                return len;
+
+        meminfo_parse(sampler->buf, len, value, n_value, set);
+
+        return 0;
+}
+
+int meminfo_sampler_read64(struct meminfo_sampler *sampler, struct meminfo64 *mi, enum meminfo_mask mask) {
+        struct meminfo_bitset set;
+
+        assert(sampler);
+        assert(mi);
+
+        meminfo_bitset_from_mask(&set, mask);
+
+        return meminfo_sampler_read64_bitset(sampler, mi->value, ELEMENTSOF(mi->value), &set, &mi->timestamp);
+}
+
+int meminfo_sampler_read(struct meminfo_sampler *sampler, struct meminfo *mi, enum meminfo_mask mask, uint64_t *timestamp) {
+        struct meminfo64 mi64;
         int r;
 
-        assert(buf);
-        assert(op);
+        assert(sampler);
+        assert(mi);
 
-        r = read_one_line_from_path("/proc/cmdline", &cmdline);
+        r = meminfo_sampler_read64(sampler, &mi64, mask);
         if (r < 0)
                 return r;
 
-        ll = strlen(op);
-        FOREACH_WORD(w, l, cmdline, state)
-                if (strneq(op, w, ll)) {
-                        s = new0(char, l - ll + 1);
-                        if (!s)
-                                return -ENOMEM;
+        meminfo_from_meminfo64(mi, &mi64);
 
-                        strncpy(s, w + ll, l - ll + 1);
+        if (timestamp)
+                *timestamp = mi64.timestamp;
 
-                        *buf = s;
+        return 0;
+}
 
-                        return l - ll + 1;
-                }
+/* Lines before Threads are about 1K, but Cpus_allowed and
+ * Mems_allowed can be long on a large system. */
+#define PROC_STATUS_BUF_SIZE    4096
 
-        return -ENOENT;
-}
+int proc_pid_get_status(pid_t pid, struct proc_status *st, enum proc_status_mask mask) {
+        _cleanup_close_ int fd = -1;
+        char path[sizeof("/proc//status") + DECIMAL_STR_MAX(pid_t)];
+        char buf[PROC_STATUS_BUF_SIZE];
+        struct line_reader r = LINE_READER_INIT_BUF(-1, buf, sizeof(buf));
+        unsigned int remain;
+        char *line;
+        size_t l;
+        int ret = 0;
 
-/* In old kernel, this symbol maybe NOT */
-#ifndef TASK_COMM_LEN
-#define TASK_COMM_LEN 16
-#endif
+        assert(st);
 
-int proc_pid_of(const char *pname) {
-        _cleanup_closedir_ DIR *dir = NULL;
-        struct dirent *de;
-        int r;
+        memset(st, 0, sizeof(struct proc_status));
 
-        dir = opendir("/proc");
-        if (!dir)
+        remain = mask & PROC_STATUS_MASK_ALL;
+        if (!remain)
+                return 0;
+
+        snprintf(path, sizeof(path), "/proc/%d/status", pid);
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
                 return -errno;
 
-        FOREACH_DIRENT(de, dir, return -errno) {
-                _cleanup_free_ char *path = NULL;
-                _cleanup_free_ char *comm = NULL;
+        r.fd = fd;
 
-                if (de->d_type != DT_DIR)
+        while (remain && (ret = line_reader_next(&r, &line, &l)) > 0) {
+                struct proc_scan_record rec;
+                const char *p = line;
+                enum proc_status_id id;
+
+                if (!proc_scan_next(&p, line + l, ':', &rec) || !rec.key_len)
                         continue;
 
-                if (!is_number(de->d_name, strlen(de->d_name)))
+                id = proc_status_string_len_to_id(rec.key, rec.key_len);
+                if (id < 0 || !(remain & (1U << id)))
                         continue;
 
-                r = asprintf(&path, "/proc/%s/comm", de->d_name);
-                if (r < 0)
-                        return -ENOMEM;
+                st->value[id] = rec.value;
+                remain &= ~(1U << id);
+        }
 
-                r = read_one_line_from_path(path, &comm);
-                if (r < 0)
-                        continue;
+        /* Not reported fields, such like Vm* of kernel threads, are
+         * left 0 */
+        return ret < 0 ? ret : 0;
+}
 
-                if (strneq(pname, comm, TASK_COMM_LEN - 1))
-                        return atoi(de->d_name);
+void proc_buddyinfo_free(struct buddyinfo *bi) {
+        if (!bi)
+                return;
+
+        free(bi->zone);
+        free(bi);
+}
+
+/* memory.stat is about 2K, io.stat has a line for each device */
+#define CGROUP_STAT_BUF_SIZE    8192
+
+enum cgroup_file {
+        CGROUP_FILE_MEMORY_CURRENT = 0,
+        CGROUP_FILE_MEMORY_STAT,
+        CGROUP_FILE_CPU_STAT,
+        CGROUP_FILE_IO_STAT,
+        CGROUP_FILE_CPU_PRESSURE,
+        CGROUP_FILE_MEMORY_PRESSURE,
+        CGROUP_FILE_IO_PRESSURE,
+        CGROUP_FILE_MAX,
+};
+
+static const char* const cgroup_file_name[CGROUP_FILE_MAX] = {
+        [CGROUP_FILE_MEMORY_CURRENT]    = "memory.current",
+        [CGROUP_FILE_MEMORY_STAT]       = "memory.stat",
+        [CGROUP_FILE_CPU_STAT]          = "cpu.stat",
+        [CGROUP_FILE_IO_STAT]           = "io.stat",
+        [CGROUP_FILE_CPU_PRESSURE]      = "cpu.pressure",
+        [CGROUP_FILE_MEMORY_PRESSURE]   = "memory.pressure",
+        [CGROUP_FILE_IO_PRESSURE]       = "io.pressure",
+};
+
+struct cgroup_handle {
+        int dfd;
+        /* opened on the first read */
+        int fd[CGROUP_FILE_MAX];
+};
+
+int cgroup_handle_open(const char *path, struct cgroup_handle **cg) {
+        struct cgroup_handle *c;
+        int i;
+
+        assert(path);
+        assert(cg);
+
+        c = new0(struct cgroup_handle, 1);
+        if (!c)
+                return -ENOMEM;
+
+        for (i = 0; i < CGROUP_FILE_MAX; i++)
+                c->fd[i] = -1;
+
+        c->dfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (c->dfd < 0) {
+                free(c);
+                return -errno;
         }
 
+        *cg = c;
+
         return 0;
 }
 
-static void smap_free(struct smap *map) {
-        if (!map)
+void cgroup_handle_free(struct cgroup_handle *cg) {
+        int i;
+
+        if (!cg)
                 return;
 
-        if (map->mode)
-                free(map->mode);
+        for (i = 0; i < CGROUP_FILE_MAX; i++)
+                if (cg->fd[i] >= 0)
+                        close(cg->fd[i]);
 
-        if (map->name)
-                free(map->name);
+        if (cg->dfd >= 0)
+                close(cg->dfd);
 
-        free(map);
+        free(cg);
 }
 
-static inline void smap_freep(struct smap **map) {
-        if (*map)
-                smap_free(*map);
+static ssize_t cgroup_read(struct cgroup_handle *cg, enum cgroup_file file, char *buf, size_t size) {
+        assert(cg);
+
+        if (cg->fd[file] < 0) {
+                cg->fd[file] = openat(cg->dfd, cgroup_file_name[file], O_RDONLY | O_CLOEXEC);
+                if (cg->fd[file] < 0)
+                        return -errno;
+        }
+
+        return proc_read_fd(cg->fd[file], buf, size);
 }
 
-#define _cleanup_smap_free_ _cleanup_ (smap_freep)
+/* Parse "key value" lines of masked keys, stop when all are found */
+static void cgroup_stat_parse(const char *buf, size_t len, int (*lookup)(const char *str, size_t len),
+                              unsigned int mask, uint64_t *value) {
+        const char *p = buf, *end = buf + len;
+        struct proc_scan_record rec;
 
-void smaps_free(struct smaps *maps) {
-        int i;
+        while (mask && proc_scan_next(&p, end, ' ', &rec)) {
+                int id;
 
-        if (!maps)
-                return;
+                if (!rec.key_len)
+                        continue;
 
-        for (i = 0; i < maps->n_map; i++)
-                smap_free(maps->maps[i]);
+                id = lookup(rec.key, rec.key_len);
+                if (id < 0 || !(mask & (1U << id)))
+                        continue;
 
-        free(maps->maps);
-        free(maps);
+                value[id] = rec.value;
+                mask &= ~(1U << id);
+        }
 }
 
-static int add_smap_to_smaps(struct smaps *maps, struct smap *map) {
-        int i;
+static int cgroup_memory_stat_lookup(const char *str, size_t len) {
+        return cgroup_memory_stat_string_len_to_id(str, len);
+}
 
-        assert(maps);
-        assert(map);
+static int cgroup_cpu_stat_lookup(const char *str, size_t len) {
+        return cgroup_cpu_stat_string_len_to_id(str, len);
+}
 
-        maps->n_map++;
+int cgroup_get_memory_current(struct cgroup_handle *cg, uint64_t *current) {
+        char buf[DECIMAL_STR_MAX(uint64_t) + 1];
+        ssize_t len;
 
-        maps->maps = (struct smap **) realloc(maps->maps, sizeof(struct smap *) * maps->n_map);
-        if (!maps->maps)
-                return -ENOMEM;
+        assert(current);
 
-        maps->maps[maps->n_map - 1] = map;
+        len = cgroup_read(cg, CGROUP_FILE_MEMORY_CURRENT, buf, sizeof(buf));
+        if (len < 0)
+                return len;
 
-        for (i = 0; i < SMAPS_ID_MAX; i++)
-                maps->sum[i] += map->value[i];
+        if (scan_u64(buf, buf + len, current) == buf)
+                return -EINVAL;
 
         return 0;
 }
 
-int proc_pid_get_smaps(pid_t pid, struct smaps **maps, enum smap_mask mask) {
-        _cleanup_smaps_free_ struct smaps *m = NULL;
-        _cleanup_free_ char *path = NULL;
-        _cleanup_fclose_ FILE *f = NULL;
-        char buf[LINE_MAX];
-        bool get_line = true;
-        int r;
+int cgroup_get_memory_stat(struct cgroup_handle *cg, struct cgroup_memory_stat *st, enum cgroup_memory_stat_mask mask) {
+        char buf[CGROUP_STAT_BUF_SIZE];
+        ssize_t len;
 
-        assert(maps);
+        assert(st);
 
-        r = asprintf(&path, "/proc/%d/smaps", pid);
-        if (r < 0)
-                return -ENOMEM;
+        memset(st, 0, sizeof(struct cgroup_memory_stat));
 
-        r = access(path, F_OK);
-        if (r < 0)
-                return -errno;
+        len = cgroup_read(cg, CGROUP_FILE_MEMORY_STAT, buf, sizeof(buf));
+        if (len < 0)
+                return len;
 
-        f = fopen(path, "re");
-        if (!f)
-                return -errno;
+        cgroup_stat_parse(buf, len, cgroup_memory_stat_lookup, mask & CGROUP_MEMORY_STAT_MASK_ALL, st->value);
 
-        m = new0(struct smaps, 1);
-        if (!m)
-                return -ENOMEM;
+        return 0;
+}
 
-        for (;;) {
-                _cleanup_smap_free_ struct smap *map = NULL;
-                int n;
+int cgroup_get_cpu_stat(struct cgroup_handle *cg, struct cgroup_cpu_stat *st, enum cgroup_cpu_stat_mask mask) {
+        char buf[CGROUP_STAT_BUF_SIZE];
+        ssize_t len;
+
+        assert(st);
+
+        memset(st, 0, sizeof(struct cgroup_cpu_stat));
+
+        len = cgroup_read(cg, CGROUP_FILE_CPU_STAT, buf, sizeof(buf));
+        if (len < 0)
+                return len;
+
+        cgroup_stat_parse(buf, len, cgroup_cpu_stat_lookup, mask & CGROUP_CPU_STAT_MASK_ALL, st->value);
+
+        return 0;
+}
 
-                if (get_line && !fgets(buf, sizeof(buf), f)) {
-                        if (ferror(f)) {
-                                r = -errno;
-                                goto on_error;
+/* "8:0 rbytes=90112 wbytes=0 rios=3 wios=0 dbytes=0 dios=0" */
+int cgroup_get_io_stat(struct cgroup_handle *cg, struct cgroup_io_stat *st, enum cgroup_io_stat_mask mask) {
+        char buf[CGROUP_STAT_BUF_SIZE];
+        const char *p, *end;
+        ssize_t len;
+
+        assert(st);
+
+        memset(st, 0, sizeof(struct cgroup_io_stat));
+
+        len = cgroup_read(cg, CGROUP_FILE_IO_STAT, buf, sizeof(buf));
+        if (len < 0)
+                return len;
+
+        for (p = buf, end = buf + len; p < end;) {
+                const char *eol = scan_find(p, end, '\n');
+
+                /* skip the device */
+                p = scan_find(p, eol, ' ');
+
+                while (p < eol) {
+                        const char *k, *e;
+                        enum cgroup_io_stat_id id;
+                        uint64_t v;
+
+                        k = scan_skip_blank(p, eol);
+                        e = scan_find2(k, eol, '=', ' ');
+                        if (e == eol || *e != '=') {
+                                p = e;
+                                continue;
                         }
-                        break;
-                } else
-                        get_line = true;
 
-                map = new0(struct smap, 1);
-                if (!map) {
-                        r = -errno;
-                        goto on_error;
+                        p = scan_u64(e + 1, eol, &v);
+
+                        id = cgroup_io_stat_string_len_to_id(k, e - k);
+                        if (id >= 0 && (mask & (1U << id)))
+                                st->value[id] += v;
                 }
 
-                n = sscanf(buf, "%x-%x %ms %*s %*s %*s %ms", &map->start, &map->end, &map->mode, &map->name);
+                p = eol < end ? eol + 1 : end;
+        }
 
-                if (n == 3 && !map->name)
-                        map->name = strdup("[anon]");
-                else if (n != 4) {
-                        r = -EINVAL;
-                        goto on_error;
-                }
+        return 0;
+}
 
-                for (;;) {
-                        unsigned int v = 0;
-                        enum smap_id id;
-                        size_t l;
+/* Parse "1.23" into 123 */
+static const char *scan_centi(const char *p, const char *end, unsigned int *v) {
+        uint64_t i, f = 0;
+        int n = 0;
 
-                        if (!fgets(buf, sizeof(buf), f)) {
-                                if (ferror(f)) {
-                                        r = -errno;
-                                        goto on_error;
-                                }
-                                break;
-                        }
+        p = scan_u64(p, end, &i);
 
-                        if ((*buf >= '0' && *buf <= '9') || (*buf >= 'a' && *buf <= 'f')) {
-                                get_line = false;
-                                break;
-                        }
+        if (p < end && *p == '.')
+                for (p++; p < end && *p >= '0' && *p <= '9'; p++, n++)
+                        if (n < 2)
+                                f = f * 10 + (*p - '0');
 
-                        l = strcspn(buf, ":");
-                        if (!l)
-                                break;
+        if (n == 1)
+                f *= 10;
 
-                        buf[l] = 0;
+        *v = (unsigned int) (i * 100 + f);
 
-                        id = smap_string_to_id(buf);
-                        if (id < 0 || id >= SMAPS_ID_MAX)
-                                continue;
+        return p;
+}
 
-                        if (!(mask & (1 << id)))
-                                continue;
+/* "some avg10=0.00 avg60=0.00 avg300=0.00 total=0" */
+static int psi_parse(const char *buf, size_t len, struct psi_stats *st) {
+        const char *p = buf, *end = buf + len;
+        struct proc_scan_record rec;
 
-                        if (sscanf(buf + l + 1, "%d kB", &v) != 1)
+        memset(st, 0, sizeof(struct psi_stats));
+
+        while (proc_scan_next(&p, end, ' ', &rec)) {
+                struct psi_line *l;
+                const char *q;
+
+                if (rec.key_len != 4)
+                        continue;
+
+                if (!memcmp(rec.key, "some", 4))
+                        l = &st->some;
+                else if (!memcmp(rec.key, "full", 4))
+                        l = &st->full;
+                else
+                        continue;
+
+                for (q = rec.key + 4; q < rec.line_end;) {
+                        const char *k = scan_skip_blank(q, rec.line_end);
+                        const char *e = scan_find(k, rec.line_end, '=');
+
+                        if (e == rec.line_end)
                                 break;
 
-                        map->value[id] = v;
+                        if (e - k == 5 && !memcmp(k, "avg10", 5))
+                                q = scan_centi(e + 1, rec.line_end, &l->avg10);
+                        else if (e - k == 5 && !memcmp(k, "avg60", 5))
+                                q = scan_centi(e + 1, rec.line_end, &l->avg60);
+                        else if (e - k == 6 && !memcmp(k, "avg300", 6))
+                                q = scan_centi(e + 1, rec.line_end, &l->avg300);
+                        else if (e - k == 5 && !memcmp(k, "total", 5))
+                                q = scan_u64(e + 1, rec.line_end, &l->total);
+                        else
+                                q = scan_find(e, rec.line_end, ' ');
                 }
+        }
 
-                r = add_smap_to_smaps(m, map);
-                if (r < 0)
-                        goto on_error;
+        return 0;
+}
 
-                map = NULL;
-        }
+int cgroup_get_pressure(struct cgroup_handle *cg, enum psi_resource resource, struct psi_stats *st) {
+        char buf[256];
+        ssize_t len;
 
-        *maps = m;
-        m = NULL;
+        assert(st);
+        assert(resource >= 0 && resource < PSI_RESOURCE_MAX);
 
-        return 0;
+        len = cgroup_read(cg, CGROUP_FILE_CPU_PRESSURE + resource, buf, sizeof(buf));
+        if (len < 0)
+                return len;
 
-on_error:
-        return r;
+        return psi_parse(buf, len, st);
 }
 
-static const char* const meminfo_string_lookup[MEMINFO_ID_MAX] = {
-        [MEMINFO_ID_MEM_TOTAL]     = "MemTotal",
-        [MEMINFO_ID_MEM_FREE]      = "MemFree",
-        [MEMINFO_ID_MEM_AVAILABLE] = "MemAvailable",
-        [MEMINFO_ID_BUFFERS]       = "Buffers",
-        [MEMINFO_ID_CACHED]        = "Cached",
-        [MEMINFO_ID_SWAP_CACHED]   = "SwapCached",
-        [MEMINFO_ID_ACTIVE]        = "Active",
-        [MEMINFO_ID_INACTIVE]      = "Inactive",
-        [MEMINFO_ID_ACTIVE_ANON]   = "Active(anon)",
-        [MEMINFO_ID_INACTIVE_ANON] = "Inactive(anon)",
-        [MEMINFO_ID_ACTIVE_FILE]   = "Active(file)",
-        [MEMINFO_ID_INACTIVE_FILE] = "Inactive(file)",
-        [MEMINFO_ID_UNEVICTABLE]   = "Unevictable",
-        [MEMINFO_ID_MLOCKED]       = "Mlocked",
-        [MEMINFO_ID_HIGH_TOTAL]    = "HighTotal",
-        [MEMINFO_ID_HIGH_FREE]     = "HighFree",
-        [MEMINFO_ID_LOW_TOTAL]     = "LowTotal",
-        [MEMINFO_ID_LOW_FREE]      = "LowFree",
-        [MEMINFO_ID_SWAP_TOTAL]    = "SwapTotal",
-        [MEMINFO_ID_SWAP_FREE]     = "SwapFree",
-        [MEMINFO_ID_DIRTY]         = "Dirty",
-        [MEMINFO_ID_WRITEBACK]     = "Writeback",
-        [MEMINFO_ID_ANON_PAGES]    = "AnonPages",
-        [MEMINFO_ID_MAPPED]        = "Mapped",
-        [MEMINFO_ID_SHMEM]         = "Shmem",
-        [MEMINFO_ID_SLAB]          = "Slab",
-        [MEMINFO_ID_SRECLAIMABLE]  = "SReclaimable",
-        [MEMINFO_ID_SUNRECLAIM]    = "SUnreclaim",
-        [MEMINFO_ID_KERNEL_STACK]  = "KernelStack",
-        [MEMINFO_ID_PAGE_TABLES]   = "PageTables",
-        [MEMINFO_ID_NFS_UNSTABLE]  = "NFS_Unstable",
-        [MEMINFO_ID_BOUNCE]        = "Bounce",
-        [MEMINFO_ID_WRITEBACK_TMP] = "WritebackTmp",
-        [MEMINFO_ID_COMMIT_LIMIT]  = "CommitLimit",
-        [MEMINFO_ID_COMMITTED_AS]  = "Committed_AS",
-        [MEMINFO_ID_VMALLOC_TOTAL] = "VmallocTotal",
-        [MEMINFO_ID_VMALLOC_USED]  = "VmallocUsed",
-        [MEMINFO_ID_VMALLOC_CHUNK] = "VmallocChunk",
+static const char* const psi_resource_name[PSI_RESOURCE_MAX] = {
+        [PSI_RESOURCE_CPU]      = "cpu",
+        [PSI_RESOURCE_MEMORY]   = "memory",
+        [PSI_RESOURCE_IO]       = "io",
 };
 
-const char *meminfo_id_to_string(enum meminfo_id id) {
-        assert(id >= 0 && id < MEMINFO_ID_MAX);
+int proc_get_pressure(enum psi_resource resource, struct psi_stats *st) {
+        _cleanup_close_ int fd = -1;
+        char path[sizeof("/proc/pressure/memory")];
+        char buf[256];
+        ssize_t len;
 
-        return meminfo_string_lookup[id];
+        assert(st);
+        assert(resource >= 0 && resource < PSI_RESOURCE_MAX);
+
+        snprintf(path, sizeof(path), "/proc/pressure/%s", psi_resource_name[resource]);
+
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        len = proc_read_fd(fd, buf, sizeof(buf));
+        if (len < 0)
+                return len;
+
+        return psi_parse(buf, len, st);
 }
 
-int proc_get_meminfo(struct meminfo *mi, enum meminfo_mask mask) {
-        _cleanup_fclose_ FILE *f = NULL;
-        enum meminfo_mask remain_mask = mask;
-        char buf[LINE_MAX];
+static int psi_trigger_open_at(int dfd, const char *path, enum psi_type type,
+                               uint64_t threshold_usec, uint64_t window_usec) {
+        _cleanup_close_ int fd = -1;
+        char buf[sizeof("some") + 2 * DECIMAL_STR_MAX(uint64_t)];
+        int fd_ret, l;
 
-        assert(mi);
+        if (type != PSI_TYPE_SOME && type != PSI_TYPE_FULL)
+                return -EINVAL;
 
-        memset(mi, 0x0, sizeof(struct meminfo));
+        if (threshold_usec == 0 || threshold_usec > window_usec)
+                return -EINVAL;
 
-        f = fopen("/proc/meminfo", "r");
-        if (!f)
+        fd = openat(dfd, path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
                 return -errno;
 
-        if (remain_mask & MEMINFO_MASK_MEM_AVAILABLE)
-                remain_mask |= (MEMINFO_MASK_MEM_FREE | MEMINFO_MASK_CACHED);
+        l = snprintf(buf, sizeof(buf), "%s %" PRIu64 " %" PRIu64,
+                     type == PSI_TYPE_SOME ? "some" : "full",
+                     threshold_usec, window_usec);
 
-        while (remain_mask) {
-                unsigned int v = 0;
-                enum meminfo_id id;
-                size_t l;
+        /* The kernel takes the trailing null too */
+        if (write(fd, buf, l + 1) < 0)
+                return -errno;
 
-                if (!fgets(buf, sizeof(buf), f)) {
-                        if (ferror(f))
-                                return -errno;
-                        break;
-                }
+        fd_ret = fd;
+        fd = -1;
 
-                l = strcspn(buf, ":");
-                if (!l)
-                        break;
+        return fd_ret;
+}
 
-                buf[l] = 0;
+int proc_psi_trigger_open(enum psi_resource resource, enum psi_type type,
+                          uint64_t threshold_usec, uint64_t window_usec) {
+        char path[sizeof("/proc/pressure/memory")];
 
-                id = meminfo_string_to_id(buf);
-                if (id < 0 || id >= MEMINFO_ID_MAX)
-                        continue;
+        assert(resource >= 0 && resource < PSI_RESOURCE_MAX);
 
-                if (!(remain_mask & (1ULL << id)))
-                        continue;
+        snprintf(path, sizeof(path), "/proc/pressure/%s", psi_resource_name[resource]);
+
+        return psi_trigger_open_at(AT_FDCWD, path, type, threshold_usec, window_usec);
+}
+
+int cgroup_psi_trigger_open(struct cgroup_handle *cg, enum psi_resource resource, enum psi_type type,
+                            uint64_t threshold_usec, uint64_t window_usec) {
+        assert(cg);
+        assert(resource >= 0 && resource < PSI_RESOURCE_MAX);
+
+        /* A trigger is bound to its fd, the cached fd is not used */
+        return psi_trigger_open_at(cg->dfd, cgroup_file_name[CGROUP_FILE_CPU_PRESSURE + resource],
+                                   type, threshold_usec, window_usec);
+}
 
-                remain_mask &= ~((1ULL << id));
+int psi_trigger_wait(int fd, int timeout_msec) {
+        struct pollfd pfd = {
+                .fd = fd,
+                .events = POLLPRI,
+        };
+        int r;
+
+        assert(fd >= 0);
+
+        r = poll(&pfd, 1, timeout_msec);
+        if (r < 0)
+                return -errno;
+
+        if (r == 0)
+                return 0;
+
+        /* The monitored cgroup is removed */
+        if (pfd.revents & (POLLERR | POLLNVAL))
+                return -ENODEV;
+
+        return 1;
+}
+
+/* A line is about 100 bytes for 11 orders */
+#define BUDDYINFO_BUF_SIZE      4096
+
+static inline const char *scan_skip_prefix(const char *p, const char *end, const char *prefix) {
+        size_t l = strlen(prefix);
+
+        if ((size_t) (end - p) < l || memcmp(p, prefix, l))
+                return NULL;
+
+        return p + l;
+}
+
+/* "Node 0, zone   Normal   1527    509    126 ..." */
+static int buddyinfo_parse_line(const char *line, size_t l, struct buddyinfo_zone *z) {
+        const char *end = line + l, *p, *e;
+        uint64_t v;
 
-                if (sscanf(buf + l + 1, "%d", &v) != 1)
+        p = scan_skip_prefix(line, end, "Node ");
+        if (!p)
+                return -EINVAL;
+
+        p = scan_u64(p, end, &v);
+        z->node = (int) v;
+
+        p = scan_skip_prefix(p, end, ", zone");
+        if (!p)
+                return -EINVAL;
+
+        p = scan_skip_blank(p, end);
+        e = scan_find(p, end, ' ');
+        if (e == p || (size_t) (e - p) >= sizeof(z->zone))
+                return -EINVAL;
+
+        memcpy(z->zone, p, e - p);
+        z->zone[e - p] = '\0';
+
+        for (z->n_order = 0, p = e; z->n_order < PAGE_MAX; z->n_order++) {
+                p = scan_skip_blank(p, end);
+                if (p == end)
                         break;
 
-                mi->value[id] = v;
+                e = scan_u64(p, end, &z->page[z->n_order]);
+                if (e == p)
+                        return -EINVAL;
+                p = e;
         }
 
-        if (remain_mask & MEMINFO_MASK_MEM_AVAILABLE) {
-                mi->value[MEMINFO_ID_MEM_AVAILABLE] = mi->value[MEMINFO_ID_MEM_FREE]
-                        + mi->value[MEMINFO_ID_CACHED];
+        for (v = z->n_order; v < PAGE_MAX; v++)
+                z->page[v] = 0;
+
+        return 0;
+}
+
+int proc_get_buddyinfo_all(struct buddyinfo_zone **zones, size_t *n_zone) {
+        _cleanup_free_ struct buddyinfo_zone *z = NULL;
+        _cleanup_close_ int fd = -1;
+        char buf[BUDDYINFO_BUF_SIZE];
+        struct line_reader r = LINE_READER_INIT_BUF(-1, buf, sizeof(buf));
+        size_t n = 0, n_allocated = 0;
+        char *line;
+        size_t l;
+        int ret;
+
+        assert(zones);
+        assert(n_zone);
+
+        fd = open("/proc/buddyinfo", O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -errno;
+
+        r.fd = fd;
+
+        while ((ret = line_reader_next(&r, &line, &l)) > 0) {
+                if (l == 0)
+                        continue;
+
+                if (n >= n_allocated) {
+                        struct buddyinfo_zone *t;
+                        size_t na = n_allocated ? n_allocated * 2 : 8;
+
+                        t = realloc(z, sizeof(struct buddyinfo_zone) * na);
+                        if (!t)
+                                return -ENOMEM;
+
+                        z = t;
+                        n_allocated = na;
+                }
+
+                ret = buddyinfo_parse_line(line, l, &z[n]);
+                if (ret < 0)
+                        return ret;
+
+                n++;
         }
+        if (ret < 0)
+                return ret;
+
+        *zones = z;
+        *n_zone = n;
+        z = NULL;
 
         return 0;
 }
 
-void proc_buddyinfo_free(struct buddyinfo *bi) {
-        if (!bi)
-                return;
+int buddyinfo_fragmentation_index(const struct buddyinfo_zone *zone, unsigned int order, int *index) {
+        uint64_t free_pages = 0, free_blocks_total = 0, free_blocks_suitable = 0;
+        unsigned int o, n_order;
 
-        free(bi->zone);
-        free(bi);
+        assert(zone);
+        assert(index);
+
+        if (order >= PAGE_MAX)
+                return -EINVAL;
+
+        n_order = zone->n_order < PAGE_MAX ? zone->n_order : PAGE_MAX;
+
+        for (o = 0; o < n_order; o++) {
+                free_blocks_total += zone->page[o];
+                free_pages += zone->page[o] << o;
+
+                if (o >= order)
+                        free_blocks_suitable += zone->page[o] << (o - order);
+        }
+
+        /* Same with __fragmentation_index() of mm/vmstat.c */
+        if (!free_blocks_total)
+                *index = 0;
+        else if (free_blocks_suitable)
+                *index = -1000;
+        else
+                *index = 1000 - (int) ((1000 + free_pages * 1000 / (1ULL << order)) / free_blocks_total);
+
+        return 0;
 }
 
 int proc_get_buddyinfo(const char *zone, struct buddyinfo **bi) {
-        _cleanup_fclose_ FILE *f = NULL;
-        char buf[LINE_MAX];
+        _cleanup_free_ struct buddyinfo_zone *zones = NULL;
+        struct buddyinfo *b;
+        size_t n, i;
+        int r, o;
 
         assert(zone);
         assert(bi);
 
-        f = fopen("/proc/buddyinfo", "re");
-        if (!f)
-                return -errno;
-
-        for (;;) {
-                _cleanup_buddyinfo_free_ struct buddyinfo *b = NULL;
-                int n;
-
-                if (!fgets(buf, sizeof(buf), f)) {
-                        if (ferror(f))
-                                return -errno;
+        r = proc_get_buddyinfo_all(&zones, &n);
+        if (r < 0)
+                return r;
 
-                        break;
-                }
+        for (i = 0; i < n; i++) {
+                if (!streq(zone, zones[i].zone))
+                        continue;
 
                 b = new0(struct buddyinfo, 1);
                 if (!b)
                         return -ENOMEM;
 
-                n = sscanf(buf, "Node %d, zone %m[^ ] %d %d %d %d %d %d %d %d %d %d %d",
-                           &b->node,
-                           &b->zone,
-                           &b->page[PAGE_4K],
-                           &b->page[PAGE_8K],
-                           &b->page[PAGE_16K],
-                           &b->page[PAGE_32K],
-                           &b->page[PAGE_64K],
-                           &b->page[PAGE_128K],
-                           &b->page[PAGE_256K],
-                           &b->page[PAGE_512K],
-                           &b->page[PAGE_1M],
-                           &b->page[PAGE_2M],
-                           &b->page[PAGE_4M]);
-                if (n != 13)
-                        break;
+                b->zone = strdup(zones[i].zone);
+                if (!b->zone) {
+                        free(b);
+                        return -ENOMEM;
+                }
 
-                if (!streq(zone, b->zone))
-                        continue;
+                b->node = zones[i].node;
+                for (o = 0; o < PAGE_MAX; o++)
+                        b->page[o] = (int) zones[i].page[o];
 
                 *bi = b;
-                b = NULL;
 
                 return 0;
         }
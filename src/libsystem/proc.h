@@ -53,15 +53,139 @@ extern "C" {
 
  proc_cmdline_get_str(&buf, "foo=");
  * \endcode
+ * The key before '=' is matched exactly, "foo=" does not match
+ * "foobar=". To look up many keys, #proc_cmdline_new() is cheaper.
  *
  * @param buf The value string is filled to here. This value has to be
  * free-ed by caller.
  * @param op An operator string.
  *
- * @return Result string. This value has to be free-ed by caller.
+ * @return Length of result string including null on success,
+ * -ENOENT if not found, -errno on other failures.
  */
 ssize_t proc_cmdline_get_str(char **buf, const char *op);
 
+/**
+ * Parsed kernel command line. Arguments are split with quotes as
+ * same as the kernel, and sorted by key.
+ */
+struct proc_cmdline;
+
+/**
+ * @brief Read whole /proc/cmdline without length limit and parse it.
+ * @code{.c}
+ {
+         _cleanup_proc_cmdline_free_ struct proc_cmdline *cmdline = NULL;
+         const char *root;
+         bool quiet;
+
+         proc_cmdline_new(&cmdline);
+
+         proc_cmdline_get(cmdline, "root", &root);
+         proc_cmdline_get_bool(cmdline, "quiet", &quiet);
+ }
+ * @endcode
+ *
+ * @param cmdline Allocated cmdline. This value has to be destroyed
+ * by caller. #_cleanup_proc_cmdline_free_ is useful to make
+ * allocated cmdline to autofree.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_cmdline_new(struct proc_cmdline **cmdline);
+
+/**
+ * @brief Parse a string in kernel command line format.
+ *
+ * @param str a command line string
+ * @param cmdline Allocated cmdline. This value has to be destroyed
+ * by caller.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_cmdline_new_from_string(const char *str, struct proc_cmdline **cmdline);
+
+/**
+ * @brief Destroy cmdline
+ *
+ * @param cmdline a cmdline
+ */
+void proc_cmdline_free(struct proc_cmdline *cmdline);
+
+static inline void proc_cmdline_freep(struct proc_cmdline **cmdline)
+{
+        if (*cmdline)
+                proc_cmdline_free(*cmdline);
+}
+
+/**
+ * Declare struct proc_cmdline with cleanup attribute. Allocated
+ * struct proc_cmdline is destroyed on going out the scope.
+ */
+#define _cleanup_proc_cmdline_free_ _cleanup_ (proc_cmdline_freep)
+
+/**
+ * @brief Get number of arguments in cmdline
+ *
+ * @param cmdline a cmdline
+ *
+ * @return number of arguments
+ */
+size_t proc_cmdline_size(const struct proc_cmdline *cmdline);
+
+/**
+ * @brief Find an argument by exact key with binary search. If a key
+ * is given more than once, the last one is found.
+ *
+ * @param cmdline a cmdline
+ * @param key key to find
+ * @param value Value of the key is filled. NULL is filled for an
+ * argument without '=', such like "quiet". This is valid while
+ * cmdline is alive. NULL is allowed to check existence only.
+ *
+ * @return 0 on success, -ENOENT if not found.
+ */
+int proc_cmdline_get(const struct proc_cmdline *cmdline, const char *key, const char **value);
+
+/**
+ * @brief Get boolean value of key with parse_boolean(). An argument
+ * without value, such like "quiet", is true.
+ *
+ * @param cmdline a cmdline
+ * @param key key to find
+ * @param value parsed value
+ *
+ * @return 0 on success, -ENOENT if not found, -EINVAL if value is
+ * not boolean.
+ */
+int proc_cmdline_get_bool(const struct proc_cmdline *cmdline, const char *key, bool *value);
+
+/**
+ * @brief Get integer value of key. Prefix "0x" and "0" are parsed as
+ * hexadecimal and octal.
+ *
+ * @param cmdline a cmdline
+ * @param key key to find
+ * @param value parsed value
+ *
+ * @return 0 on success, -ENOENT if not found, -EINVAL if value is
+ * not a number, -ERANGE if value is out of int.
+ */
+int proc_cmdline_get_int(const struct proc_cmdline *cmdline, const char *key, int *value);
+
+/**
+ * @brief Get byte size value of key with parse_bytes(), such like
+ * "crashkernel=256M".
+ *
+ * @param cmdline a cmdline
+ * @param key key to find
+ * @param value parsed value in bytes
+ *
+ * @return 0 on success, -ENOENT if not found, -EINVAL if value is
+ * not a byte size.
+ */
+int proc_cmdline_get_bytes(const struct proc_cmdline *cmdline, const char *key, size_t *value);
+
 /**
  * @brief Get PID of process.
  *
@@ -72,6 +196,201 @@ ssize_t proc_cmdline_get_str(char **buf, const char *op);
  */
 int proc_pid_of(const char *pname);
 
+/**
+ * An index of /proc/[pid]/comm to resolve many process names with
+ * one /proc walk. See #proc_comm_index_new().
+ */
+struct proc_comm_index;
+
+/**
+ * @brief Create a comm index. /proc is walked once and each comm is
+ * read by openat() relative to /proc, no memory allocation is
+ * involved for each pid.
+ * @code{.c}
+ {
+         _cleanup_proc_comm_index_free_ struct proc_comm_index *index = NULL;
+         pid_t pids[8];
+         size_t n;
+
+         proc_comm_index_new(&index);
+
+         n = proc_comm_index_lookup(index, "systemd", pids, ELEMENTSOF(pids));
+         ...
+         proc_comm_index_refresh(index);
+         ...
+ }
+ * @endcode
+ *
+ * @param index Allocated index. This value has to be destroyed by
+ * caller. #_cleanup_proc_comm_index_free_ is useful to make
+ * allocated index to autofree.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_comm_index_new(struct proc_comm_index **index);
+
+/**
+ * @brief Update comm index. Only the comm of pids which newly
+ * appeared are read, and disappeared pids are dropped. A comm
+ * changed for a living pid (exec, prctl) and a pid recycled between
+ * two refreshes are not caught, create a new index for them.
+ *
+ * @param index a comm index
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_comm_index_refresh(struct proc_comm_index *index);
+
+/**
+ * @brief Destroy comm index
+ *
+ * @param index a comm index
+ */
+void proc_comm_index_free(struct proc_comm_index *index);
+
+static inline void proc_comm_index_freep(struct proc_comm_index **index)
+{
+        if (*index)
+                proc_comm_index_free(*index);
+}
+
+/**
+ * Declare struct proc_comm_index with cleanup attribute. Allocated
+ * struct proc_comm_index is destroyed on going out the scope.
+ */
+#define _cleanup_proc_comm_index_free_ _cleanup_ (proc_comm_index_freep)
+
+/**
+ * @brief Find pids of process name in comm index. As same as
+ * #proc_pid_of(), only the first 15 characters of comm are compared.
+ *
+ * @param index a comm index
+ * @param comm Process name.
+ * @param pids Found pids are filled in ascending order. NULL is
+ * allowed if n_pids is 0.
+ * @param n_pids size of pids
+ *
+ * @return Number of matched pids. It can be bigger than n_pids, then
+ * only first n_pids pids are filled.
+ */
+size_t proc_comm_index_lookup(const struct proc_comm_index *index, const char *comm, pid_t *pids, size_t n_pids);
+
+/**
+ * A process in #proc_snapshot. Memory sizes are in kB, CPU times are
+ * in clock ticks.
+ */
+struct proc_snapshot_entry {
+        pid_t pid;
+        pid_t ppid;
+        /** state in /proc/[pid]/stat, such like 'R', 'S' or 'Z' */
+        char state;
+        char comm[16];
+        unsigned int num_threads;
+        uint64_t utime;
+        uint64_t stime;
+        /** ticks after system boot */
+        uint64_t start_time;
+        uint64_t vsize;
+        uint64_t rss;
+        /** below are filled only with #PROC_SNAPSHOT_STATM */
+        uint64_t shared;
+        uint64_t text;
+        uint64_t data;
+};
+
+/**
+ * Process table snapshot
+ */
+struct proc_snapshot {
+        /** CLOCK_MONOTONIC time in microsecond when taken */
+        uint64_t timestamp;
+        size_t n_proc;
+        /** sorted by pid */
+        struct proc_snapshot_entry *procs;
+};
+
+/**
+ * proc snapshot flags
+ */
+enum proc_snapshot_flags {
+        /** also read /proc/[pid]/statm for shared, text and data */
+        PROC_SNAPSHOT_STATM = 1 << 0,
+};
+
+/**
+ * @brief Take a snapshot of all processes. /proc is walked once and
+ * /proc/[pid]/stat is read by openat() relative to /proc without
+ * stdio or memory allocation for each pid. Processes which are gone
+ * during the walk are not included.
+ *
+ * @param snapshot Allocated snapshot. This value has to be destroyed
+ * by caller. #_cleanup_proc_snapshot_free_ is useful to make
+ * allocated snapshot to autofree.
+ * @param flags bitwise or of #proc_snapshot_flags
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_snapshot_take(struct proc_snapshot **snapshot, enum proc_snapshot_flags flags);
+
+/**
+ * @brief Destroy proc snapshot
+ *
+ * @param snapshot a proc snapshot
+ */
+void proc_snapshot_free(struct proc_snapshot *snapshot);
+
+static inline void proc_snapshot_freep(struct proc_snapshot **snapshot)
+{
+        if (*snapshot)
+                proc_snapshot_free(*snapshot);
+}
+
+/**
+ * Declare struct proc_snapshot with cleanup attribute. Allocated
+ * struct proc_snapshot is destroyed on going out the scope.
+ */
+#define _cleanup_proc_snapshot_free_ _cleanup_ (proc_snapshot_freep)
+
+/**
+ * @brief Find a process in snapshot by binary search.
+ *
+ * @param snapshot a proc snapshot
+ * @param pid pid to find
+ *
+ * @return the entry, NULL if not found.
+ */
+const struct proc_snapshot_entry *proc_snapshot_find(const struct proc_snapshot *snapshot, pid_t pid);
+
+/**
+ * Change of a process between two snapshots
+ */
+struct proc_snapshot_delta {
+        pid_t pid;
+        /** true if the process is not in old snapshot, or the pid
+         * was reused. Then all of its CPU time and RSS are counted. */
+        bool is_new;
+        /** CPU usage in percent of one CPU */
+        double cpu_usage;
+        /** RSS change in kB */
+        int64_t rss_delta;
+};
+
+/**
+ * @brief Compare two snapshots. There is an entry for each process
+ * in new snapshot, in pid order. Exited processes are not included.
+ *
+ * @param old older snapshot
+ * @param new newer snapshot
+ * @param delta Allocated array of changes. This value has to be
+ * free-ed by caller.
+ * @param n_delta number of entries in delta
+ *
+ * @return 0 on success, -EINVAL if new is not newer than old,
+ * -errno on other failures.
+ */
+int proc_snapshot_diff(const struct proc_snapshot *old, const struct proc_snapshot *new,
+                       struct proc_snapshot_delta **delta, size_t *n_delta);
+
 /**
  * smaps id
  */
@@ -228,206 +547,1202 @@ enum smap_id smap_string_to_id(const char *str);
 int proc_pid_get_smaps(pid_t pid, struct smaps **maps, enum smap_mask mask);
 
 /**
- * meminfo id
+ * A smap view which is passed to #proc_pid_foreach_smap()
+ * callback. Strings are not copied but point into the read buffer,
+ * so they are valid only in the callback.
  */
-enum meminfo_id {
-        MEMINFO_ID_INVALID = -1,
-        MEMINFO_ID_MEM_TOTAL = 0,
-        MEMINFO_ID_MEM_FREE,
-        MEMINFO_ID_MEM_AVAILABLE,
-        MEMINFO_ID_BUFFERS,
-        MEMINFO_ID_CACHED,
-        MEMINFO_ID_SWAP_CACHED,
-        MEMINFO_ID_ACTIVE,
-        MEMINFO_ID_INACTIVE,
-        MEMINFO_ID_ACTIVE_ANON,
-        MEMINFO_ID_INACTIVE_ANON,
-        MEMINFO_ID_ACTIVE_FILE,
-        MEMINFO_ID_INACTIVE_FILE,
-        MEMINFO_ID_UNEVICTABLE,
-        MEMINFO_ID_MLOCKED,
-        MEMINFO_ID_HIGH_TOTAL,
-        MEMINFO_ID_HIGH_FREE,
-        MEMINFO_ID_LOW_TOTAL,
-        MEMINFO_ID_LOW_FREE,
-        MEMINFO_ID_SWAP_TOTAL,
-        MEMINFO_ID_SWAP_FREE,
-        MEMINFO_ID_DIRTY,
-        MEMINFO_ID_WRITEBACK,
-        MEMINFO_ID_ANON_PAGES,
-        MEMINFO_ID_MAPPED,
-        MEMINFO_ID_SHMEM,
-        MEMINFO_ID_SLAB,
-        MEMINFO_ID_SRECLAIMABLE,
-        MEMINFO_ID_SUNRECLAIM,
-        MEMINFO_ID_KERNEL_STACK,
-        MEMINFO_ID_PAGE_TABLES,
-        MEMINFO_ID_NFS_UNSTABLE,
-        MEMINFO_ID_BOUNCE,
-        MEMINFO_ID_WRITEBACK_TMP,
-        MEMINFO_ID_COMMIT_LIMIT,
-        MEMINFO_ID_COMMITTED_AS,
-        MEMINFO_ID_VMALLOC_TOTAL,
-        MEMINFO_ID_VMALLOC_USED,
-        MEMINFO_ID_VMALLOC_CHUNK,
-        MEMINFO_ID_MAX,
+struct smap_view {
+        /**
+         * start address
+         */
+        unsigned long long start;
+        /**
+         * end address
+         */
+        unsigned long long end;
+        /**
+         * smaps mode, null terminated
+         */
+        const char *mode;
+        /**
+         * length of mode
+         */
+        size_t mode_len;
+        /**
+         * smaps name, null terminated. "[anon]" for anonymous mapping.
+         */
+        const char *name;
+        /**
+         * length of name
+         */
+        size_t name_len;
+        /**
+         * value of each, only masked values are filled
+         */
+        unsigned long long value[SMAPS_ID_MAX];
 };
 
 /**
- * meminfo mask
+ * Callback of #proc_pid_foreach_smap(). Return 0 to continue,
+ * negative errno to stop iteration.
  */
-enum meminfo_mask {
-        MEMINFO_MASK_MEM_TOTAL          = 1ULL << MEMINFO_ID_MEM_TOTAL,
-        MEMINFO_MASK_MEM_FREE           = 1ULL << MEMINFO_ID_MEM_FREE,
-        MEMINFO_MASK_MEM_AVAILABLE      = 1ULL << MEMINFO_ID_MEM_AVAILABLE,
-        MEMINFO_MASK_BUFFERS            = 1ULL << MEMINFO_ID_BUFFERS,
-        MEMINFO_MASK_CACHED             = 1ULL << MEMINFO_ID_CACHED,
-        MEMINFO_MASK_SWAP_CACHED        = 1ULL << MEMINFO_ID_SWAP_CACHED,
-        MEMINFO_MASK_ACTIVE             = 1ULL << MEMINFO_ID_ACTIVE,
-        MEMINFO_MASK_INACTIVE           = 1ULL << MEMINFO_ID_INACTIVE,
-        MEMINFO_MASK_ACTIVE_ANON        = 1ULL << MEMINFO_ID_ACTIVE_ANON,
-        MEMINFO_MASK_INACTIVE_ANON      = 1ULL << MEMINFO_ID_INACTIVE_ANON,
-        MEMINFO_MASK_ACTIVE_FILE        = 1ULL << MEMINFO_ID_ACTIVE_FILE,
-        MEMINFO_MASK_INACTIVE_FILE      = 1ULL << MEMINFO_ID_INACTIVE_FILE,
-        MEMINFO_MASK_UNEVICTABLE        = 1ULL << MEMINFO_ID_UNEVICTABLE,
-        MEMINFO_MASK_MLOCKED            = 1ULL << MEMINFO_ID_MLOCKED,
-        MEMINFO_MASK_HIGH_TOTAL         = 1ULL << MEMINFO_ID_HIGH_TOTAL,
-        MEMINFO_MASK_HIGH_FREE          = 1ULL << MEMINFO_ID_HIGH_FREE,
-        MEMINFO_MASK_LOW_TOTAL          = 1ULL << MEMINFO_ID_LOW_TOTAL,
-        MEMINFO_MASK_LOW_FREE           = 1ULL << MEMINFO_ID_LOW_FREE,
-        MEMINFO_MASK_SWAP_TOTAL         = 1ULL << MEMINFO_ID_SWAP_TOTAL,
-        MEMINFO_MASK_SWAP_FREE          = 1ULL << MEMINFO_ID_SWAP_FREE,
-        MEMINFO_MASK_DIRTY              = 1ULL << MEMINFO_ID_DIRTY,
-        MEMINFO_MASK_WRITEBACK          = 1ULL << MEMINFO_ID_WRITEBACK,
-        MEMINFO_MASK_ANON_PAGES         = 1ULL << MEMINFO_ID_ANON_PAGES,
-        MEMINFO_MASK_MAPPED             = 1ULL << MEMINFO_ID_MAPPED,
-        MEMINFO_MASK_SHMEM              = 1ULL << MEMINFO_ID_SHMEM,
-        MEMINFO_MASK_SLAB               = 1ULL << MEMINFO_ID_SLAB,
-        MEMINFO_MASK_SRECLAIMABLE       = 1ULL << MEMINFO_ID_SRECLAIMABLE,
-        MEMINFO_MASK_SUNRECLAIM         = 1ULL << MEMINFO_ID_SUNRECLAIM,
-        MEMINFO_MASK_KERNEL_STACK       = 1ULL << MEMINFO_ID_KERNEL_STACK,
-        MEMINFO_MASK_PAGE_TABLES        = 1ULL << MEMINFO_ID_PAGE_TABLES,
-        MEMINFO_MASK_NFS_UNSTABLE       = 1ULL << MEMINFO_ID_NFS_UNSTABLE,
-        MEMINFO_MASK_BOUNCE             = 1ULL << MEMINFO_ID_BOUNCE,
-        MEMINFO_MASK_WRITEBACK_TMP      = 1ULL << MEMINFO_ID_WRITEBACK_TMP,
-        MEMINFO_MASK_COMMIT_LIMIT       = 1ULL << MEMINFO_ID_COMMIT_LIMIT,
-        MEMINFO_MASK_COMMITTED_AS       = 1ULL << MEMINFO_ID_COMMITTED_AS,
-        MEMINFO_MASK_VMALLOC_TOTAL      = 1ULL << MEMINFO_ID_VMALLOC_TOTAL,
-        MEMINFO_MASK_VMALLOC_USED       = 1ULL << MEMINFO_ID_VMALLOC_USED,
-        MEMINFO_MASK_VMALLOC_CHUNK      = 1ULL << MEMINFO_ID_VMALLOC_CHUNK,
-        MEMINFO_MASK_ALL                = (1ULL << MEMINFO_ID_MAX) - 1,
-};
+typedef int (*smap_foreach_func_t)(const struct smap_view *map, void *data);
 
 /**
- * meminfo
- */
-struct meminfo {
-        unsigned int value[MEMINFO_ID_MAX];
-};
+ * @brief Iterate smaps of pid without memory allocation. Each
+ * mapping is parsed in a stack buffer and passed to func as a view.
+ * @code{.c}
+ static int sum_pss(const struct smap_view *map, void *data)
+ {
+         *(unsigned long long *) data += map->value[SMAPS_ID_PSS];
+         return 0;
+ }
 
-/**
- * @brief Convert meminfo id to string
- *
- * @param id meminfo id
- *
- * @return converted string
- */
-const char *meminfo_id_to_string(enum meminfo_id id);
+ {
+         unsigned long long pss = 0;
 
-/**
- * @brief Convert meminfo string to id
+         proc_pid_foreach_smap(pid, SMAPS_MASK_PSS, sum_pss, &pss);
+ }
+ * @endcode
  *
- * @param str meminfo string
+ * @param pid a pid to get
+ * @param mask mask to parse smaps.
+ * @param func callback called for each mapping
+ * @param data user data passed to func
  *
- * @return converted id
+ * @return 0 on success, -errno on failure. If func returns negative,
+ * the value is returned.
  */
-enum meminfo_id meminfo_string_to_id(const char *str);
+int proc_pid_foreach_smap(pid_t pid, enum smap_mask mask, smap_foreach_func_t func, void *data);
 
 /**
- * @brief Get system memory info(/proc/meminfo)
+ * @brief Get sum of smaps values of pid. If the kernel supports
+ * /proc/<pid>/smaps_rollup, the kernel sums values and only a single
+ * record is parsed. Otherwise, /proc/<pid>/smaps is walked without
+ * memory allocation. smaps_rollup does not report the size of
+ * mappings, so #SMAPS_MASK_SIZE always takes the full walk.
  * @code{.c}
- unsigned int get_mem_available(void)
  {
-        struct meminfo mi;
+         unsigned long long sum[SMAPS_ID_MAX];
 
-        proc_get_meminfo(&mi, MEMINFO_MASK_MEM_AVAILABLE);
+         proc_pid_get_smaps_rollup(pid, SMAPS_MASK_PSS, sum);
  }
  * @endcode
  *
- * @param mi parsed meminfo struct.
- * @param mask mask to get meminfo.
+ * @param pid a pid to get
+ * @param mask mask to parse smaps.
+ * @param sum sum of each value is filled. Values out of mask are 0.
  *
  * @return 0 on success, -errno on failure.
  */
-int proc_get_meminfo(struct meminfo *mi, enum meminfo_mask mask);
+int proc_pid_get_smaps_rollup(pid_t pid, enum smap_mask mask, unsigned long long sum[SMAPS_ID_MAX]);
 
 /**
- * /proc/buddyinfo page index
+ * Result of a pid for #proc_get_smaps_many()
  */
-enum {
-        PAGE_4K = 0,
-        PAGE_8K,
-        PAGE_16K,
-        PAGE_32K,
-        PAGE_64K,
-        PAGE_128K,
-        PAGE_256K,
-        PAGE_512K,
-        PAGE_1M,
-        PAGE_2M,
-        PAGE_4M,
-        PAGE_MAX,
+struct smaps_result {
+        pid_t pid;
+        /** 0 on success, -errno on failure of this pid */
+        int error;
+        /** same with #proc_pid_get_smaps_rollup() */
+        unsigned long long sum[SMAPS_ID_MAX];
 };
 
 /**
- * A zone buddy info
+ * @brief Get smaps sum of many pids in parallel. pids are given to
+ * the threads one by one, so a few large processes do not hold
+ * the others. Each thread reuses its own read buffer.
+ *
+ * @param pids pids to get
+ * @param n number of pids
+ * @param mask mask to parse smaps.
+ * @param n_threads number of threads including the caller. 0 means
+ * the number of online CPUs.
+ * @param results array of n results. results[i] is for pids[i]. A
+ * failure on a pid, such like exited process, is set to its error
+ * and does not fail the others.
+ *
+ * @return 0 on success, -errno on failure.
  */
-struct buddyinfo {
+int proc_get_smaps_many(const pid_t *pids, size_t n, enum smap_mask mask,
+                        unsigned int n_threads, struct smaps_result *results);
+
+/**
+ * A smaps snapshot of pid. All of mappings are stored in one
+ * contiguous memory as struct of arrays, the i-th mapping is
+ * start[i], end[i], value[id][i] and so on. Addresses and values are
+ * 64 bit. Strings are interned in one string pool and mode[i] and
+ * name[i] are offsets into the pool. The whole snapshot is freed by
+ * a single free().
+ */
+struct smaps_snapshot {
         /**
-         * Zone name
+         * sum value of each
          */
-        char *zone;
+        uint64_t sum[SMAPS_ID_MAX];
         /**
-         * Node number
+         * number of maps
          */
-        int node;
+        size_t n_map;
         /**
-         * Each pages size
+         * start addresses
          */
-        int page[PAGE_MAX];
+        uint64_t *start;
+        /**
+         * end addresses
+         */
+        uint64_t *end;
+        /**
+         * values of each. NULL if the id is not in the mask.
+         */
+        uint64_t *value[SMAPS_ID_MAX];
+        /**
+         * mode offsets in strings
+         */
+        uint32_t *mode;
+        /**
+         * name offsets in strings
+         */
+        uint32_t *name;
+        /**
+         * map indexes sorted by start address
+         */
+        uint32_t *by_addr;
+        /**
+         * string pool
+         */
+        char *strings;
+        /**
+         * size of string pool
+         */
+        size_t strings_size;
 };
 
 /**
- * @brief free struct buddyinfo
- *
- * @param bi a buddyinfo
+ * @brief Get mode string of i-th mapping in snapshot
  */
-void proc_buddyinfo_free(struct buddyinfo *bi);
-
-static inline void buddyinfo_freep(struct buddyinfo **bi)
-{
-        proc_buddyinfo_free(*bi);
+static inline const char *smaps_snapshot_mode(const struct smaps_snapshot *snapshot, size_t i) {
+        return snapshot->strings + snapshot->mode[i];
 }
 
 /**
- * Declare struct buddyinfo with cleanup attribute. Allocated struct
- * buddyinfo is destroyed on going out the scope.
+ * @brief Get name string of i-th mapping in snapshot
  */
-#define _cleanup_buddyinfo_free_ _cleanup_(buddyinfo_freep)
+static inline const char *smaps_snapshot_name(const struct smaps_snapshot *snapshot, size_t i) {
+        return snapshot->strings + snapshot->name[i];
+}
 
 /**
- * @brief Parse a zone in /proc/buddyinfo
+ * @brief Get smaps snapshot of pid
  *
- * @param zone A zone to parse such like "Normal"
- *
- * @param bi Allocated and parsed buddyinfo for given zone. This value
- * has to be destroyed by caller. #_cleanup_buddyinfo_free_ is useful
- * to make autofree this value.
- *
- * @return 0 on success, -errno on failure.
- */
+ * @param pid a pid to get
+ * @param snapshot parsed smaps snapshot. This value has to be free-ed
+ * by caller with free(). #_cleanup_free_ is useful to make it
+ * autofree.
+ * @code{.c}
+ {
+         _cleanup_free_ struct smaps_snapshot *s = NULL;
+         ssize_t i;
+
+         proc_pid_get_smaps_snapshot(pid, &s, SMAPS_MASK_RSS);
+         i = smaps_find_by_addr(s, addr);
+         if (i >= 0)
+                 printf("%s %" PRIu64 "\n", smaps_snapshot_name(s, i), s->value[SMAPS_ID_RSS][i]);
+ }
+ * @endcode
+ * @param mask mask to parse smaps.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_pid_get_smaps_snapshot(pid_t pid, struct smaps_snapshot **snapshot, enum smap_mask mask);
+
+/**
+ * @brief Find the mapping which includes given address in O(log n)
+ *
+ * @param snapshot a smaps snapshot
+ * @param addr address to find
+ *
+ * @return index of the mapping on success, -ENOENT if no mapping
+ * includes the address.
+ */
+ssize_t smaps_find_by_addr(const struct smaps_snapshot *snapshot, uint64_t addr);
+
+/**
+ * meminfo id. Generated from proc-meminfo-list.h, such like
+ * MEMINFO_ID_MEM_TOTAL for "MemTotal".
+ */
+enum meminfo_id {
+        MEMINFO_ID_INVALID = -1,
+#define MEMINFO_KEY(id, key) MEMINFO_ID_##id,
+#include "proc-meminfo-list.h"
+#undef MEMINFO_KEY
+        MEMINFO_ID_MAX,
+};
+
+/**
+ * Number of the keys listed by MEMINFO_KEY(), from
+ * MEMINFO_ID_MEM_TOTAL to MEMINFO_ID_VMALLOC_CHUNK. struct meminfo,
+ * struct meminfo64 and struct meminfo_rate are sized by this, so
+ * their size does not change when keys are added with
+ * MEMINFO_KEY_EXT(). Those are read with
+ * #proc_get_meminfo64_bitset() into an array of the caller.
+ */
+#define MEMINFO_ID_BASE_MAX     38
+
+/**
+ * meminfo mask. Generated from proc-meminfo-list.h, such like
+ * MEMINFO_MASK_MEM_TOTAL. Only the keys listed by MEMINFO_KEY() have
+ * mask, use struct meminfo_bitset for the others.
+ */
+enum meminfo_mask {
+#define MEMINFO_KEY(id, key) MEMINFO_MASK_##id = 1ULL << MEMINFO_ID_##id,
+#define MEMINFO_KEY_EXT(id, key)
+#include "proc-meminfo-list.h"
+#undef MEMINFO_KEY
+        MEMINFO_MASK_ALL                = 0
+#define MEMINFO_KEY(id, key) | MEMINFO_MASK_##id
+#define MEMINFO_KEY_EXT(id, key)
+#include "proc-meminfo-list.h"
+#undef MEMINFO_KEY
+        ,
+};
+
+/**
+ * Number of 64 bit words of struct meminfo_bitset. This is fixed,
+ * not computed from MEMINFO_ID_MAX, to keep the size of the struct
+ * while keys are added.
+ */
+#define MEMINFO_BITSET_WORDS    2
+
+/**
+ * meminfo bitset. This is able to select all of meminfo ids while
+ * enum meminfo_mask is limited to 64.
+ */
+struct meminfo_bitset {
+        uint64_t bits[MEMINFO_BITSET_WORDS];
+};
+
+/**
+ * @brief Add a meminfo id to bitset
+ */
+static inline void meminfo_bitset_set(struct meminfo_bitset *set, enum meminfo_id id) {
+        set->bits[id / 64] |= 1ULL << (id % 64);
+}
+
+/**
+ * @brief Remove a meminfo id from bitset
+ */
+static inline void meminfo_bitset_unset(struct meminfo_bitset *set, enum meminfo_id id) {
+        set->bits[id / 64] &= ~(1ULL << (id % 64));
+}
+
+/**
+ * @brief Check a meminfo id is in bitset
+ */
+static inline bool meminfo_bitset_test(const struct meminfo_bitset *set, enum meminfo_id id) {
+        return !!(set->bits[id / 64] & (1ULL << (id % 64)));
+}
+
+/**
+ * @brief Initialize bitset from enum meminfo_mask
+ */
+static inline void meminfo_bitset_from_mask(struct meminfo_bitset *set, enum meminfo_mask mask) {
+        memset(set, 0, sizeof(struct meminfo_bitset));
+        set->bits[0] = mask;
+}
+
+/**
+ * @brief Initialize bitset with all of meminfo ids
+ */
+static inline void meminfo_bitset_fill(struct meminfo_bitset *set) {
+        int i;
+
+        memset(set, 0, sizeof(struct meminfo_bitset));
+        for (i = 0; i < MEMINFO_ID_MAX; i++)
+                meminfo_bitset_set(set, (enum meminfo_id) i);
+}
+
+/**
+ * meminfo
+ */
+struct meminfo {
+        unsigned int value[MEMINFO_ID_BASE_MAX];
+};
+
+/**
+ * 64 bit meminfo
+ */
+struct meminfo64 {
+        /**
+         * value of each in kB
+         */
+        uint64_t value[MEMINFO_ID_BASE_MAX];
+        /**
+         * CLOCK_MONOTONIC time of the sample in microsecond
+         */
+        uint64_t timestamp;
+};
+
+/**
+ * Change rates between two meminfo samples
+ */
+struct meminfo_rate {
+        /**
+         * change of each in kB per second. Negative on decrease.
+         */
+        int64_t value[MEMINFO_ID_BASE_MAX];
+        /**
+         * change of used swap (SwapTotal - SwapFree) in kB per
+         * second. Positive on swap growth.
+         */
+        int64_t swap_used;
+        /**
+         * change of Dirty + Writeback in kB per second. Negative
+         * while dirty pages are drained.
+         */
+        int64_t dirty_writeback;
+        /**
+         * interval between two samples in microsecond
+         */
+        uint64_t interval;
+};
+
+/**
+ * @brief Convert meminfo id to string
+ *
+ * @param id meminfo id
+ *
+ * @return converted string
+ */
+const char *meminfo_id_to_string(enum meminfo_id id);
+
+/**
+ * @brief Convert meminfo string to id
+ *
+ * @param str meminfo string
+ *
+ * @return converted id
+ */
+enum meminfo_id meminfo_string_to_id(const char *str);
+
+/**
+ * @brief Get system memory info(/proc/meminfo)
+ * @code{.c}
+ unsigned int get_mem_available(void)
+ {
+        struct meminfo mi;
+
+        proc_get_meminfo(&mi, MEMINFO_MASK_MEM_AVAILABLE);
+ }
+ * @endcode
+ *
+ * @param mi parsed meminfo struct.
+ * @param mask mask to get meminfo.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_get_meminfo(struct meminfo *mi, enum meminfo_mask mask);
+
+/**
+ * @brief Get system memory info(/proc/meminfo) in 64 bit
+ * values. Values are not wrapped around on large memory system.
+ *
+ * @param mi parsed meminfo struct. timestamp is also filled.
+ * @param mask mask to get meminfo.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_get_meminfo64(struct meminfo64 *mi, enum meminfo_mask mask);
+
+/**
+ * @brief Get system memory info(/proc/meminfo) in 64 bit values with
+ * bitset. This is able to get the keys which have no enum
+ * meminfo_mask in the same single pass. Values are stored in the
+ * array of the caller indexed by enum meminfo_id, ids which are not
+ * less than n_value are not stored.
+ * @code{.c}
+ {
+         struct meminfo_bitset set = {};
+         uint64_t value[MEMINFO_ID_MAX];
+
+         meminfo_bitset_set(&set, MEMINFO_ID_MEM_AVAILABLE);
+         meminfo_bitset_set(&set, MEMINFO_ID_ZSWAP);
+         meminfo_bitset_set(&set, MEMINFO_ID_HUGETLB);
+
+         proc_get_meminfo64_bitset(value, ELEMENTSOF(value), &set, NULL);
+ }
+ * @endcode
+ *
+ * @param value parsed values in kB
+ * @param n_value number of elements of value
+ * @param set bitset to get meminfo.
+ * @param timestamp CLOCK_MONOTONIC time of the sample in microsecond
+ * is filled. NULL is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_get_meminfo64_bitset(uint64_t *value, size_t n_value, const struct meminfo_bitset *set, uint64_t *timestamp);
+
+/**
+ * @brief Compute per second change rates between two meminfo
+ * samples. Values which are not in the mask of both samples are
+ * meaningless.
+ * @code{.c}
+ {
+         struct meminfo64 old, new;
+         struct meminfo_rate rate;
+
+         proc_get_meminfo64(&old, MEMINFO_MASK_DIRTY | MEMINFO_MASK_WRITEBACK);
+         sleep(1);
+         proc_get_meminfo64(&new, MEMINFO_MASK_DIRTY | MEMINFO_MASK_WRITEBACK);
+
+         meminfo_delta(&old, &new, &rate);
+         if (rate.dirty_writeback < 0)
+                 printf("draining %" PRId64 " kB/s\n", -rate.dirty_writeback);
+ }
+ * @endcode
+ *
+ * @param old older sample
+ * @param new newer sample
+ * @param rate computed rates
+ *
+ * @return 0 on success, -EINVAL if new is not newer than old.
+ */
+int meminfo_delta(const struct meminfo64 *old, const struct meminfo64 *new, struct meminfo_rate *rate);
+
+/**
+ * meminfo sampler. It keeps /proc/meminfo opened and re-reads it
+ * from the beginning on each sample.
+ */
+struct meminfo_sampler;
+
+/**
+ * @brief Create meminfo sampler. Frequent meminfo polling is
+ * recommended to use this instead of #proc_get_meminfo().
+ * @code{.c}
+ {
+         _cleanup_meminfo_sampler_free_ struct meminfo_sampler *s = NULL;
+         struct meminfo mi;
+         uint64_t t;
+
+         meminfo_sampler_new(&s);
+
+         for (;;) {
+                 meminfo_sampler_read(s, &mi, MEMINFO_MASK_MEM_AVAILABLE, &t);
+                 ...
+         }
+ }
+ * @endcode
+ *
+ * @param sampler Allocated sampler. This value has to be destroyed
+ * by caller. #_cleanup_meminfo_sampler_free_ is useful to make
+ * allocated sampler to autofree.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int meminfo_sampler_new(struct meminfo_sampler **sampler);
+
+/**
+ * @brief Destroy meminfo sampler
+ *
+ * @param sampler a meminfo sampler
+ */
+void meminfo_sampler_free(struct meminfo_sampler *sampler);
+
+static inline void meminfo_sampler_freep(struct meminfo_sampler **sampler)
+{
+        if (*sampler)
+                meminfo_sampler_free(*sampler);
+}
+
+/**
+ * Declare struct meminfo_sampler with cleanup attribute. Allocated
+ * struct meminfo_sampler is destroyed on going out the scope.
+ */
+#define _cleanup_meminfo_sampler_free_ _cleanup_ (meminfo_sampler_freep)
+
+/**
+ * @brief Take a meminfo sample. The file is read with pread() on the
+ * opened fd into the buffer of sampler, no file open or memory
+ * allocation is involved.
+ *
+ * @param sampler a meminfo sampler
+ * @param mi parsed meminfo struct.
+ * @param mask mask to get meminfo. Same with #proc_get_meminfo().
+ * @param timestamp CLOCK_MONOTONIC time of the sample in microsecond
+ * is filled. NULL is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int meminfo_sampler_read(struct meminfo_sampler *sampler, struct meminfo *mi, enum meminfo_mask mask, uint64_t *timestamp);
+
+/**
+ * @brief Take a meminfo sample in 64 bit values. Same with
+ * #meminfo_sampler_read() but the timestamp is stored in mi.
+ *
+ * @param sampler a meminfo sampler
+ * @param mi parsed meminfo struct.
+ * @param mask mask to get meminfo.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int meminfo_sampler_read64(struct meminfo_sampler *sampler, struct meminfo64 *mi, enum meminfo_mask mask);
+
+/**
+ * @brief Take a meminfo sample in 64 bit values with bitset. Same
+ * with #proc_get_meminfo64_bitset() but read with sampler.
+ *
+ * @param sampler a meminfo sampler
+ * @param value parsed values in kB
+ * @param n_value number of elements of value
+ * @param set bitset to get meminfo.
+ * @param timestamp CLOCK_MONOTONIC time of the sample in microsecond
+ * is filled. NULL is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int meminfo_sampler_read64_bitset(struct meminfo_sampler *sampler, uint64_t *value, size_t n_value,
+                                  const struct meminfo_bitset *set, uint64_t *timestamp);
+
+/**
+ * /proc/[pid]/status id
+ */
+enum proc_status_id {
+        PROC_STATUS_ID_INVALID = -1,
+        PROC_STATUS_ID_TGID = 0,
+        PROC_STATUS_ID_PID,
+        PROC_STATUS_ID_PPID,
+        PROC_STATUS_ID_TRACER_PID,
+        PROC_STATUS_ID_FD_SIZE,
+        PROC_STATUS_ID_VM_PEAK,
+        PROC_STATUS_ID_VM_SIZE,
+        PROC_STATUS_ID_VM_LCK,
+        PROC_STATUS_ID_VM_PIN,
+        PROC_STATUS_ID_VM_HWM,
+        PROC_STATUS_ID_VM_RSS,
+        PROC_STATUS_ID_RSS_ANON,
+        PROC_STATUS_ID_RSS_FILE,
+        PROC_STATUS_ID_RSS_SHMEM,
+        PROC_STATUS_ID_VM_DATA,
+        PROC_STATUS_ID_VM_STK,
+        PROC_STATUS_ID_VM_EXE,
+        PROC_STATUS_ID_VM_LIB,
+        PROC_STATUS_ID_VM_PTE,
+        PROC_STATUS_ID_VM_SWAP,
+        PROC_STATUS_ID_HUGETLB_PAGES,
+        PROC_STATUS_ID_THREADS,
+        PROC_STATUS_ID_VOLUNTARY_CTXT_SWITCHES,
+        PROC_STATUS_ID_NONVOLUNTARY_CTXT_SWITCHES,
+        PROC_STATUS_ID_MAX,
+};
+
+/**
+ * /proc/[pid]/status mask
+ */
+enum proc_status_mask {
+        PROC_STATUS_MASK_TGID                           = 1 << PROC_STATUS_ID_TGID,
+        PROC_STATUS_MASK_PID                            = 1 << PROC_STATUS_ID_PID,
+        PROC_STATUS_MASK_PPID                           = 1 << PROC_STATUS_ID_PPID,
+        PROC_STATUS_MASK_TRACER_PID                     = 1 << PROC_STATUS_ID_TRACER_PID,
+        PROC_STATUS_MASK_FD_SIZE                        = 1 << PROC_STATUS_ID_FD_SIZE,
+        PROC_STATUS_MASK_VM_PEAK                        = 1 << PROC_STATUS_ID_VM_PEAK,
+        PROC_STATUS_MASK_VM_SIZE                        = 1 << PROC_STATUS_ID_VM_SIZE,
+        PROC_STATUS_MASK_VM_LCK                         = 1 << PROC_STATUS_ID_VM_LCK,
+        PROC_STATUS_MASK_VM_PIN                         = 1 << PROC_STATUS_ID_VM_PIN,
+        PROC_STATUS_MASK_VM_HWM                         = 1 << PROC_STATUS_ID_VM_HWM,
+        PROC_STATUS_MASK_VM_RSS                         = 1 << PROC_STATUS_ID_VM_RSS,
+        PROC_STATUS_MASK_RSS_ANON                       = 1 << PROC_STATUS_ID_RSS_ANON,
+        PROC_STATUS_MASK_RSS_FILE                       = 1 << PROC_STATUS_ID_RSS_FILE,
+        PROC_STATUS_MASK_RSS_SHMEM                      = 1 << PROC_STATUS_ID_RSS_SHMEM,
+        PROC_STATUS_MASK_VM_DATA                        = 1 << PROC_STATUS_ID_VM_DATA,
+        PROC_STATUS_MASK_VM_STK                         = 1 << PROC_STATUS_ID_VM_STK,
+        PROC_STATUS_MASK_VM_EXE                         = 1 << PROC_STATUS_ID_VM_EXE,
+        PROC_STATUS_MASK_VM_LIB                         = 1 << PROC_STATUS_ID_VM_LIB,
+        PROC_STATUS_MASK_VM_PTE                         = 1 << PROC_STATUS_ID_VM_PTE,
+        PROC_STATUS_MASK_VM_SWAP                        = 1 << PROC_STATUS_ID_VM_SWAP,
+        PROC_STATUS_MASK_HUGETLB_PAGES                  = 1 << PROC_STATUS_ID_HUGETLB_PAGES,
+        PROC_STATUS_MASK_THREADS                        = 1 << PROC_STATUS_ID_THREADS,
+        PROC_STATUS_MASK_VOLUNTARY_CTXT_SWITCHES        = 1 << PROC_STATUS_ID_VOLUNTARY_CTXT_SWITCHES,
+        PROC_STATUS_MASK_NONVOLUNTARY_CTXT_SWITCHES     = 1 << PROC_STATUS_ID_NONVOLUNTARY_CTXT_SWITCHES,
+        PROC_STATUS_MASK_ALL                            = (1 << PROC_STATUS_ID_MAX) - 1,
+};
+
+/**
+ * Numeric fields of /proc/[pid]/status. Memory sizes are in kB.
+ */
+struct proc_status {
+        uint64_t value[PROC_STATUS_ID_MAX];
+};
+
+/**
+ * @brief Convert proc status id to string
+ *
+ * @param id proc status id
+ *
+ * @return converted string
+ */
+const char *proc_status_id_to_string(enum proc_status_id id);
+
+/**
+ * @brief Convert proc status string to id
+ *
+ * @param str proc status string
+ *
+ * @return converted id
+ */
+enum proc_status_id proc_status_string_to_id(const char *str);
+
+/**
+ * @brief Get /proc/[pid]/status. Reading and parsing stop as soon as
+ * all of masked fields are found. For RSS of a process, this is much
+ * cheaper than summing smaps.
+ * @code{.c}
+ {
+         struct proc_status st;
+
+         proc_pid_get_status(pid, &st, PROC_STATUS_MASK_VM_RSS | PROC_STATUS_MASK_VM_SWAP);
+ }
+ * @endcode
+ *
+ * @param pid a pid to get
+ * @param st parsed status. Values out of mask or not reported by the
+ * kernel are 0.
+ * @param mask mask of #proc_status_mask to get
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_pid_get_status(pid_t pid, struct proc_status *st, enum proc_status_mask mask);
+
+/**
+ * cgroup memory.stat id
+ */
+enum cgroup_memory_stat_id {
+        CGROUP_MEMORY_STAT_ID_INVALID = -1,
+        CGROUP_MEMORY_STAT_ID_ANON = 0,
+        CGROUP_MEMORY_STAT_ID_FILE,
+        CGROUP_MEMORY_STAT_ID_KERNEL,
+        CGROUP_MEMORY_STAT_ID_KERNEL_STACK,
+        CGROUP_MEMORY_STAT_ID_PAGETABLES,
+        CGROUP_MEMORY_STAT_ID_SOCK,
+        CGROUP_MEMORY_STAT_ID_SHMEM,
+        CGROUP_MEMORY_STAT_ID_FILE_MAPPED,
+        CGROUP_MEMORY_STAT_ID_FILE_DIRTY,
+        CGROUP_MEMORY_STAT_ID_FILE_WRITEBACK,
+        CGROUP_MEMORY_STAT_ID_SWAPCACHED,
+        CGROUP_MEMORY_STAT_ID_ANON_THP,
+        CGROUP_MEMORY_STAT_ID_INACTIVE_ANON,
+        CGROUP_MEMORY_STAT_ID_ACTIVE_ANON,
+        CGROUP_MEMORY_STAT_ID_INACTIVE_FILE,
+        CGROUP_MEMORY_STAT_ID_ACTIVE_FILE,
+        CGROUP_MEMORY_STAT_ID_UNEVICTABLE,
+        CGROUP_MEMORY_STAT_ID_SLAB_RECLAIMABLE,
+        CGROUP_MEMORY_STAT_ID_SLAB_UNRECLAIMABLE,
+        CGROUP_MEMORY_STAT_ID_SLAB,
+        CGROUP_MEMORY_STAT_ID_WORKINGSET_REFAULT_ANON,
+        CGROUP_MEMORY_STAT_ID_WORKINGSET_REFAULT_FILE,
+        CGROUP_MEMORY_STAT_ID_PGFAULT,
+        CGROUP_MEMORY_STAT_ID_PGMAJFAULT,
+        CGROUP_MEMORY_STAT_ID_PGSCAN,
+        CGROUP_MEMORY_STAT_ID_PGSTEAL,
+        CGROUP_MEMORY_STAT_ID_MAX,
+};
+
+/**
+ * cgroup memory.stat mask
+ */
+enum cgroup_memory_stat_mask {
+        CGROUP_MEMORY_STAT_MASK_ANON                           = 1 << CGROUP_MEMORY_STAT_ID_ANON,
+        CGROUP_MEMORY_STAT_MASK_FILE                           = 1 << CGROUP_MEMORY_STAT_ID_FILE,
+        CGROUP_MEMORY_STAT_MASK_KERNEL                         = 1 << CGROUP_MEMORY_STAT_ID_KERNEL,
+        CGROUP_MEMORY_STAT_MASK_KERNEL_STACK                   = 1 << CGROUP_MEMORY_STAT_ID_KERNEL_STACK,
+        CGROUP_MEMORY_STAT_MASK_PAGETABLES                     = 1 << CGROUP_MEMORY_STAT_ID_PAGETABLES,
+        CGROUP_MEMORY_STAT_MASK_SOCK                           = 1 << CGROUP_MEMORY_STAT_ID_SOCK,
+        CGROUP_MEMORY_STAT_MASK_SHMEM                          = 1 << CGROUP_MEMORY_STAT_ID_SHMEM,
+        CGROUP_MEMORY_STAT_MASK_FILE_MAPPED                    = 1 << CGROUP_MEMORY_STAT_ID_FILE_MAPPED,
+        CGROUP_MEMORY_STAT_MASK_FILE_DIRTY                     = 1 << CGROUP_MEMORY_STAT_ID_FILE_DIRTY,
+        CGROUP_MEMORY_STAT_MASK_FILE_WRITEBACK                 = 1 << CGROUP_MEMORY_STAT_ID_FILE_WRITEBACK,
+        CGROUP_MEMORY_STAT_MASK_SWAPCACHED                     = 1 << CGROUP_MEMORY_STAT_ID_SWAPCACHED,
+        CGROUP_MEMORY_STAT_MASK_ANON_THP                       = 1 << CGROUP_MEMORY_STAT_ID_ANON_THP,
+        CGROUP_MEMORY_STAT_MASK_INACTIVE_ANON                  = 1 << CGROUP_MEMORY_STAT_ID_INACTIVE_ANON,
+        CGROUP_MEMORY_STAT_MASK_ACTIVE_ANON                    = 1 << CGROUP_MEMORY_STAT_ID_ACTIVE_ANON,
+        CGROUP_MEMORY_STAT_MASK_INACTIVE_FILE                  = 1 << CGROUP_MEMORY_STAT_ID_INACTIVE_FILE,
+        CGROUP_MEMORY_STAT_MASK_ACTIVE_FILE                    = 1 << CGROUP_MEMORY_STAT_ID_ACTIVE_FILE,
+        CGROUP_MEMORY_STAT_MASK_UNEVICTABLE                    = 1 << CGROUP_MEMORY_STAT_ID_UNEVICTABLE,
+        CGROUP_MEMORY_STAT_MASK_SLAB_RECLAIMABLE               = 1 << CGROUP_MEMORY_STAT_ID_SLAB_RECLAIMABLE,
+        CGROUP_MEMORY_STAT_MASK_SLAB_UNRECLAIMABLE             = 1 << CGROUP_MEMORY_STAT_ID_SLAB_UNRECLAIMABLE,
+        CGROUP_MEMORY_STAT_MASK_SLAB                           = 1 << CGROUP_MEMORY_STAT_ID_SLAB,
+        CGROUP_MEMORY_STAT_MASK_WORKINGSET_REFAULT_ANON        = 1 << CGROUP_MEMORY_STAT_ID_WORKINGSET_REFAULT_ANON,
+        CGROUP_MEMORY_STAT_MASK_WORKINGSET_REFAULT_FILE        = 1 << CGROUP_MEMORY_STAT_ID_WORKINGSET_REFAULT_FILE,
+        CGROUP_MEMORY_STAT_MASK_PGFAULT                        = 1 << CGROUP_MEMORY_STAT_ID_PGFAULT,
+        CGROUP_MEMORY_STAT_MASK_PGMAJFAULT                     = 1 << CGROUP_MEMORY_STAT_ID_PGMAJFAULT,
+        CGROUP_MEMORY_STAT_MASK_PGSCAN                         = 1 << CGROUP_MEMORY_STAT_ID_PGSCAN,
+        CGROUP_MEMORY_STAT_MASK_PGSTEAL                        = 1 << CGROUP_MEMORY_STAT_ID_PGSTEAL,
+        CGROUP_MEMORY_STAT_MASK_ALL                            = (1 << CGROUP_MEMORY_STAT_ID_MAX) - 1,
+};
+
+/**
+ * Values of memory.stat. Sizes are in bytes.
+ */
+struct cgroup_memory_stat {
+        uint64_t value[CGROUP_MEMORY_STAT_ID_MAX];
+};
+
+/**
+ * cgroup cpu.stat id
+ */
+enum cgroup_cpu_stat_id {
+        CGROUP_CPU_STAT_ID_INVALID = -1,
+        CGROUP_CPU_STAT_ID_USAGE_USEC = 0,
+        CGROUP_CPU_STAT_ID_USER_USEC,
+        CGROUP_CPU_STAT_ID_SYSTEM_USEC,
+        CGROUP_CPU_STAT_ID_NR_PERIODS,
+        CGROUP_CPU_STAT_ID_NR_THROTTLED,
+        CGROUP_CPU_STAT_ID_THROTTLED_USEC,
+        CGROUP_CPU_STAT_ID_NR_BURSTS,
+        CGROUP_CPU_STAT_ID_BURST_USEC,
+        CGROUP_CPU_STAT_ID_MAX,
+};
+
+/**
+ * cgroup cpu.stat mask
+ */
+enum cgroup_cpu_stat_mask {
+        CGROUP_CPU_STAT_MASK_USAGE_USEC            = 1 << CGROUP_CPU_STAT_ID_USAGE_USEC,
+        CGROUP_CPU_STAT_MASK_USER_USEC             = 1 << CGROUP_CPU_STAT_ID_USER_USEC,
+        CGROUP_CPU_STAT_MASK_SYSTEM_USEC           = 1 << CGROUP_CPU_STAT_ID_SYSTEM_USEC,
+        CGROUP_CPU_STAT_MASK_NR_PERIODS            = 1 << CGROUP_CPU_STAT_ID_NR_PERIODS,
+        CGROUP_CPU_STAT_MASK_NR_THROTTLED          = 1 << CGROUP_CPU_STAT_ID_NR_THROTTLED,
+        CGROUP_CPU_STAT_MASK_THROTTLED_USEC        = 1 << CGROUP_CPU_STAT_ID_THROTTLED_USEC,
+        CGROUP_CPU_STAT_MASK_NR_BURSTS             = 1 << CGROUP_CPU_STAT_ID_NR_BURSTS,
+        CGROUP_CPU_STAT_MASK_BURST_USEC            = 1 << CGROUP_CPU_STAT_ID_BURST_USEC,
+        CGROUP_CPU_STAT_MASK_ALL                   = (1 << CGROUP_CPU_STAT_ID_MAX) - 1,
+};
+
+/**
+ * Values of cpu.stat
+ */
+struct cgroup_cpu_stat {
+        uint64_t value[CGROUP_CPU_STAT_ID_MAX];
+};
+
+/**
+ * cgroup io.stat id
+ */
+enum cgroup_io_stat_id {
+        CGROUP_IO_STAT_ID_INVALID = -1,
+        CGROUP_IO_STAT_ID_RBYTES = 0,
+        CGROUP_IO_STAT_ID_WBYTES,
+        CGROUP_IO_STAT_ID_RIOS,
+        CGROUP_IO_STAT_ID_WIOS,
+        CGROUP_IO_STAT_ID_DBYTES,
+        CGROUP_IO_STAT_ID_DIOS,
+        CGROUP_IO_STAT_ID_MAX,
+};
+
+/**
+ * cgroup io.stat mask
+ */
+enum cgroup_io_stat_mask {
+        CGROUP_IO_STAT_MASK_RBYTES        = 1 << CGROUP_IO_STAT_ID_RBYTES,
+        CGROUP_IO_STAT_MASK_WBYTES        = 1 << CGROUP_IO_STAT_ID_WBYTES,
+        CGROUP_IO_STAT_MASK_RIOS          = 1 << CGROUP_IO_STAT_ID_RIOS,
+        CGROUP_IO_STAT_MASK_WIOS          = 1 << CGROUP_IO_STAT_ID_WIOS,
+        CGROUP_IO_STAT_MASK_DBYTES        = 1 << CGROUP_IO_STAT_ID_DBYTES,
+        CGROUP_IO_STAT_MASK_DIOS          = 1 << CGROUP_IO_STAT_ID_DIOS,
+        CGROUP_IO_STAT_MASK_ALL           = (1 << CGROUP_IO_STAT_ID_MAX) - 1,
+};
+
+/**
+ * Values of io.stat summed over all devices
+ */
+struct cgroup_io_stat {
+        uint64_t value[CGROUP_IO_STAT_ID_MAX];
+};
+
+/**
+ * PSI resources
+ */
+enum psi_resource {
+        PSI_RESOURCE_CPU = 0,
+        PSI_RESOURCE_MEMORY,
+        PSI_RESOURCE_IO,
+        PSI_RESOURCE_MAX,
+};
+
+/**
+ * A line of pressure stall information. Averages are in hundredths
+ * of percent, "avg10=1.23" is 123.
+ */
+struct psi_line {
+        unsigned int avg10;
+        unsigned int avg60;
+        unsigned int avg300;
+        /** total stall time in microsecond */
+        uint64_t total;
+};
+
+/**
+ * Pressure stall information of a resource. "full" of cpu is 0 on
+ * kernels which do not report it.
+ */
+struct psi_stats {
+        struct psi_line some;
+        struct psi_line full;
+};
+
+/**
+ * @brief Convert cgroup memory.stat id to string
+ *
+ * @param id cgroup memory.stat id
+ *
+ * @return converted string
+ */
+const char *cgroup_memory_stat_id_to_string(enum cgroup_memory_stat_id id);
+
+/**
+ * @brief Convert cgroup memory.stat string to id
+ *
+ * @param str cgroup memory.stat string
+ *
+ * @return converted id
+ */
+enum cgroup_memory_stat_id cgroup_memory_stat_string_to_id(const char *str);
+
+/**
+ * @brief Convert cgroup cpu.stat id to string
+ *
+ * @param id cgroup cpu.stat id
+ *
+ * @return converted string
+ */
+const char *cgroup_cpu_stat_id_to_string(enum cgroup_cpu_stat_id id);
+
+/**
+ * @brief Convert cgroup cpu.stat string to id
+ *
+ * @param str cgroup cpu.stat string
+ *
+ * @return converted id
+ */
+enum cgroup_cpu_stat_id cgroup_cpu_stat_string_to_id(const char *str);
+
+/**
+ * @brief Convert cgroup io.stat id to string
+ *
+ * @param id cgroup io.stat id
+ *
+ * @return converted string
+ */
+const char *cgroup_io_stat_id_to_string(enum cgroup_io_stat_id id);
+
+/**
+ * @brief Convert cgroup io.stat string to id
+ *
+ * @param str cgroup io.stat string
+ *
+ * @return converted id
+ */
+enum cgroup_io_stat_id cgroup_io_stat_string_to_id(const char *str);
+
+/**
+ * A cgroup v2 directory. It keeps the directory and each stat file
+ * opened after the first read, and re-reads them with pread(). A
+ * handle is not thread safe.
+ */
+struct cgroup_handle;
+
+/**
+ * @brief Open a cgroup v2 directory to read its stats.
+ * @code{.c}
+ {
+         _cleanup_cgroup_handle_free_ struct cgroup_handle *cg = NULL;
+         struct cgroup_memory_stat st;
+         uint64_t current;
+
+         cgroup_handle_open("/sys/fs/cgroup/system.slice", &cg);
+
+         for (;;) {
+                 cgroup_get_memory_current(cg, &current);
+                 cgroup_get_memory_stat(cg, &st, CGROUP_MEMORY_STAT_MASK_ANON | CGROUP_MEMORY_STAT_MASK_FILE);
+                 ...
+         }
+ }
+ * @endcode
+ *
+ * @param path path of cgroup directory
+ * @param cg Allocated handle. This value has to be destroyed by
+ * caller. #_cleanup_cgroup_handle_free_ is useful to make allocated
+ * handle to autofree.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int cgroup_handle_open(const char *path, struct cgroup_handle **cg);
+
+/**
+ * @brief Close cgroup handle
+ *
+ * @param cg a cgroup handle
+ */
+void cgroup_handle_free(struct cgroup_handle *cg);
+
+static inline void cgroup_handle_freep(struct cgroup_handle **cg)
+{
+        if (*cg)
+                cgroup_handle_free(*cg);
+}
+
+/**
+ * Declare struct cgroup_handle with cleanup attribute. Allocated
+ * struct cgroup_handle is destroyed on going out the scope.
+ */
+#define _cleanup_cgroup_handle_free_ _cleanup_ (cgroup_handle_freep)
+
+/**
+ * @brief Get memory.current of cgroup
+ *
+ * @param cg a cgroup handle
+ * @param current memory usage in bytes
+ *
+ * @return 0 on success, -errno on failure. -ENOENT if the memory
+ * controller is not enabled for the cgroup.
+ */
+int cgroup_get_memory_current(struct cgroup_handle *cg, uint64_t *current);
+
+/**
+ * @brief Get memory.stat of cgroup. Parsing stops as soon as all of
+ * masked keys are found.
+ *
+ * @param cg a cgroup handle
+ * @param st parsed values. Values out of mask are 0.
+ * @param mask mask of #cgroup_memory_stat_mask to get
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int cgroup_get_memory_stat(struct cgroup_handle *cg, struct cgroup_memory_stat *st, enum cgroup_memory_stat_mask mask);
+
+/**
+ * @brief Get cpu.stat of cgroup. Parsing stops as soon as all of
+ * masked keys are found.
+ *
+ * @param cg a cgroup handle
+ * @param st parsed values. Values out of mask are 0.
+ * @param mask mask of #cgroup_cpu_stat_mask to get
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int cgroup_get_cpu_stat(struct cgroup_handle *cg, struct cgroup_cpu_stat *st, enum cgroup_cpu_stat_mask mask);
+
+/**
+ * @brief Get io.stat of cgroup. Each line of io.stat is for a
+ * device, and values of all devices are summed.
+ *
+ * @param cg a cgroup handle
+ * @param st summed values. Values out of mask are 0.
+ * @param mask mask of #cgroup_io_stat_mask to get
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int cgroup_get_io_stat(struct cgroup_handle *cg, struct cgroup_io_stat *st, enum cgroup_io_stat_mask mask);
+
+/**
+ * @brief Get {cpu,memory,io}.pressure of cgroup
+ *
+ * @param cg a cgroup handle
+ * @param resource a resource
+ * @param st parsed pressure stall information
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int cgroup_get_pressure(struct cgroup_handle *cg, enum psi_resource resource, struct psi_stats *st);
+
+/**
+ * @brief Get system wide pressure stall information from
+ * /proc/pressure.
+ *
+ * @param resource a resource
+ * @param st parsed pressure stall information
+ *
+ * @return 0 on success, -errno on failure. -ENOENT or -EOPNOTSUPP
+ * if PSI is not enabled in the kernel.
+ */
+int proc_get_pressure(enum psi_resource resource, struct psi_stats *st);
+
+/**
+ * PSI trigger type
+ */
+enum psi_type {
+        /** some tasks are stalled */
+        PSI_TYPE_SOME = 0,
+        /** all non-idle tasks are stalled */
+        PSI_TYPE_FULL,
+};
+
+/**
+ * @brief Register a system wide PSI trigger. The kernel notifies
+ * when the stall time exceeds threshold_usec in any window_usec
+ * period, by POLLPRI on the returned fd. The fd can be waited on
+ * with poll(), epoll or #psi_trigger_wait(). The trigger is removed
+ * when the fd is closed.
+ * @code{.c}
+ {
+         _cleanup_close_ int fd = -1;
+
+         // 150ms of memory stall in 1s
+         fd = proc_psi_trigger_open(PSI_RESOURCE_MEMORY, PSI_TYPE_SOME, 150000, 1000000);
+
+         while (psi_trigger_wait(fd, -1) > 0)
+                 reclaim();
+ }
+ * @endcode
+ *
+ * @param resource a resource
+ * @param type stall type
+ * @param threshold_usec stall time threshold in microsecond
+ * @param window_usec window in microsecond. The kernel allows
+ * between 500ms and 10s, and unprivileged users can use only
+ * multiples of 2s.
+ *
+ * @return fd of the trigger on success, -errno on failure. The fd
+ * has to be closed by caller.
+ */
+int proc_psi_trigger_open(enum psi_resource resource, enum psi_type type,
+                          uint64_t threshold_usec, uint64_t window_usec);
+
+/**
+ * @brief Register a PSI trigger of a cgroup. Same with
+ * #proc_psi_trigger_open() but on {cpu,memory,io}.pressure of the
+ * cgroup. The fd gets POLLERR if the cgroup is removed.
+ *
+ * @param cg a cgroup handle
+ * @param resource a resource
+ * @param type stall type
+ * @param threshold_usec stall time threshold in microsecond
+ * @param window_usec window in microsecond
+ *
+ * @return fd of the trigger on success, -errno on failure. The fd
+ * has to be closed by caller.
+ */
+int cgroup_psi_trigger_open(struct cgroup_handle *cg, enum psi_resource resource, enum psi_type type,
+                            uint64_t threshold_usec, uint64_t window_usec);
+
+/**
+ * @brief Wait for a PSI trigger event.
+ *
+ * @param fd a PSI trigger fd
+ * @param timeout_msec timeout in millisecond, -1 to wait forever.
+ *
+ * @return 1 on event, 0 on timeout, -ENODEV if the monitored cgroup
+ * is removed, -errno on other failures.
+ */
+int psi_trigger_wait(int fd, int timeout_msec);
+
+/**
+ * /proc/buddyinfo page index
+ */
+enum {
+        PAGE_4K = 0,
+        PAGE_8K,
+        PAGE_16K,
+        PAGE_32K,
+        PAGE_64K,
+        PAGE_128K,
+        PAGE_256K,
+        PAGE_512K,
+        PAGE_1M,
+        PAGE_2M,
+        PAGE_4M,
+        PAGE_MAX,
+};
+
+/**
+ * A zone buddy info
+ */
+struct buddyinfo {
+        /**
+         * Zone name
+         */
+        char *zone;
+        /**
+         * Node number
+         */
+        int node;
+        /**
+         * Each pages size
+         */
+        int page[PAGE_MAX];
+};
+
+/**
+ * @brief free struct buddyinfo
+ *
+ * @param bi a buddyinfo
+ */
+void proc_buddyinfo_free(struct buddyinfo *bi);
+
+static inline void buddyinfo_freep(struct buddyinfo **bi)
+{
+        proc_buddyinfo_free(*bi);
+}
+
+/**
+ * Declare struct buddyinfo with cleanup attribute. Allocated struct
+ * buddyinfo is destroyed on going out the scope.
+ */
+#define _cleanup_buddyinfo_free_ _cleanup_(buddyinfo_freep)
+
+/**
+ * @brief Parse a zone in /proc/buddyinfo
+ *
+ * @param zone A zone to parse such like "Normal"
+ *
+ * @param bi Allocated and parsed buddyinfo for given zone. This value
+ * has to be destroyed by caller. #_cleanup_buddyinfo_free_ is useful
+ * to make autofree this value.
+ *
+ * @return 0 on success, -errno on failure.
+ */
 int proc_get_buddyinfo(const char *zone, struct buddyinfo **bi);
 
+/**
+ * A (node, zone) pair of /proc/buddyinfo
+ */
+struct buddyinfo_zone {
+        int node;
+        /** Zone name such like "Normal" */
+        char zone[16];
+        /** Number of orders in /proc/buddyinfo, up to #PAGE_MAX */
+        unsigned int n_order;
+        /** Number of free blocks of each order */
+        uint64_t page[PAGE_MAX];
+};
+
+/**
+ * @brief Parse all zones of all nodes in /proc/buddyinfo in a single
+ * pass. No memory is allocated for each line.
+ *
+ * @param zones Allocated array of zones in the order of
+ * /proc/buddyinfo. This value has to be free-ed by caller.
+ * @param n_zone number of zones
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int proc_get_buddyinfo_all(struct buddyinfo_zone **zones, size_t *n_zone);
+
+/**
+ * @brief Get external fragmentation index of a zone for an order, as
+ * same as /sys/kernel/debug/extfrag/extfrag_index. The index is in
+ * thousandths. Toward 0 the allocation would fail due to lack of
+ * memory, toward 1000 it would fail due to fragmentation, and -1000
+ * means a free block of the order exists.
+ *
+ * @param zone a zone
+ * @param order order of the allocation, less than #PAGE_MAX
+ * @param index fragmentation index is filled
+ *
+ * @return 0 on success, -EINVAL if order is out of range.
+ */
+int buddyinfo_fragmentation_index(const struct buddyinfo_zone *zone, unsigned int order, int *index);
+
 /**
  * @}
  */
@@ -0,0 +1,509 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+
+#include "libsystem.h"
+#include "sysattr.h"
+#include "decimal.h"
+
+#ifndef CGROUP2_SUPER_MAGIC
+#define CGROUP2_SUPER_MAGIC     0x63677270
+#endif
+
+#define SYSATTR_CACHE_SIZE      16
+#define SYSATTR_NUM_BUF_SIZE    64
+
+struct sysattr {
+        char *path;
+        int rfd;
+        int wfd;
+        /* -1 until the first open, then whether the file is on a
+         * kernel pseudo file system */
+        int pseudo;
+};
+
+int sysattr_open(const char *path, struct sysattr **ret) {
+        struct sysattr *a;
+
+        assert(path);
+        assert(ret);
+
+        a = new0(struct sysattr, 1);
+        if (!a)
+                return -ENOMEM;
+
+        a->path = strdup(path);
+        if (!a->path) {
+                free(a);
+                return -ENOMEM;
+        }
+
+        a->rfd = -1;
+        a->wfd = -1;
+        a->pseudo = -1;
+
+        *ret = a;
+
+        return 0;
+}
+
+void sysattr_free(struct sysattr *a) {
+        if (!a)
+                return;
+
+        if (a->rfd >= 0)
+                close(a->rfd);
+        if (a->wfd >= 0)
+                close(a->wfd);
+
+        free(a->path);
+        free(a);
+}
+
+const char *sysattr_path(const struct sysattr *a) {
+        assert(a);
+
+        return a->path;
+}
+
+static bool fd_is_pseudo(int fd) {
+        struct statfs sfs;
+
+        if (fstatfs(fd, &sfs) < 0)
+                return false;
+
+        switch (sfs.f_type) {
+        case SYSFS_MAGIC:
+        case PROC_SUPER_MAGIC:
+        case CGROUP_SUPER_MAGIC:
+        case CGROUP2_SUPER_MAGIC:
+        case DEBUGFS_MAGIC:
+                return true;
+        default:
+                return false;
+        }
+}
+
+static bool fd_is_unlinked(int fd) {
+        struct stat st;
+
+        return fstat(fd, &st) < 0 || st.st_nlink == 0;
+}
+
+/* The attribute is gone under the descriptor, e.g. the cgroup or the
+ * device is removed. The path may be valid again. */
+static bool sysattr_is_gone(int r) {
+        switch (r) {
+        case -ENODEV:
+        case -ENXIO:
+        case -ESTALE:
+                return true;
+        default:
+                return false;
+        }
+}
+
+static int sysattr_fd(struct sysattr *a, bool write, bool reopen) {
+        int *fd = write ? &a->wfd : &a->rfd;
+
+        if (*fd >= 0) {
+                /* Regular files may be replaced by rename(2), such
+                 * as FILE_WRITE_ATOMIC does. Pseudo files are not. */
+                if (!reopen && (a->pseudo || !fd_is_unlinked(*fd)))
+                        return *fd;
+
+                close(*fd);
+                *fd = -1;
+        }
+
+        *fd = open(a->path, (write ? O_WRONLY : O_RDONLY) | O_NOCTTY | O_CLOEXEC);
+        if (*fd < 0)
+                return -errno;
+
+        if (a->pseudo < 0)
+                a->pseudo = fd_is_pseudo(*fd);
+
+        return *fd;
+}
+
+static ssize_t sysattr_pread(struct sysattr *a, char *buf, size_t size) {
+        bool reopen = false;
+        ssize_t n;
+        int fd, r;
+
+        for (;;) {
+                fd = sysattr_fd(a, false, reopen);
+                if (fd < 0)
+                        return fd;
+
+                n = pread(fd, buf, size, 0);
+                if (n >= 0)
+                        return n;
+
+                r = -errno;
+                if (r == -EINTR)
+                        continue;
+
+                if (reopen || !sysattr_is_gone(r))
+                        return r;
+
+                reopen = true;
+        }
+}
+
+/* Attributes take a whole value in a single write(2), so buf is
+ * never split to several writes unless the kernel writes partially. */
+static int sysattr_pwrite(struct sysattr *a, const char *buf, size_t len) {
+        bool reopen = false;
+        size_t done = 0;
+        ssize_t n;
+        int fd, r;
+
+        for (;;) {
+                fd = sysattr_fd(a, true, reopen);
+                if (fd < 0)
+                        return fd;
+
+                n = pwrite(fd, buf + done, len - done, done);
+                if (n < 0) {
+                        r = -errno;
+                        if (r == -EINTR)
+                                continue;
+
+                        if (reopen || done > 0 || !sysattr_is_gone(r))
+                                return r;
+
+                        reopen = true;
+                        continue;
+                }
+
+                done += n;
+                if (done >= len)
+                        break;
+        }
+
+        if (!a->pseudo && ftruncate(fd, len) < 0)
+                return -errno;
+
+        return 0;
+}
+
+ssize_t sysattr_read(struct sysattr *a, char *buf, size_t size) {
+        ssize_t n;
+
+        assert(a);
+        assert(buf);
+
+        if (size < 2)
+                return -EINVAL;
+
+        n = sysattr_pread(a, buf, size - 1);
+        if (n < 0)
+                return n;
+
+        buf[n] = '\0';
+
+        return n;
+}
+
+static int sysattr_read_decimal(struct sysattr *a, struct decimal *d) {
+        char buf[SYSATTR_NUM_BUF_SIZE];
+        ssize_t n;
+        int r;
+
+        assert(a);
+
+        n = sysattr_pread(a, buf, sizeof(buf));
+        if (n < 0)
+                return n;
+
+        r = decimal_scan(buf, buf + n, d);
+        if (r == EOF)
+                return -ENODATA;
+        if (r == 0)
+                return -EINVAL;
+
+        return 0;
+}
+
+int sysattr_read_int64(struct sysattr *a, int64_t *i) {
+        struct decimal d;
+        int r;
+
+        assert(i);
+
+        r = sysattr_read_decimal(a, &d);
+        if (r < 0)
+                return r;
+
+        *i = decimal_to_int64(&d);
+
+        return 0;
+}
+
+int sysattr_read_uint64(struct sysattr *a, uint64_t *u) {
+        struct decimal d;
+        int r;
+
+        assert(u);
+
+        r = sysattr_read_decimal(a, &d);
+        if (r < 0)
+                return r;
+
+        *u = decimal_to_uint64(&d);
+
+        return 0;
+}
+
+int sysattr_write_str(struct sysattr *a, const char *str, enum file_write_flags flags) {
+        _cleanup_free_ char *t = NULL;
+        size_t l;
+
+        assert(a);
+        assert(str);
+
+        if (flags & ~FILE_WRITE_NEWLINE_IF_NOT)
+                return -EINVAL;
+
+        l = strlen(str);
+
+        if ((flags & FILE_WRITE_NEWLINE_IF_NOT) && (l == 0 || str[l - 1] != '\n')) {
+                t = new(char, l + 1);
+                if (!t)
+                        return -ENOMEM;
+
+                memcpy(t, str, l);
+                t[l++] = '\n';
+                str = t;
+        }
+
+        return sysattr_pwrite(a, str, l);
+}
+
+#define DEFINE_SYSATTR_WRITE_NUM(type, kind)                            \
+        int sysattr_write_##kind(struct sysattr *a, type##_t n, enum file_write_flags flags) { \
+                char buf[DECIMAL_STR_MAX(type##_t) + 1];                \
+                size_t l;                                               \
+                                                                        \
+                assert(a);                                              \
+                                                                        \
+                if (flags & ~FILE_WRITE_NEWLINE_IF_NOT)                 \
+                        return -EINVAL;                                 \
+                                                                        \
+                l = decimal_format_##kind(buf, n);                      \
+                if (flags & FILE_WRITE_NEWLINE_IF_NOT)                  \
+                        buf[l++] = '\n';                                \
+                                                                        \
+                return sysattr_pwrite(a, buf, l);                       \
+        }
+
+DEFINE_SYSATTR_WRITE_NUM(int64, int64);
+DEFINE_SYSATTR_WRITE_NUM(uint64, uint64);
+
+/*
+ * Per-thread cache of handles. The least recently used one is
+ * evicted when the cache is full. The thread local pointer is a fast
+ * path, and the key is only to close the handles at thread exit.
+ */
+struct sysattr_cache {
+        struct sysattr *attrs[SYSATTR_CACHE_SIZE];
+        unsigned int hash[SYSATTR_CACHE_SIZE];
+        unsigned long used[SYSATTR_CACHE_SIZE];
+        unsigned long clock;
+};
+
+static pthread_key_t sysattr_cache_key;
+static pthread_once_t sysattr_cache_once = PTHREAD_ONCE_INIT;
+static bool sysattr_cache_key_valid;
+static __thread struct sysattr_cache *sysattr_cache;
+
+static void sysattr_cache_clear(struct sysattr_cache *c) {
+        size_t i;
+
+        for (i = 0; i < SYSATTR_CACHE_SIZE && c->attrs[i]; i++) {
+                sysattr_free(c->attrs[i]);
+                c->attrs[i] = NULL;
+        }
+}
+
+static void sysattr_cache_destroy(void *p) {
+        struct sysattr_cache *c = p;
+
+        sysattr_cache_clear(c);
+        free(c);
+
+        sysattr_cache = NULL;
+}
+
+static void sysattr_cache_key_init(void) {
+        sysattr_cache_key_valid = pthread_key_create(&sysattr_cache_key, sysattr_cache_destroy) == 0;
+}
+
+static struct sysattr_cache *sysattr_cache_get(void) {
+        struct sysattr_cache *c;
+
+        if (sysattr_cache)
+                return sysattr_cache;
+
+        (void) pthread_once(&sysattr_cache_once, sysattr_cache_key_init);
+        if (!sysattr_cache_key_valid)
+                return NULL;
+
+        c = new0(struct sysattr_cache, 1);
+        if (!c)
+                return NULL;
+
+        if (pthread_setspecific(sysattr_cache_key, c) != 0) {
+                free(c);
+                return NULL;
+        }
+
+        sysattr_cache = c;
+
+        return c;
+}
+
+/* FNV-1a, to skip strcmp(3) of paths which share a long prefix */
+static unsigned int sysattr_hash(const char *path) {
+        unsigned int h = 2166136261U;
+
+        for (; *path; path++)
+                h = (h ^ (unsigned char) *path) * 16777619U;
+
+        return h;
+}
+
+static int sysattr_cache_lookup(const char *path, struct sysattr **ret) {
+        struct sysattr_cache *c;
+        struct sysattr *a;
+        unsigned int h;
+        size_t i, lru = 0;
+        int r;
+
+        assert(path);
+
+        c = sysattr_cache_get();
+        if (!c)
+                return -ENOMEM;
+
+        h = sysattr_hash(path);
+
+        /* Slots are filled in order and never emptied one by one */
+        for (i = 0; i < SYSATTR_CACHE_SIZE; i++) {
+                if (!c->attrs[i]) {
+                        lru = i;
+                        break;
+                }
+
+                if (c->hash[i] == h && streq(c->attrs[i]->path, path)) {
+                        c->used[i] = ++c->clock;
+                        *ret = c->attrs[i];
+                        return 0;
+                }
+
+                if (c->used[i] < c->used[lru])
+                        lru = i;
+        }
+
+        r = sysattr_open(path, &a);
+        if (r < 0)
+                return r;
+
+        sysattr_free(c->attrs[lru]);
+        c->attrs[lru] = a;
+        c->hash[lru] = h;
+        c->used[lru] = ++c->clock;
+
+        *ret = a;
+
+        return 0;
+}
+
+int sysattr_read_int64_from_path(const char *path, int64_t *i) {
+        struct sysattr *a;
+        int r;
+
+        r = sysattr_cache_lookup(path, &a);
+        if (r < 0)
+                return r;
+
+        return sysattr_read_int64(a, i);
+}
+
+int sysattr_read_uint64_from_path(const char *path, uint64_t *u) {
+        struct sysattr *a;
+        int r;
+
+        r = sysattr_cache_lookup(path, &a);
+        if (r < 0)
+                return r;
+
+        return sysattr_read_uint64(a, u);
+}
+
+int sysattr_write_str_to_path(const char *path, const char *str, enum file_write_flags flags) {
+        struct sysattr *a;
+        int r;
+
+        r = sysattr_cache_lookup(path, &a);
+        if (r < 0)
+                return r;
+
+        return sysattr_write_str(a, str, flags);
+}
+
+int sysattr_write_int64_to_path(const char *path, int64_t i, enum file_write_flags flags) {
+        struct sysattr *a;
+        int r;
+
+        r = sysattr_cache_lookup(path, &a);
+        if (r < 0)
+                return r;
+
+        return sysattr_write_int64(a, i, flags);
+}
+
+int sysattr_write_uint64_to_path(const char *path, uint64_t u, enum file_write_flags flags) {
+        struct sysattr *a;
+        int r;
+
+        r = sysattr_cache_lookup(path, &a);
+        if (r < 0)
+                return r;
+
+        return sysattr_write_uint64(a, u, flags);
+}
+
+void sysattr_cache_flush(void) {
+        if (sysattr_cache)
+                sysattr_cache_clear(sysattr_cache);
+}
@@ -0,0 +1,257 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file sysattr.h
+ *
+ * Cached handles of sysfs, procfs and cgroupfs attributes
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd. All rights reserved.
+ *
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "libsystem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup SYSATTR_GROUP sysattr group
+ *
+ * @brief Attribute files which are read or written again and again,
+ * such as cgroup knobs or sysfs tunables. A handle keeps the file
+ * descriptors open, and each access is a single pread(2) or
+ * pwrite(2) at offset 0 instead of open(2), read(2) and close(2).
+ *
+ * If the attribute is gone and comes back, for example a cgroup is
+ * removed and created again, the descriptor returns ENODEV. The
+ * handle reopens the path and retries once in that case.
+ *
+ * A handle is not thread safe. The path based functions use a small
+ * per-thread cache of handles, so they are safe in any thread.
+ *
+ * @{
+ */
+
+/**
+ * An attribute handle.
+ */
+struct sysattr;
+
+/**
+ * @brief Allocate a handle for path. The file is opened lazily at
+ * the first read or write, so this does not fail if the path does
+ * not exist yet.
+ * @code{.c}
+ {
+         _cleanup_sysattr_free_ struct sysattr *a = NULL;
+         uint64_t usage;
+
+         sysattr_open("/sys/fs/cgroup/memory/foo/memory.usage_in_bytes", &a);
+
+         for (;;) {
+                 sysattr_read_uint64(a, &usage);
+                 ...
+         }
+ }
+ * @endcode
+ *
+ * @param path Attribute path.
+ * @param ret Allocated handle. This value has to be destroyed by
+ * caller. #_cleanup_sysattr_free_ is useful to make allocated handle
+ * to autofree.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_open(const char *path, struct sysattr **ret);
+
+/**
+ * @brief Close and free a handle.
+ *
+ * @param a a handle
+ */
+void sysattr_free(struct sysattr *a);
+
+static inline void sysattr_freep(struct sysattr **a)
+{
+        if (*a)
+                sysattr_free(*a);
+}
+
+/**
+ * Declare struct sysattr with cleanup attribute. Allocated struct
+ * sysattr is destroyed on going out the scope.
+ */
+#define _cleanup_sysattr_free_ _cleanup_ (sysattr_freep)
+
+/**
+ * @brief Get the path of a handle.
+ *
+ * @param a a handle
+ *
+ * @return the path
+ */
+const char *sysattr_path(const struct sysattr *a);
+
+/**
+ * @brief Read the attribute from the beginning.
+ *
+ * @param a a handle
+ * @param buf Buffer to fill. It is always null terminated.
+ * @param size Size of buf, 2 at least.
+ *
+ * @return the length read on success, -errno on failure.
+ */
+ssize_t sysattr_read(struct sysattr *a, char *buf, size_t size);
+
+/**
+ * @brief Read 64 bit signed decimal integer.
+ *
+ * @param a a handle
+ * @param i 64 bit signed int value pointer.
+ *
+ * @return 0 on success, -ENODATA if the attribute is empty,
+ * -EINVAL if it is not a number, -errno on other failures.
+ */
+int sysattr_read_int64(struct sysattr *a, int64_t *i);
+
+/**
+ * @brief Read 64 bit unsigned decimal integer.
+ *
+ * @param a a handle
+ * @param u 64 bit unsigned int value pointer.
+ *
+ * @return 0 on success, -ENODATA if the attribute is empty,
+ * -EINVAL if it is not a number, -errno on other failures.
+ */
+int sysattr_read_uint64(struct sysattr *a, uint64_t *u);
+
+/**
+ * @brief Write strings at the beginning of the attribute. On a
+ * regular file, the file is truncated to the written length.
+ *
+ * @param a a handle
+ * @param str Strings to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -EINVAL for other flags, -errno on failure.
+ */
+int sysattr_write_str(struct sysattr *a, const char *str, enum file_write_flags flags);
+
+/**
+ * @brief Write 64 bit signed decimal integer.
+ *
+ * @param a a handle
+ * @param i 64 bit signed integer to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -EINVAL for other flags, -errno on failure.
+ */
+int sysattr_write_int64(struct sysattr *a, int64_t i, enum file_write_flags flags);
+
+/**
+ * @brief Write 64 bit unsigned decimal integer.
+ *
+ * @param a a handle
+ * @param u 64 bit unsigned integer to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -EINVAL for other flags, -errno on failure.
+ */
+int sysattr_write_uint64(struct sysattr *a, uint64_t u, enum file_write_flags flags);
+
+/**
+ * @brief Same as sysattr_read_int64() on a cached handle of
+ * path. The handle is opened at the first call in each thread and
+ * kept until it is evicted by the least recently used order or
+ * sysattr_cache_flush() is called.
+ *
+ * @param path Attribute path.
+ * @param i 64 bit signed int value pointer.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_read_int64_from_path(const char *path, int64_t *i);
+
+/**
+ * @brief Same as sysattr_read_uint64() on a cached handle of
+ * path. See sysattr_read_int64_from_path().
+ *
+ * @param path Attribute path.
+ * @param u 64 bit unsigned int value pointer.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_read_uint64_from_path(const char *path, uint64_t *u);
+
+/**
+ * @brief Same as sysattr_write_str() on a cached handle of
+ * path. See sysattr_read_int64_from_path().
+ *
+ * @param path Attribute path.
+ * @param str Strings to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_write_str_to_path(const char *path, const char *str, enum file_write_flags flags);
+
+/**
+ * @brief Same as sysattr_write_int64() on a cached handle of
+ * path. See sysattr_read_int64_from_path().
+ *
+ * @param path Attribute path.
+ * @param i 64 bit signed integer to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_write_int64_to_path(const char *path, int64_t i, enum file_write_flags flags);
+
+/**
+ * @brief Same as sysattr_write_uint64() on a cached handle of
+ * path. See sysattr_read_int64_from_path().
+ *
+ * @param path Attribute path.
+ * @param u 64 bit unsigned integer to write.
+ * @param flags Only ::FILE_WRITE_NEWLINE_IF_NOT is allowed.
+ *
+ * @return 0 on success, -errno on failure.
+ */
+int sysattr_write_uint64_to_path(const char *path, uint64_t u, enum file_write_flags flags);
+
+/**
+ * @brief Close all cached handles of the calling thread. Handles of
+ * a thread are also closed when the thread exits.
+ */
+void sysattr_cache_flush(void);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
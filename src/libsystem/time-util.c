@@ -86,6 +86,16 @@ void msec_to_timeval(uint64_t msec, struct timeval *tv) {
         tv->tv_usec = (msec % MSEC_PER_SEC) * USEC_PER_MSEC;
 }
 
+uint64_t now_usec(clockid_t clock) {
+        struct timespec ts;
+        int r;
+
+        r = clock_gettime(clock, &ts);
+        assert(r == 0);
+
+        return (uint64_t) ts.tv_sec * USEC_PER_SEC + (uint64_t) ts.tv_nsec / NSEC_PER_USEC;
+}
+
 int parse_time(const char *time_string, struct tm *time) {
 
         struct tm _time;
@@ -0,0 +1,413 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#include "libsystem.h"
+#include "uring.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+#include <linux/io_uring.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup     425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter     426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register  427
+#endif
+
+struct uring {
+        int fd;
+
+        void *sq_ring;
+        size_t sq_ring_size;
+        void *cq_ring;
+        size_t cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+
+        unsigned int *sq_head;
+        unsigned int *sq_tail;
+        unsigned int sq_mask;
+        unsigned int sq_entries;
+
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int cq_mask;
+        struct io_uring_cqe *cqes;
+
+        /* queued locally, not published to the kernel yet */
+        unsigned int sqe_tail;
+        unsigned int submitted;
+        unsigned int pending;
+};
+
+static const uint8_t uring_ops[] = {
+        IORING_OP_OPENAT,
+        IORING_OP_CLOSE,
+        IORING_OP_READ,
+        IORING_OP_WRITE,
+        IORING_OP_UNLINKAT,
+};
+
+static int uring_probe(int fd) {
+        _cleanup_free_ struct io_uring_probe *probe = NULL;
+        size_t i;
+
+        probe = calloc(1, sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op));
+        if (!probe)
+                return -ENOMEM;
+
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+                return errno == EINVAL ? -EOPNOTSUPP : -errno;
+
+        for (i = 0; i < ELEMENTSOF(uring_ops); i++) {
+                uint8_t op = uring_ops[i];
+
+                if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+                        return -EOPNOTSUPP;
+        }
+
+        return 0;
+}
+
+void uring_free(struct uring *u) {
+        if (!u)
+                return;
+
+        if (u->sqes && u->sqes != MAP_FAILED)
+                munmap(u->sqes, u->sqes_size);
+        if (u->cq_ring && u->cq_ring != MAP_FAILED && u->cq_ring != u->sq_ring)
+                munmap(u->cq_ring, u->cq_ring_size);
+        if (u->sq_ring && u->sq_ring != MAP_FAILED)
+                munmap(u->sq_ring, u->sq_ring_size);
+        if (u->fd >= 0)
+                close(u->fd);
+
+        free(u);
+}
+
+int uring_new(unsigned int entries, struct uring **ret) {
+        _cleanup_uring_free_ struct uring *u = NULL;
+        struct io_uring_params p = {};
+        unsigned int *sq_array, i;
+        int r;
+
+        assert(ret);
+
+        u = new0(struct uring, 1);
+        if (!u)
+                return -ENOMEM;
+
+        u->fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (u->fd < 0) {
+                /* disabled by sysctl or seccomp as well */
+                if (errno == ENOSYS || errno == EPERM)
+                        return -ENOSYS;
+                return -errno;
+        }
+
+        r = uring_probe(u->fd);
+        if (r < 0)
+                return r;
+
+        u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+        u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                if (u->cq_ring_size > u->sq_ring_size)
+                        u->sq_ring_size = u->cq_ring_size;
+                u->cq_ring_size = u->sq_ring_size;
+        }
+
+        u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+        if (u->sq_ring == MAP_FAILED)
+                return -errno;
+
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+                u->cq_ring = u->sq_ring;
+        else {
+                u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+                if (u->cq_ring == MAP_FAILED)
+                        return -errno;
+        }
+
+        u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+        if (u->sqes == MAP_FAILED)
+                return -errno;
+
+        u->sq_head = (unsigned int *) ((char *) u->sq_ring + p.sq_off.head);
+        u->sq_tail = (unsigned int *) ((char *) u->sq_ring + p.sq_off.tail);
+        u->sq_mask = *(unsigned int *) ((char *) u->sq_ring + p.sq_off.ring_mask);
+        u->sq_entries = p.sq_entries;
+
+        u->cq_head = (unsigned int *) ((char *) u->cq_ring + p.cq_off.head);
+        u->cq_tail = (unsigned int *) ((char *) u->cq_ring + p.cq_off.tail);
+        u->cq_mask = *(unsigned int *) ((char *) u->cq_ring + p.cq_off.ring_mask);
+        u->cqes = (struct io_uring_cqe *) ((char *) u->cq_ring + p.cq_off.cqes);
+
+        /* Entries are always used in ring order */
+        sq_array = (unsigned int *) ((char *) u->sq_ring + p.sq_off.array);
+        for (i = 0; i < p.sq_entries; i++)
+                sq_array[i] = i;
+
+        u->sqe_tail = u->submitted = *u->sq_tail;
+
+        *ret = u;
+        u = NULL;
+
+        return 0;
+}
+
+bool uring_available(void) {
+        /* 0: unknown, 1: available, -1: not */
+        static int cached = 0;
+        int c;
+
+        c = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+        if (c == 0) {
+                struct uring *u = NULL;
+
+                c = uring_new(1, &u) < 0 ? -1 : 1;
+                uring_free(u);
+                __atomic_store_n(&cached, c, __ATOMIC_RELAXED);
+        }
+
+        return c > 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring *u, uint8_t opcode, int fd, uint64_t data) {
+        struct io_uring_sqe *sqe;
+        unsigned int head;
+
+        /* The completion queue is twice of the submission, so
+         * limiting in-flight operations to this never overflows it */
+        if (u->pending >= u->sq_entries)
+                return NULL;
+
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sqe_tail - head >= u->sq_entries)
+                return NULL;
+
+        sqe = &u->sqes[u->sqe_tail & u->sq_mask];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = data;
+
+        u->sqe_tail++;
+        u->pending++;
+
+        return sqe;
+}
+
+int uring_prep_openat(struct uring *u, int dfd, const char *path, int flags, mode_t mode, uint64_t data) {
+        struct io_uring_sqe *sqe;
+
+        assert(u);
+        assert(path);
+
+        sqe = uring_get_sqe(u, IORING_OP_OPENAT, dfd, data);
+        if (!sqe)
+                return -EBUSY;
+
+        sqe->addr = (uintptr_t) path;
+        sqe->len = mode;
+        sqe->open_flags = flags;
+
+        return 0;
+}
+
+int uring_prep_close(struct uring *u, int fd, uint64_t data) {
+        assert(u);
+
+        if (!uring_get_sqe(u, IORING_OP_CLOSE, fd, data))
+                return -EBUSY;
+
+        return 0;
+}
+
+static int uring_prep_rw(struct uring *u, uint8_t opcode, int fd, const void *buf,
+                         unsigned int len, uint64_t offset, uint64_t data) {
+        struct io_uring_sqe *sqe;
+
+        assert(u);
+        assert(buf || len == 0);
+
+        sqe = uring_get_sqe(u, opcode, fd, data);
+        if (!sqe)
+                return -EBUSY;
+
+        sqe->addr = (uintptr_t) buf;
+        sqe->len = len;
+        sqe->off = offset;
+
+        return 0;
+}
+
+int uring_prep_read(struct uring *u, int fd, void *buf, unsigned int len, uint64_t offset, uint64_t data) {
+        return uring_prep_rw(u, IORING_OP_READ, fd, buf, len, offset, data);
+}
+
+int uring_prep_write(struct uring *u, int fd, const void *buf, unsigned int len, uint64_t offset, uint64_t data) {
+        return uring_prep_rw(u, IORING_OP_WRITE, fd, buf, len, offset, data);
+}
+
+int uring_prep_unlinkat(struct uring *u, int dfd, const char *path, int flags, uint64_t data) {
+        struct io_uring_sqe *sqe;
+
+        assert(u);
+        assert(path);
+
+        sqe = uring_get_sqe(u, IORING_OP_UNLINKAT, dfd, data);
+        if (!sqe)
+                return -EBUSY;
+
+        sqe->addr = (uintptr_t) path;
+        sqe->unlink_flags = flags;
+
+        return 0;
+}
+
+void uring_link(struct uring *u) {
+        assert(u);
+        assert(u->sqe_tail != u->submitted);
+
+        u->sqes[(u->sqe_tail - 1) & u->sq_mask].flags |= IOSQE_IO_LINK;
+}
+
+unsigned int uring_pending(struct uring *u) {
+        assert(u);
+
+        return u->pending;
+}
+
+static bool uring_reap(struct uring *u, uint64_t *data, int32_t *res) {
+        unsigned int head = *u->cq_head;
+        struct io_uring_cqe *cqe;
+
+        if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE))
+                return false;
+
+        cqe = &u->cqes[head & u->cq_mask];
+        *data = cqe->user_data;
+        *res = cqe->res;
+
+        __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+        u->pending--;
+
+        return true;
+}
+
+int uring_wait(struct uring *u, uint64_t *data, int32_t *res) {
+        assert(u);
+        assert(data);
+        assert(res);
+
+        if (u->pending == 0)
+                return -ENOENT;
+
+        for (;;) {
+                unsigned int n;
+                long r;
+
+                if (uring_reap(u, data, res))
+                        return 0;
+
+                n = u->sqe_tail - u->submitted;
+                if (n > 0)
+                        __atomic_store_n(u->sq_tail, u->sqe_tail, __ATOMIC_RELEASE);
+
+                r = syscall(__NR_io_uring_enter, u->fd, n, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (r < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return -errno;
+                }
+
+                u->submitted += r;
+        }
+}
+
+#else
+
+struct uring {
+        int fd;
+};
+
+int uring_new(unsigned int entries, struct uring **ret) {
+        return -ENOSYS;
+}
+
+void uring_free(struct uring *u) {
+        free(u);
+}
+
+bool uring_available(void) {
+        return false;
+}
+
+int uring_prep_openat(struct uring *u, int dfd, const char *path, int flags, mode_t mode, uint64_t data) {
+        return -ENOSYS;
+}
+
+int uring_prep_close(struct uring *u, int fd, uint64_t data) {
+        return -ENOSYS;
+}
+
+int uring_prep_read(struct uring *u, int fd, void *buf, unsigned int len, uint64_t offset, uint64_t data) {
+        return -ENOSYS;
+}
+
+int uring_prep_write(struct uring *u, int fd, const void *buf, unsigned int len, uint64_t offset, uint64_t data) {
+        return -ENOSYS;
+}
+
+int uring_prep_unlinkat(struct uring *u, int dfd, const char *path, int flags, uint64_t data) {
+        return -ENOSYS;
+}
+
+void uring_link(struct uring *u) {
+}
+
+unsigned int uring_pending(struct uring *u) {
+        return 0;
+}
+
+int uring_wait(struct uring *u, uint64_t *data, int32_t *res) {
+        return -ENOENT;
+}
+
+#endif
@@ -0,0 +1,87 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal minimal io_uring wrapper on raw syscalls. This header is
+ * not installed. Without <linux/io_uring.h> at build time, or if the
+ * kernel lacks io_uring or any of the operations below, uring_new()
+ * fails and the callers go on with the synchronous code.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "libsystem.h"
+
+struct uring;
+
+/*
+ * Set up a ring of at least entries submission entries. The openat,
+ * close, read, write and unlinkat operations are probed.
+ *
+ * Return 0 on success, -ENOSYS or -EOPNOTSUPP if io_uring can not be
+ * used, or -errno on the other failures.
+ */
+int uring_new(unsigned int entries, struct uring **ret);
+void uring_free(struct uring *u);
+static inline void uring_freep(struct uring **u) {
+        if (*u)
+                uring_free(*u);
+}
+#define _cleanup_uring_free_ _cleanup_(uring_freep)
+
+/* Return true if uring_new() can succeed. The result is cached. */
+bool uring_available(void);
+
+/*
+ * Queue an operation. Nothing is submitted until uring_wait(). The
+ * buffers and paths have to be kept until its completion is reaped.
+ * data is returned with the completion.
+ *
+ * Return 0 on success, -EBUSY if the submission queue is full.
+ */
+int uring_prep_openat(struct uring *u, int dfd, const char *path, int flags, mode_t mode, uint64_t data);
+int uring_prep_close(struct uring *u, int fd, uint64_t data);
+int uring_prep_read(struct uring *u, int fd, void *buf, unsigned int len, uint64_t offset, uint64_t data);
+int uring_prep_write(struct uring *u, int fd, const void *buf, unsigned int len, uint64_t offset, uint64_t data);
+int uring_prep_unlinkat(struct uring *u, int dfd, const char *path, int flags, uint64_t data);
+
+/*
+ * Link the last queued operation to the next one. The next one is
+ * started only if the last one succeeds, and is completed with
+ * -ECANCELED otherwise.
+ */
+void uring_link(struct uring *u);
+
+/* Number of queued or submitted operations not reaped yet */
+unsigned int uring_pending(struct uring *u);
+
+/*
+ * Submit the queued operations and reap one completion, waiting for
+ * it if none is ready. res is the result of the operation, which is
+ * -errno on failure.
+ *
+ * Return 0 on success, -ENOENT if no operation is pending or -errno
+ * if io_uring_enter(2) failed.
+ */
+int uring_wait(struct uring *u, uint64_t *data, int32_t *res);
@@ -0,0 +1,130 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libsystem.h"
+#include "work-pool.h"
+
+struct work_pool {
+        size_t n_items;
+        size_t buf_size;
+        work_func_t func;
+        void *userdata;
+
+        /* accessed atomically */
+        size_t next;
+        int error;
+};
+
+static void work_pool_set_error(struct work_pool *pool, int error) {
+        int zero = 0;
+
+        /* keep the first one */
+        __atomic_compare_exchange_n(&pool->error, &zero, error, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+static int work_pool_worker(struct work_pool *pool) {
+        _cleanup_free_ void *buf = NULL;
+
+        if (pool->buf_size > 0) {
+                buf = malloc(pool->buf_size);
+                if (!buf)
+                        return -ENOMEM;
+        }
+
+        while (!__atomic_load_n(&pool->error, __ATOMIC_RELAXED)) {
+                size_t i;
+                int r;
+
+                i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+                if (i >= pool->n_items)
+                        break;
+
+                r = pool->func(i, buf, pool->userdata);
+                if (r < 0) {
+                        work_pool_set_error(pool, r);
+                        break;
+                }
+        }
+
+        return 0;
+}
+
+static void *work_pool_thread(void *data) {
+        /* Failed to allocate the buffer, the other threads take the
+         * items instead. */
+        (void) work_pool_worker(data);
+
+        return NULL;
+}
+
+int work_pool_run(size_t n_items, unsigned int n_threads, size_t buf_size,
+                  work_func_t func, void *userdata) {
+        _cleanup_free_ pthread_t *threads = NULL;
+        struct work_pool pool = {
+                .n_items = n_items,
+                .buf_size = buf_size,
+                .func = func,
+                .userdata = userdata,
+        };
+        unsigned int i, n = 0;
+        int r;
+
+        assert(func);
+
+        if (n_items == 0)
+                return 0;
+
+        if (n_threads == 0) {
+                long c = sysconf(_SC_NPROCESSORS_ONLN);
+
+                n_threads = c > 0 ? (unsigned int) c : 1;
+        }
+
+        if (n_threads > n_items)
+                n_threads = n_items;
+
+        if (n_threads > 1) {
+                threads = new(pthread_t, n_threads - 1);
+                if (!threads)
+                        return -ENOMEM;
+
+                /* Go on with less threads if creation fails */
+                for (i = 0; i < n_threads - 1; i++, n++)
+                        if (pthread_create(&threads[i], NULL, work_pool_thread, &pool) != 0)
+                                break;
+        }
+
+        r = work_pool_worker(&pool);
+        if (r < 0)
+                work_pool_set_error(&pool, r);
+
+        for (i = 0; i < n; i++)
+                pthread_join(threads[i], NULL);
+
+        return pool.error;
+}
@@ -0,0 +1,48 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Internal pthread pool to run a function over a range of items. This
+ * header is not installed.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+/*
+ * Called once for each item with a per thread buffer of buf_size
+ * bytes, which is reused for all items run on the thread. A negative
+ * return stops the pool, remaining items are not run.
+ */
+typedef int (*work_func_t)(size_t index, void *buf, void *userdata);
+
+/*
+ * Run func for items [0, n_items) on n_threads threads. The calling
+ * thread is one of them. n_threads 0 means the number of online CPUs.
+ *
+ * Items are taken one at a time from a shared counter, so a thread
+ * stuck on a large item does not hold the others behind it.
+ *
+ * Return 0 on success, the first negative return of func or -errno
+ * on failure.
+ */
+int work_pool_run(size_t n_items, unsigned int n_threads, size_t buf_size,
+                  work_func_t func, void *userdata);
@@ -0,0 +1,531 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timing of the file helpers, kept out of the tests since the numbers
+ * depend on the file system and the machine.
+ *
+ *  - do_copy_force() of a large file against a read/write loop
+ *  - do_copy_tree() against cp -a
+ *  - rmdir_recursive() against the recursion over opendir(3)
+ *  - read_int32_from_path() and write_int32_to_path() against stdio
+ *  - sysattr_read_uint64_from_path() against read_uint64_from_path()
+ *  - write_attrs_batch() against write_str_to_path() on cgroup2 knobs
+ *  - the synchronous and io_uring ways of do_copy_many() and
+ *    rmdir_recursive_full() in files per second. N_FILES and
+ *    FILE_SIZE are for this one.
+ *
+ * usage: bench-file-io [DIR] [N_FILES] [FILE_SIZE]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/sysattr.h"
+#include "libsystem/uring.h"
+#include "test.h"
+
+static double files_per_sec(size_t n, uint64_t usec) {
+        return usec ? (double) n * USEC_PER_SEC / usec : 0.0;
+}
+
+/* The implementation before copy_file_range() */
+static int legacy_copy(const char *src, const char *dst) {
+        _cleanup_close_ int rfd = -1, wfd = -1;
+        char buf[1024];
+        ssize_t red;
+
+        wfd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        if (wfd < 0)
+                return -errno;
+
+        rfd = open(src, O_RDONLY);
+        if (rfd < 0)
+                return -errno;
+
+        while ((red = read(rfd, buf, 1024)) > 0)
+                if (write(wfd, buf, red) != red)
+                        return -errno;
+
+        if (red < 0)
+                return -errno;
+
+        return 0;
+}
+
+#define BENCH_COPY_SIZE (64 << 20)
+#define BENCH_COPY_LOOP 4
+
+static void bench_copy(const char *dir) {
+        _cleanup_free_ char *src = NULL, *dst = NULL, *data = NULL;
+        uint64_t t, legacy, copy;
+        size_t i;
+        int r;
+
+        if (asprintf(&src, "%s/bench-file-io-copy-src", dir) < 0 ||
+            asprintf(&dst, "%s/bench-file-io-copy-dst", dir) < 0)
+                return;
+
+        /* not sparse */
+        data = new(char, BENCH_COPY_SIZE + 1);
+        assert(data);
+        for (i = 0; i < BENCH_COPY_SIZE; i++)
+                data[i] = 'a' + i % 26;
+        data[BENCH_COPY_SIZE] = 0;
+
+        r = write_str_to_path(src, data, 0);
+        if (r < 0) {
+                fprintf(stderr, "Failed to write %s: %s\n", src, strerror(-r));
+                return;
+        }
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_COPY_LOOP; i++)
+                assert(legacy_copy(src, dst) == 0);
+        legacy = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_COPY_LOOP; i++)
+                assert(do_copy_force(src, dst) == 0);
+        copy = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("copy of %d MiB file (%d loops)\n", BENCH_COPY_SIZE >> 20, BENCH_COPY_LOOP);
+        printf("  read/write 1k   : %8" PRIu64 " us/loop\n", legacy / BENCH_COPY_LOOP);
+        printf("  do_copy         : %8" PRIu64 " us/loop\n", copy / BENCH_COPY_LOOP);
+        printf("  speedup         : %8.2fx\n", copy ? (double) legacy / copy : 0.0);
+
+        (void) unlink(src);
+        (void) unlink(dst);
+}
+
+#define BENCH_TREE_FILES        2000
+
+static void bench_copy_tree(const char *dir) {
+        _cleanup_free_ char *src = NULL, *dst = NULL;
+        char *cp_argv[] = { "/bin/cp", "-a", NULL, NULL, NULL };
+        char path[PATH_MAX];
+        uint64_t t, cp = 0, tree;
+        int i, r;
+
+        if (asprintf(&src, "%s/bench-file-io-tree-src", dir) < 0 ||
+            asprintf(&dst, "%s/bench-file-io-tree-dst", dir) < 0)
+                return;
+
+        (void) rmdir_recursive(src);
+        (void) rmdir_recursive(dst);
+
+        for (i = 0; i < BENCH_TREE_FILES; i++) {
+                snprintf(path, sizeof(path), "%s/d%d", src, i / 100);
+                assert(do_mkdir(path, 0755) == 0);
+                snprintf(path, sizeof(path), "%s/d%d/f%d", src, i / 100, i);
+                assert(write_str_to_path(path, path, 0) == 0);
+        }
+
+        cp_argv[2] = src;
+        cp_argv[3] = dst;
+        if (access(cp_argv[0], X_OK) == 0) {
+                t = now_usec(CLOCK_MONOTONIC);
+                assert(do_fork_exec(cp_argv, NULL, 0) == 0);
+                cp = now_usec(CLOCK_MONOTONIC) - t;
+                assert(rmdir_recursive(dst) == 0);
+        }
+
+        t = now_usec(CLOCK_MONOTONIC);
+        r = do_copy_tree(src, dst, 0);
+        tree = now_usec(CLOCK_MONOTONIC) - t;
+        if (r < 0)
+                fprintf(stderr, "copy failed: %s\n", strerror(-r));
+
+        printf("copy of tree with %d files\n", BENCH_TREE_FILES);
+        printf("  cp -a           : %8" PRIu64 " us\n", cp);
+        printf("  do_copy_tree    : %8" PRIu64 " us\n", tree);
+
+        (void) rmdir_recursive(src);
+        (void) rmdir_recursive(dst);
+}
+
+/* The implementation before unlinkat() */
+static int legacy_rmdir_recursive(const char *path) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int r;
+
+        d = opendir(path);
+        if (!d)
+                return -errno;
+
+        FOREACH_DIRENT(de, d, return -errno) {
+                _cleanup_free_ char *p = NULL;
+
+                r = asprintf(&p, "%s/%s", path, de->d_name);
+                if (r < 0)
+                        return -ENOMEM;
+
+                if (de->d_type == DT_DIR) {
+                        r = legacy_rmdir_recursive(p);
+                        if (r < 0)
+                                return r;
+                } else {
+                        r = unlink(p);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        return rmdir(path);
+}
+
+#define BENCH_RMDIR_FILES       20000
+
+static void make_rmdir_tree(const char *top) {
+        char path[PATH_MAX];
+        int i;
+
+        for (i = 0; i < BENCH_RMDIR_FILES; i++) {
+                if (i % 100 == 0) {
+                        snprintf(path, sizeof(path), "%s/%02d/%03d", top, i / 2000, i / 100);
+                        assert(do_mkdir(path, 0755) == 0);
+                }
+
+                snprintf(path, sizeof(path), "%s/%02d/%03d/cache-%d", top, i / 2000, i / 100, i);
+                assert(mknod(path, S_IFREG | 0644, 0) == 0);
+        }
+}
+
+/* Many subdirectories in one directory, each entered and left */
+#define BENCH_RMDIR_WIDE        8000
+
+static void make_rmdir_wide(const char *top) {
+        char path[PATH_MAX];
+        int i;
+
+        assert(do_mkdir(top, 0755) == 0);
+
+        for (i = 0; i < BENCH_RMDIR_WIDE; i++) {
+                snprintf(path, sizeof(path), "%s/dir-%d", top, i);
+                assert(mkdir(path, 0755) == 0);
+        }
+}
+
+static void bench_rmdir_one(const char *top, void (*make)(const char *top), int n, const char *what) {
+        uint64_t t, legacy, rm;
+
+        (void) rmdir_recursive(top);
+
+        make(top);
+        t = now_usec(CLOCK_MONOTONIC);
+        assert(legacy_rmdir_recursive(top) == 0);
+        legacy = now_usec(CLOCK_MONOTONIC) - t;
+
+        make(top);
+        t = now_usec(CLOCK_MONOTONIC);
+        assert(rmdir_recursive(top) == 0);
+        rm = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("remove of %d %s\n", n, what);
+        printf("  opendir + unlink: %8" PRIu64 " us\n", legacy);
+        printf("  unlinkat        : %8" PRIu64 " us\n", rm);
+        printf("  speedup         : %8.2fx\n", rm ? (double) legacy / rm : 0.0);
+}
+
+static void bench_rmdir(const char *dir) {
+        _cleanup_free_ char *top = NULL;
+
+        if (asprintf(&top, "%s/bench-file-io-rmdir", dir) < 0)
+                return;
+
+        bench_rmdir_one(top, make_rmdir_tree, BENCH_RMDIR_FILES, "files in a tree");
+        bench_rmdir_one(top, make_rmdir_wide, BENCH_RMDIR_WIDE, "subdirectories of one directory");
+}
+
+#define BENCH_NUM_LOOP  20000
+
+static void bench_num(const char *dir) {
+        _cleanup_free_ char *file = NULL;
+        const char *path = "/proc/sys/kernel/pid_max";
+        uint64_t t, stdio_r, raw_r, stdio_w, raw_w;
+        int32_t v;
+        int i;
+
+        if (asprintf(&file, "%s/bench-file-io-num", dir) < 0)
+                return;
+
+        assert(write_int32_to_path(file, 1, 0) == 0);
+        if (access(path, R_OK) < 0)
+                path = file;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_NUM_LOOP; i++) {
+                _cleanup_fclose_ FILE *f = fopen(path, "re");
+
+                assert(f);
+                assert(read_int32_from_file(f, &v) == 1);
+        }
+        stdio_r = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_NUM_LOOP; i++)
+                assert(read_int32_from_path(path, &v) == 1);
+        raw_r = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_NUM_LOOP; i++) {
+                _cleanup_fclose_ FILE *f = fopen(file, "we");
+
+                assert(f);
+                assert(write_int32_to_file(f, i, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        }
+        stdio_w = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_NUM_LOOP; i++)
+                assert(write_int32_to_path(file, i, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        raw_w = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("read %s, write %s (%d loops)\n", path, file, BENCH_NUM_LOOP);
+        printf("  fopen + fscanf  : %8" PRIu64 " ns/loop\n", stdio_r * 1000 / BENCH_NUM_LOOP);
+        printf("  read            : %8" PRIu64 " ns/loop\n", raw_r * 1000 / BENCH_NUM_LOOP);
+        printf("  fopen + fprintf : %8" PRIu64 " ns/loop\n", stdio_w * 1000 / BENCH_NUM_LOOP);
+        printf("  write           : %8" PRIu64 " ns/loop\n", raw_w * 1000 / BENCH_NUM_LOOP);
+
+        (void) unlink(file);
+}
+
+#define BENCH_SYSATTR_LOOP      100000
+
+static void bench_sysattr(const char *path) {
+        uint64_t t, plain, cached, u;
+        int n;
+
+        if (access(path, R_OK) < 0)
+                return;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (n = 0; n < BENCH_SYSATTR_LOOP; n++)
+                assert(read_uint64_from_path(path, &u) >= 0);
+        plain = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (n = 0; n < BENCH_SYSATTR_LOOP; n++)
+                assert(sysattr_read_uint64_from_path(path, &u) == 0);
+        cached = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("read of %s %d times\n", path, BENCH_SYSATTR_LOOP);
+        printf("  open + read + close: %8" PRIu64 " us\n", plain);
+        printf("  cached pread       : %8" PRIu64 " us\n", cached);
+        printf("  speedup            : %8.2fx\n", cached ? (double) plain / cached : 0.0);
+}
+
+#define BENCH_ATTR_DIRS         50
+#define BENCH_ATTR_LOOP         100
+
+static void bench_attrs_batch(void) {
+        static const char * const knobs[] = { "cgroup.max.depth", "cgroup.max.descendants" };
+        struct file_write_entry entries[BENCH_ATTR_DIRS * ELEMENTSOF(knobs) * 2];
+        char paths[ELEMENTSOF(entries)][PATH_MAX];
+        _cleanup_free_ char *mnt = NULL, *top = NULL;
+        uint64_t t, plain, batch, parallel;
+        size_t i;
+        int n;
+
+        mnt = cgroup2_mount_dir();
+        if (!mnt) {
+                printf("cgroup2 is not mounted, skip %s\n", __func__);
+                return;
+        }
+
+        if (asprintf(&top, "%s/bench-file-io", mnt) < 0)
+                return;
+
+        /* leftovers of an aborted run */
+        for (i = 0; i < BENCH_ATTR_DIRS; i++) {
+                snprintf(paths[0], sizeof(paths[0]), "%s/service-%zu.service", top, i);
+                (void) rmdir(paths[0]);
+        }
+        (void) rmdir(top);
+
+        if (mkdir(top, 0755) < 0) {
+                printf("%s is not writable, skip %s\n", mnt, __func__);
+                return;
+        }
+
+        /* as a profile of cgroup knobs, each is written twice */
+        for (i = 0; i < ELEMENTSOF(entries); i++) {
+                size_t d = i / (ELEMENTSOF(knobs) * 2);
+
+                snprintf(paths[i], sizeof(paths[i]), "%s/service-%zu.service/%s",
+                         top, d, knobs[i % ELEMENTSOF(knobs)]);
+                if (i % (ELEMENTSOF(knobs) * 2) == 0) {
+                        char *p = strrchr(paths[i], '/');
+
+                        *p = '\0';
+                        assert(mkdir(paths[i], 0755) == 0);
+                        *p = '/';
+                }
+
+                entries[i].path = paths[i];
+                entries[i].str = "max";
+        }
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (n = 0; n < BENCH_ATTR_LOOP; n++)
+                for (i = 0; i < ELEMENTSOF(entries); i++)
+                        assert(write_str_to_path(entries[i].path, entries[i].str, 0) == 0);
+        plain = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (n = 0; n < BENCH_ATTR_LOOP; n++)
+                assert(write_attrs_batch(entries, ELEMENTSOF(entries), 0, NULL) == 0);
+        batch = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (n = 0; n < BENCH_ATTR_LOOP; n++)
+                assert(write_attrs_batch(entries, ELEMENTSOF(entries), FILE_WRITE_PARALLEL, NULL) == 0);
+        parallel = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("write of %zu cgroup attributes in %d directories of %s, %d times\n",
+               ELEMENTSOF(entries), BENCH_ATTR_DIRS, mnt, BENCH_ATTR_LOOP);
+        printf("  write_str_to_path     : %8" PRIu64 " us\n", plain);
+        printf("  write_attrs_batch     : %8" PRIu64 " us\n", batch);
+        printf("  write_attrs_batch (mt): %8" PRIu64 " us\n", parallel);
+
+        for (i = 0; i < BENCH_ATTR_DIRS; i++) {
+                snprintf(paths[0], sizeof(paths[0]), "%s/service-%zu.service", top, i);
+                assert(rmdir(paths[0]) == 0);
+        }
+        assert(rmdir(top) == 0);
+}
+
+static int make_files(const char *dir, size_t n, size_t size, struct copy_pair *pairs, const char *dst) {
+        _cleanup_free_ char *data = NULL;
+        size_t i;
+        int r;
+
+        data = new0(char, size + 1);
+        if (!data)
+                return -ENOMEM;
+        memset(data, 'x', size);
+
+        r = mkdir(dir, 0755);
+        if (r < 0)
+                return -errno;
+
+        for (i = 0; i < n; i++) {
+                char *src;
+
+                if (asprintf(&src, "%s/f%zu", dir, i) < 0)
+                        return -ENOMEM;
+
+                r = write_str_to_path(src, data, 0);
+                if (r < 0)
+                        return r;
+
+                pairs[i].src = src;
+                if (asprintf((char **) &pairs[i].dst, "%s/f%zu", dst, i) < 0)
+                        return -ENOMEM;
+        }
+
+        return 0;
+}
+
+static void bench(const char *mode, const char *src, const char *dst, struct copy_pair *pairs,
+                  size_t n, enum copy_flags cflags, enum rmdir_flags rflags) {
+        uint64_t t, copy, rm;
+        int r;
+
+        r = mkdir(dst, 0755);
+        assert(r == 0);
+
+        t = now_usec(CLOCK_MONOTONIC);
+        r = do_copy_many(pairs, n, 0644, cflags, NULL);
+        copy = now_usec(CLOCK_MONOTONIC) - t;
+        if (r < 0)
+                fprintf(stderr, "copy failed: %s\n", strerror(-r));
+
+        t = now_usec(CLOCK_MONOTONIC);
+        r = rmdir_recursive_full(dst, rflags);
+        rm = now_usec(CLOCK_MONOTONIC) - t;
+        if (r < 0)
+                fprintf(stderr, "remove failed: %s\n", strerror(-r));
+
+        printf("  %-10s copy %10.0f files/s, remove %10.0f files/s\n",
+               mode, files_per_sec(n, copy), files_per_sec(n, rm));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_free_ char *src = NULL, *dst = NULL;
+        _cleanup_free_ struct copy_pair *pairs = NULL;
+        const char *dir = argc > 1 ? argv[1] : "/tmp";
+        size_t n = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000;
+        size_t size = argc > 3 ? strtoul(argv[3], NULL, 10) : 4096;
+        size_t i;
+        int r;
+
+        if (asprintf(&src, "%s/bench-file-io-src", dir) < 0 ||
+            asprintf(&dst, "%s/bench-file-io-dst", dir) < 0)
+                return EXIT_FAILURE;
+
+        bench_copy(dir);
+        bench_copy_tree(dir);
+        bench_rmdir(dir);
+        bench_num(dir);
+        bench_sysattr("/proc/sys/kernel/pid_max");
+        bench_attrs_batch();
+
+        pairs = new0(struct copy_pair, n);
+        if (!pairs)
+                return EXIT_FAILURE;
+
+        (void) rmdir_recursive(src);
+        (void) rmdir_recursive(dst);
+
+        r = make_files(src, n, size, pairs, dst);
+        if (r < 0) {
+                fprintf(stderr, "Failed to make files: %s\n", strerror(-r));
+                return EXIT_FAILURE;
+        }
+
+        printf("%zu files of %zu bytes in %s\n", n, size, dir);
+        bench("sync", src, dst, pairs, n, 0, 0);
+        if (uring_available())
+                bench("io_uring", src, dst, pairs, n, COPY_URING, RMDIR_URING);
+        else
+                printf("  io_uring   not available\n");
+
+        for (i = 0; i < n; i++) {
+                free((char *) pairs[i].src);
+                free((char *) pairs[i].dst);
+        }
+
+        (void) rmdir_recursive(src);
+
+        return EXIT_SUCCESS;
+}
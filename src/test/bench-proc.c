@@ -0,0 +1,191 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Timing of the /proc parsers, kept out of the tests since the
+ * numbers depend on the kernel and the machine.
+ *
+ *  - proc_pid_foreach_smap() against fgets(3) and sscanf(3)
+ *  - proc_snapshot_take() of all the processes
+ *  - cgroup_get_cpu_stat() on an opened cgroup2 handle
+ *
+ * usage: bench-proc [PID]...
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+/* The parser before the shared scanner: fgets(), strcspn(), gperf
+ * lookup and sscanf() for each line. */
+static int legacy_sum_smaps(pid_t pid, unsigned long long sum[SMAPS_ID_MAX]) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char path[64], buf[LINE_MAX];
+
+        snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+
+        f = fopen(path, "re");
+        if (!f)
+                return -errno;
+
+        while (fgets(buf, sizeof(buf), f)) {
+                unsigned int v = 0;
+                enum smap_id id;
+                size_t l;
+
+                if ((*buf >= '0' && *buf <= '9') || (*buf >= 'a' && *buf <= 'f'))
+                        continue;
+
+                l = strcspn(buf, ":");
+                if (!l || !buf[l])
+                        continue;
+
+                buf[l] = 0;
+
+                id = smap_string_to_id(buf);
+                if (id < 0 || id >= SMAPS_ID_MAX)
+                        continue;
+
+                if (sscanf(buf + l + 1, "%d kB", &v) != 1)
+                        continue;
+
+                sum[id] += v;
+        }
+
+        return 0;
+}
+
+static int count_smap(const struct smap_view *map, void *data) {
+        int *n_map = data;
+
+        (*n_map)++;
+
+        return 0;
+}
+
+#define BENCH_SMAPS_LOOP        200
+
+static void bench_smaps(pid_t pid) {
+        unsigned long long sum[SMAPS_ID_MAX];
+        uint64_t t, legacy, scan;
+        int i, r, n_map = 0;
+
+        memset(sum, 0, sizeof(sum));
+        r = legacy_sum_smaps(pid, sum);
+        if (r < 0) {
+                fprintf(stderr, "cannot read smaps of pid %d: %s\n", pid, strerror(-r));
+                return;
+        }
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_SMAPS_LOOP; i++) {
+                memset(sum, 0, sizeof(sum));
+                assert(legacy_sum_smaps(pid, sum) == 0);
+        }
+        legacy = now_usec(CLOCK_MONOTONIC) - t;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_SMAPS_LOOP; i++) {
+                n_map = 0;
+                assert(proc_pid_foreach_smap(pid, SMAPS_MASK_ALL, count_smap, &n_map) == 0);
+        }
+        scan = now_usec(CLOCK_MONOTONIC) - t;
+
+        /* the kernel side cost is included */
+        printf("smaps parse of pid %d (%d maps, %d loops)\n", pid, n_map, BENCH_SMAPS_LOOP);
+        printf("  fgets + sscanf  : %8" PRIu64 " ns/loop\n", legacy * 1000 / BENCH_SMAPS_LOOP);
+        printf("  scanner         : %8" PRIu64 " ns/loop\n", scan * 1000 / BENCH_SMAPS_LOOP);
+        printf("  speedup         : %8.2fx\n", scan ? (double) legacy / scan : 0.0);
+}
+
+#define BENCH_SNAPSHOT_LOOP     20
+
+static void bench_snapshot(void) {
+        uint64_t t, elapsed;
+        size_t n = 0;
+        int i;
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_SNAPSHOT_LOOP; i++) {
+                _cleanup_proc_snapshot_free_ struct proc_snapshot *s = NULL;
+
+                assert(proc_snapshot_take(&s, 0) == 0);
+                n = s->n_proc;
+        }
+        elapsed = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("proc_snapshot_take of %zu processes (%d loops)\n", n, BENCH_SNAPSHOT_LOOP);
+        printf("  snapshot        : %8" PRIu64 " us/loop\n", elapsed / BENCH_SNAPSHOT_LOOP);
+}
+
+#define BENCH_CGROUP_LOOP       1000
+
+static void bench_cgroup_poll(void) {
+        _cleanup_cgroup_handle_free_ struct cgroup_handle *cg = NULL;
+        _cleanup_free_ char *root = NULL;
+        struct cgroup_cpu_stat cs;
+        uint64_t t;
+        int i, r;
+
+        root = cgroup2_mount_dir();
+        if (!root) {
+                printf("cgroup2 is not mounted, skip %s\n", __func__);
+                return;
+        }
+
+        r = cgroup_handle_open(root, &cg);
+        if (r < 0) {
+                fprintf(stderr, "cannot open %s: %s\n", root, strerror(-r));
+                return;
+        }
+
+        t = now_usec(CLOCK_MONOTONIC);
+        for (i = 0; i < BENCH_CGROUP_LOOP; i++)
+                assert(cgroup_get_cpu_stat(cg, &cs, CGROUP_CPU_STAT_MASK_USAGE_USEC) == 0);
+        t = now_usec(CLOCK_MONOTONIC) - t;
+
+        printf("cpu.stat poll of %s (%d loops)\n", root, BENCH_CGROUP_LOOP);
+        printf("  cgroup handle   : %8.2f us/read\n", (double) t / BENCH_CGROUP_LOOP);
+}
+
+int main(int argc, char *argv[]) {
+        int i;
+
+        /* smaps of the given pids, or of itself */
+        for (i = 1; i < argc; i++)
+                bench_smaps((pid_t) atoi(argv[i]));
+        if (argc <= 1)
+                bench_smaps(getpid());
+
+        bench_snapshot();
+        bench_cgroup_poll();
+
+        return 0;
+}
@@ -0,0 +1,92 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/config-parser.h"
+#include "test.h"
+
+#define TEST_CONFIG_FILE        "/tmp/test-config-parser.conf"
+
+static void test_config_parse(void) {
+        _cleanup_free_ char *name = NULL, *long_value = NULL, *conf = NULL;
+        int count = 0, other = 0;
+        bool enable = false;
+        ConfigTableItem items[] = {
+                { "Main",       "Name",         config_parse_string,    0, &name        },
+                { "Main",       "Count",        config_parse_int,       0, &count       },
+                { "Main",       "Enable",       config_parse_bool,      0, &enable      },
+                { "Main",       "Long",         config_parse_string,    0, &long_value  },
+                { "Other",      "Count",        config_parse_int,       0, &other       },
+                { NULL,         NULL,           NULL,                   0, NULL         },
+        };
+        char *value;
+        size_t i;
+
+        /* longer than LINE_MAX is not split to lines */
+        value = new(char, 2 * LINE_MAX + 1);
+        assert(value);
+        for (i = 0; i < 2 * LINE_MAX; i++)
+                value[i] = 'a' + i % 26;
+        value[2 * LINE_MAX] = 0;
+
+        assert(asprintf(&conf,
+                        "# comment\n"
+                        "Count=1\n"
+                        "[Main]\n"
+                        "Name = libsystem \n"
+                        "\n"
+                        "Count=42\n"
+                        "Enable=yes\r\n"
+                        "Long=%s\n"
+                        "[Other]\n"
+                        "Count=7\n"
+                        "; comment\n"
+                        "Unknown=1", value) > 0);
+        assert(write_str_to_path(TEST_CONFIG_FILE, conf, 0) == 0);
+
+        assert(config_parse(TEST_CONFIG_FILE, items) == 0);
+        assert(streq(name, "libsystem"));
+        assert(count == 42);
+        assert(enable);
+        assert(long_value && streq(long_value, value));
+        assert(other == 7);
+
+        free(value);
+
+        assert(write_str_to_path(TEST_CONFIG_FILE, "[Main\nCount=1\n", 0) == 0);
+        assert(config_parse(TEST_CONFIG_FILE, items) == -EBADMSG);
+
+        assert(unlink(TEST_CONFIG_FILE) == 0);
+        assert(config_parse(TEST_CONFIG_FILE, items) == -ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        test_config_parse();
+
+        return 0;
+}
@@ -26,11 +26,15 @@
 #include <errno.h>
 #include <limits.h>
 #include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 
 #include "libsystem/libsystem.h"
 
 #define TEST_SRC_FILE "/tmp/test-cp-src"
 #define TEST_DST_FILE "/tmp/test-cp-dst"
+#define TEST_SRC_DIR "/tmp/test-cp-src-dir"
+#define TEST_DST_DIR "/tmp/test-cp-dst-dir"
 
 static int random_char(char **buf, size_t len) {
         static int rand_init = 0;
@@ -99,11 +103,13 @@ static void compare_file(void) {
         dst_fd = open(TEST_DST_FILE, O_RDONLY);
         assert(dst_fd >= 0);
 
-        while(src_red = read(src_fd, src_buf, 1024) > 0,
-              dst_red = read(dst_fd, dst_buf, 1024) > 0) {
+        do {
+                src_red = read(src_fd, src_buf, 1024);
+                dst_red = read(dst_fd, dst_buf, 1024);
+                assert(src_red >= 0);
                 assert(src_red == dst_red);
                 assert(memcmp(src_buf, dst_buf, src_red) == 0);
-        }
+        } while (src_red > 0);
 }
 
 static void test_overwite(void) {
@@ -124,14 +130,312 @@ static void test_n_byte_cp_force(unsigned int n) {
         compare_file();
 }
 
+static void test_sparse(void) {
+        struct stat st;
+        _cleanup_close_ int fd = -1;
+
+        assert(unlink(TEST_SRC_FILE) == 0 || errno == ENOENT);
+
+        /* hole, 4k data, hole, 4k data, trailing hole */
+        fd = open(TEST_SRC_FILE, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        assert(fd >= 0);
+        assert(pwrite(fd, "data", 4, 1 << 20) == 4);
+        assert(pwrite(fd, "more", 4, 4 << 20) == 4);
+        assert(ftruncate(fd, 8 << 20) == 0);
+
+        assert(do_copy_force(TEST_SRC_FILE, TEST_DST_FILE) == 0);
+        compare_file();
+
+        assert(stat(TEST_DST_FILE, &st) == 0);
+        assert(st.st_size == 8 << 20);
+
+        /* file systems without SEEK_HOLE report the whole file as data */
+        if (lseek(fd, 0, SEEK_HOLE) != 0) {
+                printf("SEEK_HOLE is not supported, skip the hole check of %s\n", __func__);
+                return;
+        }
+
+        assert((uint64_t) st.st_blocks * 512 < (uint64_t) st.st_size);
+}
+
+static void test_sparse_prealloc(void) {
+        struct stat st;
+        _cleanup_close_ int fd = -1;
+
+        assert(unlink(TEST_SRC_FILE) == 0 || errno == ENOENT);
+
+        /* blocks preallocated past the end outnumber the holes */
+        fd = open(TEST_SRC_FILE, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        assert(fd >= 0);
+        assert(pwrite(fd, "data", 4, 0) == 4);
+        assert(pwrite(fd, "more", 4, 4 << 20) == 4);
+        if (fallocate(fd, FALLOC_FL_KEEP_SIZE, 8 << 20, 16 << 20) < 0 ||
+            lseek(fd, 0, SEEK_HOLE) >= 4 << 20) {
+                printf("fallocate or SEEK_HOLE is not supported, skip %s\n", __func__);
+                return;
+        }
+
+        assert(fstat(fd, &st) == 0);
+        assert((uint64_t) st.st_blocks * 512 >= (uint64_t) st.st_size);
+
+        assert(do_copy_force(TEST_SRC_FILE, TEST_DST_FILE) == 0);
+        compare_file();
+
+        assert(stat(TEST_DST_FILE, &st) == 0);
+        assert(st.st_size == (4 << 20) + 4);
+        assert((uint64_t) st.st_blocks * 512 < (uint64_t) st.st_size);
+}
+
+static void test_reflink(void) {
+        assert(write_src_file(300 * 1024) == 0);
+
+        /* falls back to the data copy if FICLONE is not supported */
+        assert(do_copy_full(TEST_SRC_FILE, TEST_DST_FILE, 0600, COPY_FORCE | COPY_REFLINK) == 0);
+        compare_file();
+
+        assert(do_copy_full(TEST_SRC_FILE, TEST_DST_FILE, 0600, COPY_REFLINK) == -EALREADY);
+}
+
+static void test_stream(void) {
+        _cleanup_close_ int fd = -1;
+        char buf[256];
+        ssize_t n;
+
+        /* procfs reports zero size but has contents */
+        assert(do_copy_force("/proc/self/status", TEST_DST_FILE) == 0);
+
+        fd = open(TEST_DST_FILE, O_RDONLY);
+        assert(fd >= 0);
+        n = read(fd, buf, sizeof(buf) - 1);
+        assert(n > 0);
+        buf[n] = 0;
+        assert(strstr(buf, "Name:"));
+}
+
+static void make_tree_file(const char *path, const char *str, mode_t mode, time_t mtime) {
+        struct timespec ts[2] = { { mtime, 0 }, { mtime, 0 } };
+
+        assert(write_str_to_path(path, str, 0) == 0);
+        assert(chmod(path, mode) == 0);
+        assert(utimensat(AT_FDCWD, path, ts, 0) == 0);
+}
+
+static void check_tree_file(const char *path, const char *str, mode_t mode, time_t mtime) {
+        _cleanup_free_ char *buf = NULL;
+        struct stat st;
+
+        assert(lstat(path, &st) == 0);
+        assert(S_ISREG(st.st_mode));
+        assert((st.st_mode & 07777) == mode);
+        assert(st.st_mtim.tv_sec == mtime);
+
+        /* read-only files can be read by root only */
+        if (!(mode & 0400))
+                return;
+
+        assert(read_one_line_from_path(path, &buf) == 0);
+        assert(streq(buf, str));
+}
+
+static void test_copy_tree(void) {
+        struct timespec ts[2] = { { 1000, 0 }, { 1000, 0 } };
+        char path[PATH_MAX];
+        struct stat st;
+        int i;
+
+        (void) rmdir_recursive(TEST_SRC_DIR);
+        (void) rmdir_recursive(TEST_DST_DIR);
+
+        assert(do_mkdir(TEST_SRC_DIR "/a/b/c", 0755) == 0);
+        assert(mkdir(TEST_SRC_DIR "/empty", 0700) == 0);
+
+        make_tree_file(TEST_SRC_DIR "/top", "top", 0644, 12345);
+        make_tree_file(TEST_SRC_DIR "/a/exec", "exec", 0755, 23456);
+        make_tree_file(TEST_SRC_DIR "/a/b/c/deep", "deep", 0400, 34567);
+        for (i = 0; i < 100; i++) {
+                snprintf(path, sizeof(path), TEST_SRC_DIR "/a/b/f%d", i);
+                make_tree_file(path, path, 0600, 40000 + i);
+        }
+        assert(symlink("a/exec", TEST_SRC_DIR "/link") == 0);
+
+        assert(chmod(TEST_SRC_DIR "/a/b", 0750) == 0);
+        assert(utimensat(AT_FDCWD, TEST_SRC_DIR "/a/b", ts, 0) == 0);
+
+        assert(do_copy_tree(TEST_SRC_DIR, TEST_DST_DIR, 0) == 0);
+
+        check_tree_file(TEST_DST_DIR "/top", "top", 0644, 12345);
+        check_tree_file(TEST_DST_DIR "/a/exec", "exec", 0755, 23456);
+        check_tree_file(TEST_DST_DIR "/a/b/c/deep", "deep", 0400, 34567);
+        for (i = 0; i < 100; i++) {
+                char dst[PATH_MAX];
+
+                snprintf(path, sizeof(path), TEST_SRC_DIR "/a/b/f%d", i);
+                snprintf(dst, sizeof(dst), TEST_DST_DIR "/a/b/f%d", i);
+                check_tree_file(dst, path, 0600, 40000 + i);
+        }
+
+        assert(readlink(TEST_DST_DIR "/link", path, sizeof(path)) == 6);
+        assert(strneq(path, "a/exec", 6));
+
+        assert(stat(TEST_DST_DIR "/a/b", &st) == 0);
+        assert((st.st_mode & 07777) == 0750);
+        assert(st.st_mtim.tv_sec == 1000);
+
+        assert(stat(TEST_DST_DIR "/empty", &st) == 0);
+        assert(S_ISDIR(st.st_mode));
+        assert((st.st_mode & 07777) == 0700);
+
+        assert(do_copy_tree(TEST_SRC_DIR, TEST_DST_DIR, 0) == -EALREADY);
+
+        make_tree_file(TEST_SRC_DIR "/top", "changed", 0644, 12346);
+        assert(do_copy_tree(TEST_SRC_DIR, TEST_DST_DIR, COPY_FORCE | COPY_SYNC) == 0);
+        check_tree_file(TEST_DST_DIR "/top", "changed", 0644, 12346);
+        check_tree_file(TEST_DST_DIR "/a/b/c/deep", "deep", 0400, 34567);
+
+        /* copy into itself does not recurse */
+        assert(do_copy_tree(TEST_SRC_DIR, TEST_SRC_DIR "/a/self", 0) == 0);
+        assert(access(TEST_SRC_DIR "/a/self/a/exec", F_OK) == 0);
+        assert(access(TEST_SRC_DIR "/a/self/a/self", F_OK) < 0);
+
+        assert(rmdir_recursive(TEST_SRC_DIR) == 0);
+        assert(rmdir_recursive(TEST_DST_DIR) == 0);
+}
+
+#define DEEP_DEPTH      600
+#define DEEP_FDS        64
+
+static void test_copy_tree_deep(void) {
+        struct rlimit old, rl;
+        char path[PATH_MAX];
+        int fd, nfd, i;
+
+        (void) rmdir_recursive(TEST_SRC_DIR);
+        (void) rmdir_recursive(TEST_DST_DIR);
+
+        assert(mkdir(TEST_SRC_DIR, 0755) == 0);
+        fd = open(TEST_SRC_DIR, O_RDONLY | O_DIRECTORY);
+        assert(fd >= 0);
+
+        for (i = 0; i < DEEP_DEPTH; i++) {
+                assert(mkdirat(fd, "d", 0755) == 0);
+                if (i % 100 == 0)
+                        assert(mknodat(fd, "file", S_IFREG | 0644, 0) == 0);
+
+                nfd = openat(fd, "d", O_RDONLY | O_DIRECTORY);
+                assert(nfd >= 0);
+                close(fd);
+                fd = nfd;
+        }
+        assert(mknodat(fd, "file", S_IFREG | 0644, 0) == 0);
+        close(fd);
+
+        /* far less fds than the depth */
+        assert(getrlimit(RLIMIT_NOFILE, &old) == 0);
+        rl = old;
+        rl.rlim_cur = DEEP_FDS;
+        assert(setrlimit(RLIMIT_NOFILE, &rl) == 0);
+
+        assert(do_copy_tree(TEST_SRC_DIR, TEST_DST_DIR, 0) == 0);
+
+        assert(setrlimit(RLIMIT_NOFILE, &old) == 0);
+
+        snprintf(path, sizeof(path), "%s", TEST_DST_DIR);
+        for (i = 0; i < DEEP_DEPTH; i++)
+                strcat(path, "/d");
+        strcat(path, "/file");
+        assert(access(path, F_OK) == 0);
+
+        assert(rmdir_recursive(TEST_SRC_DIR) == 0);
+        assert(rmdir_recursive(TEST_DST_DIR) == 0);
+}
+
+#define MANY_FILES      40
+
+static void compare_path(const char *a, const char *b) {
+        _cleanup_free_ char *x = NULL, *y = NULL;
+        size_t lx, ly;
+
+        assert(read_full_file(a, &x, &lx) == 0);
+        assert(read_full_file(b, &y, &ly) == 0);
+
+        if (lx != ly || memcmp(x, y, lx) != 0) {
+                fprintf(stderr, "%s and %s differ\n", a, b);
+                abort();
+        }
+}
+
+static void test_copy_many(enum copy_flags flags) {
+        struct copy_pair pairs[MANY_FILES + 2];
+        char src[MANY_FILES][PATH_MAX], dst[MANY_FILES][PATH_MAX];
+        int status[MANY_FILES + 2];
+        int i;
+
+        (void) rmdir_recursive(TEST_SRC_DIR);
+        (void) rmdir_recursive(TEST_DST_DIR);
+        assert(mkdir(TEST_SRC_DIR, 0755) == 0);
+        assert(mkdir(TEST_DST_DIR, 0755) == 0);
+
+        /* empty, small and multiple of the buffer sizes */
+        for (i = 0; i < MANY_FILES; i++) {
+                _cleanup_free_ char *buf = NULL;
+                _cleanup_close_ int fd = -1;
+                size_t size = i == 0 ? 0 : (size_t) i * i * i * 97;
+
+                snprintf(src[i], PATH_MAX, TEST_SRC_DIR "/f%d", i);
+                snprintf(dst[i], PATH_MAX, TEST_DST_DIR "/f%d", i);
+                pairs[i].src = src[i];
+                pairs[i].dst = dst[i];
+
+                if (size)
+                        assert(random_char(&buf, size) == 0);
+                fd = open(src[i], O_CREAT | O_WRONLY | O_TRUNC, 0644);
+                assert(fd >= 0);
+                assert(write(fd, buf, size) == (ssize_t) size);
+        }
+
+        pairs[MANY_FILES].src = TEST_SRC_DIR "/no-such-file";
+        pairs[MANY_FILES].dst = TEST_DST_DIR "/no-such-file";
+        pairs[MANY_FILES + 1].src = src[1];
+        pairs[MANY_FILES + 1].dst = dst[2];
+
+        assert(do_copy_many(pairs, MANY_FILES, 0600, flags, status) == 0);
+        for (i = 0; i < MANY_FILES; i++) {
+                assert(status[i] == 0);
+                compare_path(src[i], dst[i]);
+        }
+
+        /* the others are copied even if some fail */
+        assert(do_copy_many(pairs, MANY_FILES + 2, 0600, flags | COPY_FORCE, status) < 0);
+        for (i = 0; i < MANY_FILES; i++)
+                assert(status[i] == 0);
+        assert(status[MANY_FILES] == -ENOENT);
+        assert(status[MANY_FILES + 1] == 0);
+        assert(access(TEST_DST_DIR "/no-such-file", F_OK) < 0);
+
+        assert(do_copy_many(pairs, 1, 0600, flags, status) == -EALREADY);
+        assert(status[0] == -EALREADY);
+
+        assert(rmdir_recursive(TEST_SRC_DIR) == 0);
+        assert(rmdir_recursive(TEST_DST_DIR) == 0);
+}
+
 int main(int argc, char *argv[]) {
         unsigned int b;
 
         test_overwite();
+        test_sparse();
+        test_sparse_prealloc();
+        test_reflink();
+        test_stream();
+        test_copy_tree();
+        test_copy_tree_deep();
+        test_copy_many(0);
+        test_copy_many(COPY_URING);
 
         for (b = 8; b < (1 << 30); b = b << 1)
                 test_n_byte_cp_force(b);
 
+
         unlink(TEST_SRC_FILE);
         unlink(TEST_DST_FILE);
 
@@ -0,0 +1,92 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static void test_get_buddyinfo_all(void) {
+        _cleanup_free_ struct buddyinfo_zone *zones = NULL;
+        size_t n, i;
+        int r, o;
+
+        r = proc_get_buddyinfo_all(&zones, &n);
+        if (r == -ENOENT)
+                return;
+
+        assert(r == 0);
+        assert(n > 0);
+
+        for (i = 0; i < n; i++) {
+                _cleanup_buddyinfo_free_ struct buddyinfo *bi = NULL;
+
+                assert(zones[i].zone[0]);
+                assert(zones[i].n_order > 0 && zones[i].n_order <= PAGE_MAX);
+
+                assert(proc_get_buddyinfo(zones[i].zone, &bi) == 0);
+                assert(streq(bi->zone, zones[i].zone));
+
+                /* orders not in the file are zero */
+                for (o = zones[i].n_order; o < PAGE_MAX; o++)
+                        assert(zones[i].page[o] == 0);
+        }
+
+        assert(proc_get_buddyinfo("NoSuchZone", &(struct buddyinfo *) { NULL }) == -ENODATA);
+}
+
+static void test_fragmentation_index(void) {
+        struct buddyinfo_zone z = {
+                .zone = "Test",
+                .n_order = PAGE_MAX,
+        };
+        int index;
+
+        /* no free memory */
+        assert(buddyinfo_fragmentation_index(&z, 3, &index) == 0);
+        assert(index == 0);
+
+        /* only order 0 pages are free */
+        z.page[PAGE_4K] = 100;
+        assert(buddyinfo_fragmentation_index(&z, 0, &index) == 0);
+        assert(index == -1000);
+        assert(buddyinfo_fragmentation_index(&z, 3, &index) == 0);
+        assert(index == 1000 - (1000 + 100 * 1000 / 8) / 100);
+
+        /* a block of order 3 satisfies order 2 */
+        z.page[PAGE_32K] = 1;
+        assert(buddyinfo_fragmentation_index(&z, 2, &index) == 0);
+        assert(index == -1000);
+        assert(buddyinfo_fragmentation_index(&z, 4, &index) == 0);
+        assert(index > 0 && index < 1000);
+
+        assert(buddyinfo_fragmentation_index(&z, PAGE_MAX, &index) == -EINVAL);
+}
+
+int main(int argc, char *argv[]) {
+        test_get_buddyinfo_all();
+        test_fragmentation_index();
+
+        return 0;
+}
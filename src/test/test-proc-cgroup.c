@@ -0,0 +1,197 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static const char *cgroup2_root(void) {
+        static const char * const roots[] = {
+                "/sys/fs/cgroup",
+                "/sys/fs/cgroup/unified",
+        };
+        unsigned int i;
+
+        for (i = 0; i < ELEMENTSOF(roots); i++) {
+                char path[64];
+
+                snprintf(path, sizeof(path), "%s/cgroup.controllers", roots[i]);
+                if (access(path, F_OK) == 0)
+                        return roots[i];
+        }
+
+        return NULL;
+}
+
+static void test_cgroup_stat(const char *root) {
+        _cleanup_cgroup_handle_free_ struct cgroup_handle *cg = NULL;
+        struct cgroup_memory_stat ms;
+        struct cgroup_cpu_stat cs, cs2;
+        struct cgroup_io_stat is;
+        uint64_t current;
+        int r;
+
+        assert(cgroup_handle_open(root, &cg) == 0);
+
+        /* the root cgroup has cpu.stat always */
+        assert(cgroup_get_cpu_stat(cg, &cs, CGROUP_CPU_STAT_MASK_ALL) == 0);
+        assert(cs.value[CGROUP_CPU_STAT_ID_USAGE_USEC] > 0);
+        assert(cs.value[CGROUP_CPU_STAT_ID_USAGE_USEC] >= cs.value[CGROUP_CPU_STAT_ID_USER_USEC]);
+
+        /* re-read on the cached fd */
+        assert(cgroup_get_cpu_stat(cg, &cs2, CGROUP_CPU_STAT_MASK_USAGE_USEC) == 0);
+        assert(cs2.value[CGROUP_CPU_STAT_ID_USAGE_USEC] >= cs.value[CGROUP_CPU_STAT_ID_USAGE_USEC]);
+        assert(cs2.value[CGROUP_CPU_STAT_ID_USER_USEC] == 0);
+
+        /* controllers may not be enabled */
+        r = cgroup_get_memory_current(cg, &current);
+        assert(r == 0 || r == -ENOENT);
+
+        r = cgroup_get_memory_stat(cg, &ms, CGROUP_MEMORY_STAT_MASK_ANON | CGROUP_MEMORY_STAT_MASK_FILE);
+        assert(r == 0 || r == -ENOENT);
+        if (r == 0)
+                assert(ms.value[CGROUP_MEMORY_STAT_ID_SHMEM] == 0);
+
+        r = cgroup_get_io_stat(cg, &is, CGROUP_IO_STAT_MASK_ALL);
+        assert(r == 0 || r == -ENOENT);
+}
+
+static void test_cgroup_pressure(const char *root) {
+        _cleanup_cgroup_handle_free_ struct cgroup_handle *cg = NULL;
+        struct psi_stats st;
+        int r;
+
+        assert(cgroup_handle_open(root, &cg) == 0);
+
+        /* PSI may be disabled */
+        r = cgroup_get_pressure(cg, PSI_RESOURCE_MEMORY, &st);
+        assert(r == 0 || r == -ENOENT || r == -EOPNOTSUPP);
+        if (r == 0)
+                assert(st.some.avg10 <= 10000 && st.full.avg10 <= 10000);
+}
+
+static void write_file(const char *dir, const char *name, const char *content) {
+        _cleanup_fclose_ FILE *f = NULL;
+        char path[PATH_MAX];
+
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        f = fopen(path, "we");
+        assert(f);
+        assert(fputs(content, f) >= 0);
+}
+
+/* Parsers on a fake cgroup directory with known contents */
+static void test_cgroup_parse(void) {
+        _cleanup_cgroup_handle_free_ struct cgroup_handle *cg = NULL;
+        char dir[] = "/tmp/test-proc-cgroup-XXXXXX";
+        struct cgroup_memory_stat ms;
+        struct cgroup_io_stat is;
+        struct psi_stats st;
+        uint64_t current;
+
+        assert(mkdtemp(dir));
+
+        write_file(dir, "memory.current", "123456789012\n");
+        write_file(dir, "memory.stat",
+                   "anon 4096\n"
+                   "file 8192\n"
+                   "kernel_stack 16384\n"
+                   "unknown_key 1\n"
+                   "pgfault 99\n");
+        write_file(dir, "io.stat",
+                   "8:0 rbytes=100 wbytes=200 rios=1 wios=2 dbytes=0 dios=0\n"
+                   "8:16 rbytes=1000 wbytes=2000 rios=10 wios=20 dbytes=5 dios=1\n");
+        write_file(dir, "memory.pressure",
+                   "some avg10=1.23 avg60=0.5 avg300=12.00 total=4567\n"
+                   "full avg10=0.01 avg60=0.00 avg300=0.00 total=89\n");
+
+        assert(cgroup_handle_open(dir, &cg) == 0);
+
+        assert(cgroup_get_memory_current(cg, &current) == 0);
+        assert(current == 123456789012ULL);
+
+        assert(cgroup_get_memory_stat(cg, &ms, CGROUP_MEMORY_STAT_MASK_ALL) == 0);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_ANON] == 4096);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_FILE] == 8192);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_KERNEL_STACK] == 16384);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_PGFAULT] == 99);
+
+        assert(cgroup_get_memory_stat(cg, &ms, CGROUP_MEMORY_STAT_MASK_FILE) == 0);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_ANON] == 0);
+        assert(ms.value[CGROUP_MEMORY_STAT_ID_FILE] == 8192);
+
+        assert(cgroup_get_io_stat(cg, &is, CGROUP_IO_STAT_MASK_ALL & ~CGROUP_IO_STAT_MASK_DIOS) == 0);
+        assert(is.value[CGROUP_IO_STAT_ID_RBYTES] == 1100);
+        assert(is.value[CGROUP_IO_STAT_ID_WBYTES] == 2200);
+        assert(is.value[CGROUP_IO_STAT_ID_RIOS] == 11);
+        assert(is.value[CGROUP_IO_STAT_ID_WIOS] == 22);
+        assert(is.value[CGROUP_IO_STAT_ID_DBYTES] == 5);
+        assert(is.value[CGROUP_IO_STAT_ID_DIOS] == 0);
+
+        assert(cgroup_get_pressure(cg, PSI_RESOURCE_MEMORY, &st) == 0);
+        assert(st.some.avg10 == 123);
+        assert(st.some.avg60 == 50);
+        assert(st.some.avg300 == 1200);
+        assert(st.some.total == 4567);
+        assert(st.full.avg10 == 1);
+        assert(st.full.total == 89);
+
+        assert(cgroup_get_cpu_stat(cg, &(struct cgroup_cpu_stat) {}, CGROUP_CPU_STAT_MASK_ALL) == -ENOENT);
+
+        assert(rmdir_recursive(dir) == 0);
+}
+
+static void test_stat_keys(void) {
+        int i;
+
+        for (i = 0; i < CGROUP_MEMORY_STAT_ID_MAX; i++)
+                assert(cgroup_memory_stat_string_to_id(cgroup_memory_stat_id_to_string(i)) == i);
+        for (i = 0; i < CGROUP_CPU_STAT_ID_MAX; i++)
+                assert(cgroup_cpu_stat_string_to_id(cgroup_cpu_stat_id_to_string(i)) == i);
+        for (i = 0; i < CGROUP_IO_STAT_ID_MAX; i++)
+                assert(cgroup_io_stat_string_to_id(cgroup_io_stat_id_to_string(i)) == i);
+
+        assert(cgroup_memory_stat_string_to_id("no_such_key") == CGROUP_MEMORY_STAT_ID_INVALID);
+}
+
+int main(int argc, char *argv[]) {
+        const char *root;
+
+        test_stat_keys();
+        test_cgroup_parse();
+
+        root = cgroup2_root();
+        if (!root)
+                return EXIT_TEST_SKIP;
+
+        test_cgroup_stat(root);
+        test_cgroup_pressure(root);
+
+        return 0;
+}
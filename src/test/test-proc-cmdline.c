@@ -0,0 +1,117 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static void test_cmdline_parse(void) {
+        _cleanup_proc_cmdline_free_ struct proc_cmdline *c = NULL;
+        const char *v;
+        size_t bytes;
+        bool b;
+        int i;
+
+        assert(proc_cmdline_new_from_string(
+                       "  root=/dev/sda1 quiet foobar=1 foo=2 "
+                       "console=\"tty0 tty1\" \"quoted=a b\" "
+                       "debug=off loglevel=7 loglevel=0x10 big=99999999999 "
+                       "crashkernel=256M empty= -- init_arg\n", &c) == 0);
+
+        assert(proc_cmdline_size(c) == 13);
+
+        assert(proc_cmdline_get(c, "root", &v) == 0);
+        assert(streq(v, "/dev/sda1"));
+
+        /* exact match, no prefix */
+        assert(proc_cmdline_get(c, "foo", &v) == 0);
+        assert(streq(v, "2"));
+        assert(proc_cmdline_get(c, "fo", NULL) == -ENOENT);
+        assert(proc_cmdline_get(c, "foobar", &v) == 0);
+        assert(streq(v, "1"));
+
+        /* quotes */
+        assert(proc_cmdline_get(c, "console", &v) == 0);
+        assert(streq(v, "tty0 tty1"));
+        assert(proc_cmdline_get(c, "quoted", &v) == 0);
+        assert(streq(v, "a b"));
+
+        assert(proc_cmdline_get(c, "quiet", &v) == 0);
+        assert(v == NULL);
+        assert(proc_cmdline_get(c, "empty", &v) == 0);
+        assert(streq(v, ""));
+        assert(proc_cmdline_get(c, "init_arg", NULL) == 0);
+
+        assert(proc_cmdline_get_bool(c, "quiet", &b) == 0 && b);
+        assert(proc_cmdline_get_bool(c, "debug", &b) == 0 && !b);
+        assert(proc_cmdline_get_bool(c, "root", &b) == -EINVAL);
+        assert(proc_cmdline_get_bool(c, "nosuchkey", &b) == -ENOENT);
+
+        /* the last one wins */
+        assert(proc_cmdline_get_int(c, "loglevel", &i) == 0 && i == 16);
+        assert(proc_cmdline_get_int(c, "big", &i) == -ERANGE);
+        assert(proc_cmdline_get_int(c, "root", &i) == -EINVAL);
+        assert(proc_cmdline_get_int(c, "quiet", &i) == -EINVAL);
+
+        assert(proc_cmdline_get_bytes(c, "crashkernel", &bytes) == 0);
+        assert(bytes == 256 << 20);
+        assert(proc_cmdline_get_bytes(c, "root", &bytes) == -EINVAL);
+}
+
+static void test_cmdline_long(void) {
+        _cleanup_proc_cmdline_free_ struct proc_cmdline *c = NULL;
+        _cleanup_free_ char *s = NULL;
+        const char *v;
+        size_t l = LINE_MAX * 4;
+
+        /* longer than LINE_MAX, the last argument is not truncated */
+        s = new(char, l + sizeof(" last=1"));
+        assert(s);
+        memset(s, 'x', l);
+        strcpy(s + l, " last=1");
+
+        assert(proc_cmdline_new_from_string(s, &c) == 0);
+        assert(proc_cmdline_size(c) == 2);
+        assert(proc_cmdline_get(c, "last", &v) == 0);
+        assert(streq(v, "1"));
+}
+
+static void test_cmdline_proc(void) {
+        _cleanup_proc_cmdline_free_ struct proc_cmdline *c = NULL;
+        _cleanup_free_ char *buf = NULL;
+
+        assert(proc_cmdline_new(&c) == 0);
+        assert(proc_cmdline_get_str(&buf, "no_such_key_in_cmdline=") == -ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        test_cmdline_parse();
+        test_cmdline_long();
+        test_cmdline_proc();
+
+        return 0;
+}
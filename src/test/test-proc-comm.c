@@ -0,0 +1,116 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+#define TEST_COMM "test-comm-idx"
+
+static pid_t spawn_named(const char *name) {
+        int fds[2];
+        char c;
+        pid_t pid;
+
+        assert(pipe(fds) == 0);
+
+        pid = fork();
+        assert(pid >= 0);
+
+        if (pid == 0) {
+                prctl(PR_SET_NAME, name);
+                close(fds[0]);
+                assert(write(fds[1], "x", 1) == 1);
+                for (;;)
+                        pause();
+        }
+
+        close(fds[1]);
+        assert(read(fds[0], &c, 1) == 1);
+        close(fds[0]);
+
+        return pid;
+}
+
+static void kill_named(pid_t pid) {
+        assert(kill(pid, SIGKILL) == 0);
+        assert(waitpid(pid, NULL, 0) == pid);
+}
+
+static void test_comm_index(void) {
+        _cleanup_proc_comm_index_free_ struct proc_comm_index *index = NULL;
+        pid_t a, b, c, pids[4];
+
+        a = spawn_named(TEST_COMM);
+        b = spawn_named(TEST_COMM);
+        c = spawn_named(TEST_COMM "-with-long-name");
+        if (a > b) {
+                pid_t t = a;
+
+                a = b;
+                b = t;
+        }
+
+        assert(proc_comm_index_new(&index) == 0);
+
+        assert(proc_comm_index_lookup(index, TEST_COMM, pids, ELEMENTSOF(pids)) == 2);
+        assert(pids[0] == a && pids[1] == b);
+        assert(proc_comm_index_lookup(index, TEST_COMM, NULL, 0) == 2);
+        assert(proc_comm_index_lookup(index, "no-such-comm", pids, ELEMENTSOF(pids)) == 0);
+        assert(proc_pid_of(TEST_COMM) == a);
+
+        /* The first 15 characters are compared */
+        assert(proc_comm_index_lookup(index, TEST_COMM "-with-long-name", pids, 1) == 1);
+        assert(pids[0] == c);
+        assert(proc_comm_index_lookup(index, TEST_COMM "-w", pids, 1) == 1);
+        kill_named(c);
+
+        kill_named(a);
+        assert(proc_comm_index_refresh(index) == 0);
+        assert(proc_comm_index_lookup(index, TEST_COMM, pids, ELEMENTSOF(pids)) == 1);
+        assert(pids[0] == b);
+
+        a = spawn_named("test-comm-idx2");
+        assert(proc_comm_index_refresh(index) == 0);
+        assert(proc_comm_index_lookup(index, "test-comm-idx2", pids, ELEMENTSOF(pids)) == 1);
+        assert(pids[0] == a);
+        assert(proc_comm_index_lookup(index, TEST_COMM, pids, ELEMENTSOF(pids)) == 1);
+
+        kill_named(a);
+        kill_named(b);
+        assert(proc_comm_index_refresh(index) == 0);
+        assert(proc_comm_index_lookup(index, TEST_COMM, NULL, 0) == 0);
+        assert(proc_comm_index_lookup(index, "test-comm-idx2", NULL, 0) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_comm_index();
+
+        return 0;
+}
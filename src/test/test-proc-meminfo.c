@@ -0,0 +1,157 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static void test_get_meminfo(void) {
+        struct meminfo mi;
+
+        assert(proc_get_meminfo(&mi, MEMINFO_MASK_ALL) == 0);
+        assert(mi.value[MEMINFO_ID_MEM_TOTAL] > 0);
+        assert(mi.value[MEMINFO_ID_MEM_FREE] <= mi.value[MEMINFO_ID_MEM_TOTAL]);
+
+        assert(proc_get_meminfo(&mi, MEMINFO_MASK_MEM_TOTAL) == 0);
+        assert(mi.value[MEMINFO_ID_MEM_TOTAL] > 0);
+        assert(mi.value[MEMINFO_ID_SWAP_FREE] == 0);
+}
+
+static void test_meminfo_sampler(void) {
+        _cleanup_meminfo_sampler_free_ struct meminfo_sampler *s = NULL;
+        struct meminfo mi, sample;
+        uint64_t t1 = 0, t2 = 0;
+
+        assert(meminfo_sampler_new(&s) == 0);
+
+        assert(meminfo_sampler_read(s, &sample, MEMINFO_MASK_ALL, &t1) == 0);
+        assert(proc_get_meminfo(&mi, MEMINFO_MASK_ALL) == 0);
+        assert(sample.value[MEMINFO_ID_MEM_TOTAL] == mi.value[MEMINFO_ID_MEM_TOTAL]);
+
+        /* re-read on the same fd */
+        assert(meminfo_sampler_read(s, &sample, MEMINFO_MASK_MEM_TOTAL, &t2) == 0);
+        assert(sample.value[MEMINFO_ID_MEM_TOTAL] == mi.value[MEMINFO_ID_MEM_TOTAL]);
+        assert(sample.value[MEMINFO_ID_MEM_FREE] == 0);
+        assert(t1 > 0 && t2 >= t1);
+}
+
+static void test_meminfo_delta(void) {
+        struct meminfo64 old = {}, new = {};
+        struct meminfo_rate rate;
+
+        old.timestamp = 1 * USEC_PER_SEC;
+        new.timestamp = 3 * USEC_PER_SEC;
+
+        /* 8TiB in kB does not fit to 32 bit */
+        old.value[MEMINFO_ID_MEM_TOTAL] = 8ULL << 30;
+        new.value[MEMINFO_ID_MEM_TOTAL] = 8ULL << 30;
+        old.value[MEMINFO_ID_DIRTY] = 3000;
+        new.value[MEMINFO_ID_DIRTY] = 1000;
+        old.value[MEMINFO_ID_SWAP_TOTAL] = new.value[MEMINFO_ID_SWAP_TOTAL] = 4000;
+        old.value[MEMINFO_ID_SWAP_FREE] = 4000;
+        new.value[MEMINFO_ID_SWAP_FREE] = 3000;
+
+        assert(meminfo_delta(&old, &new, &rate) == 0);
+        assert(rate.interval == 2 * USEC_PER_SEC);
+        assert(rate.value[MEMINFO_ID_MEM_TOTAL] == 0);
+        assert(rate.value[MEMINFO_ID_DIRTY] == -1000);
+        assert(rate.dirty_writeback == -1000);
+        assert(rate.swap_used == 500);
+
+        assert(meminfo_delta(&new, &old, &rate) == -EINVAL);
+}
+
+static void test_get_meminfo64(void) {
+        _cleanup_meminfo_sampler_free_ struct meminfo_sampler *s = NULL;
+        struct meminfo64 a, b;
+        struct meminfo mi;
+
+        assert(proc_get_meminfo64(&a, MEMINFO_MASK_ALL) == 0);
+        assert(proc_get_meminfo(&mi, MEMINFO_MASK_MEM_TOTAL) == 0);
+        assert(a.value[MEMINFO_ID_MEM_TOTAL] == mi.value[MEMINFO_ID_MEM_TOTAL]);
+
+        assert(meminfo_sampler_new(&s) == 0);
+        usleep(1000);
+        assert(meminfo_sampler_read64(s, &b, MEMINFO_MASK_ALL) == 0);
+        assert(b.timestamp > a.timestamp);
+        assert(b.value[MEMINFO_ID_MEM_TOTAL] == a.value[MEMINFO_ID_MEM_TOTAL]);
+}
+
+static void test_meminfo_keys(void) {
+        int i;
+
+        for (i = 0; i < MEMINFO_ID_MAX; i++)
+                assert(meminfo_string_to_id(meminfo_id_to_string(i)) == i);
+
+        assert(meminfo_string_to_id("NoSuchKey") == MEMINFO_ID_INVALID);
+        assert(MEMINFO_MASK_ALL == (MEMINFO_MASK_VMALLOC_CHUNK << 1) - 1);
+}
+
+static void test_get_meminfo64_bitset(void) {
+        _cleanup_meminfo_sampler_free_ struct meminfo_sampler *s = NULL;
+        struct meminfo_bitset set = {};
+        uint64_t value[MEMINFO_ID_MAX + 1], t = 0;
+        struct meminfo64 mi;
+
+        /* the sizes of public structs are kept while keys are added */
+        assert(ELEMENTSOF(mi.value) == 38);
+        assert(MEMINFO_ID_MAX > MEMINFO_ID_BASE_MAX);
+
+        meminfo_bitset_set(&set, MEMINFO_ID_MEM_TOTAL);
+        meminfo_bitset_set(&set, MEMINFO_ID_DIRECT_MAP_1G);
+        assert(meminfo_bitset_test(&set, MEMINFO_ID_DIRECT_MAP_1G));
+        assert(!meminfo_bitset_test(&set, MEMINFO_ID_MEM_FREE));
+
+        assert(proc_get_meminfo64_bitset(value, MEMINFO_ID_MAX, &set, &t) == 0);
+        assert(t > 0);
+        assert(value[MEMINFO_ID_MEM_TOTAL] > 0);
+        assert(value[MEMINFO_ID_MEM_FREE] == 0);
+
+        /* nothing is stored beyond n_value */
+        meminfo_bitset_fill(&set);
+        value[MEMINFO_ID_BASE_MAX] = UINT64_MAX;
+        assert(proc_get_meminfo64_bitset(value, MEMINFO_ID_BASE_MAX, &set, NULL) == 0);
+        assert(value[MEMINFO_ID_MEM_FREE] > 0);
+        assert(value[MEMINFO_ID_BASE_MAX] == UINT64_MAX);
+
+        value[MEMINFO_ID_MAX] = UINT64_MAX;
+        assert(meminfo_sampler_new(&s) == 0);
+        assert(meminfo_sampler_read64_bitset(s, value, MEMINFO_ID_MAX, &set, NULL) == 0);
+        assert(value[MEMINFO_ID_MEM_TOTAL] > 0);
+        assert(value[MEMINFO_ID_MAX] == UINT64_MAX);
+}
+
+int main(int argc, char *argv[]) {
+        test_get_meminfo();
+        test_meminfo_sampler();
+        test_meminfo_delta();
+        test_get_meminfo64();
+        test_meminfo_keys();
+        test_get_meminfo64_bitset();
+
+        return 0;
+}
@@ -0,0 +1,78 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static void test_get_pressure(void) {
+        struct psi_stats st;
+        int i;
+
+        for (i = 0; i < PSI_RESOURCE_MAX; i++) {
+                assert(proc_get_pressure(i, &st) == 0);
+                assert(st.some.avg10 <= 10000);
+                assert(st.some.avg60 <= 10000);
+                assert(st.some.avg300 <= 10000);
+                assert(st.full.total <= st.some.total || i == PSI_RESOURCE_CPU);
+        }
+}
+
+static void test_psi_trigger(void) {
+        _cleanup_close_ int fd = -1;
+        int r;
+
+        assert(proc_psi_trigger_open(PSI_RESOURCE_MEMORY, PSI_TYPE_SOME, 0, 1000000) == -EINVAL);
+        assert(proc_psi_trigger_open(PSI_RESOURCE_MEMORY, PSI_TYPE_SOME, 2000000, 1000000) == -EINVAL);
+
+        /* A window of multiple of 2s is allowed to unprivileged since
+         * 6.5. Older kernels need CAP_SYS_RESOURCE. */
+        fd = proc_psi_trigger_open(PSI_RESOURCE_MEMORY, PSI_TYPE_SOME, 150000, 2000000);
+        if (fd == -EPERM || fd == -EACCES) {
+                printf("psi trigger is not permitted, skip %s\n", __func__);
+                return;
+        }
+        assert(fd >= 0);
+
+        r = psi_trigger_wait(fd, 0);
+        assert(r == 0 || r == 1);
+
+        /* A trigger per fd */
+        assert(write(fd, "some 150000 2000000", sizeof("some 150000 2000000")) < 0);
+        assert(errno == EBUSY);
+}
+
+int main(int argc, char *argv[]) {
+        struct psi_stats st;
+
+        if (proc_get_pressure(PSI_RESOURCE_MEMORY, &st) < 0)
+                return EXIT_TEST_SKIP;
+
+        test_get_pressure();
+        test_psi_trigger();
+
+        return 0;
+}
@@ -23,6 +23,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/wait.h>
 
 #include "libsystem/libsystem.h"
 #include "libsystem/proc.h"
@@ -36,13 +38,140 @@ static void test_get_pid_smaps(pid_t pid) {
         assert(r == 0);
 }
 
+struct foreach_data {
+        int n_map;
+        unsigned long long sum[SMAPS_ID_MAX];
+};
+
+static int count_smap(const struct smap_view *map, void *data) {
+        struct foreach_data *d = data;
+        int i;
+
+        assert(map->mode && strlen(map->mode) == map->mode_len);
+        assert(map->name && strlen(map->name) == map->name_len);
+        assert(map->start <= map->end);
+
+        d->n_map++;
+        for (i = 0; i < SMAPS_ID_MAX; i++)
+                d->sum[i] += map->value[i];
+
+        return 0;
+}
+
+static void test_foreach_pid_smap(pid_t pid) {
+        _cleanup_smaps_free_ struct smaps *maps = NULL;
+        struct foreach_data d = {};
+        int r;
+
+        r = proc_pid_get_smaps(pid, &maps, SMAPS_MASK_ALL);
+        assert(r == 0);
+
+        r = proc_pid_foreach_smap(pid, SMAPS_MASK_SIZE, count_smap, &d);
+        assert(r == 0);
+
+        /* our own maps may be changed between two reads, size of
+         * mappings are compared only for the count */
+        assert(d.n_map > 0);
+        assert(d.sum[SMAPS_ID_SIZE] > 0);
+        assert(d.sum[SMAPS_ID_RSS] == 0);
+}
+
+static void test_pid_smaps_rollup(pid_t pid) {
+        unsigned long long sum[SMAPS_ID_MAX];
+        int r;
+
+        r = proc_pid_get_smaps_rollup(pid, SMAPS_MASK_RSS | SMAPS_MASK_PSS, sum);
+        assert(r == 0);
+        assert(sum[SMAPS_ID_RSS] > 0);
+        assert(sum[SMAPS_ID_PSS] > 0);
+        assert(sum[SMAPS_ID_SWAP] == 0);
+
+        /* Size is not in smaps_rollup, full walk is used */
+        r = proc_pid_get_smaps_rollup(pid, SMAPS_MASK_SIZE, sum);
+        assert(r == 0);
+        assert(sum[SMAPS_ID_SIZE] > 0);
+        assert(sum[SMAPS_ID_RSS] == 0);
+}
+
+static int test_global;
+
+static void test_pid_smaps_snapshot(pid_t pid) {
+        _cleanup_free_ struct smaps_snapshot *s = NULL;
+        uint64_t addr;
+        ssize_t i;
+        size_t j;
+        int r;
+
+        r = proc_pid_get_smaps_snapshot(pid, &s, SMAPS_MASK_RSS | SMAPS_MASK_PSS);
+        assert(r == 0);
+        assert(s->n_map > 0);
+        assert(s->value[SMAPS_ID_RSS] && s->value[SMAPS_ID_PSS]);
+        assert(!s->value[SMAPS_ID_SIZE]);
+
+        for (j = 1; j < s->n_map; j++)
+                assert(s->start[s->by_addr[j - 1]] < s->start[s->by_addr[j]]);
+
+        if (pid != getpid())
+                return;
+
+        /* 64 bit address has to be found without truncation */
+        addr = (uint64_t) (uintptr_t) &test_global;
+        i = smaps_find_by_addr(s, addr);
+        assert(i >= 0);
+        assert(s->start[i] <= addr && addr < s->end[i]);
+        assert(strlen(smaps_snapshot_mode(s, i)) == 4);
+        assert(smaps_snapshot_name(s, i)[0]);
+
+        assert(smaps_find_by_addr(s, 0) == -ENOENT);
+}
+
+#define MANY_PIDS       64
+
+static void test_get_smaps_many(void) {
+        struct smaps_result results[MANY_PIDS + 1];
+        pid_t pids[MANY_PIDS + 1];
+        pid_t gone;
+        int i;
+
+        /* a pid which is already reaped */
+        gone = fork();
+        assert(gone >= 0);
+        if (gone == 0)
+                _exit(EXIT_SUCCESS);
+        assert(waitpid(gone, NULL, 0) == gone);
+
+        for (i = 0; i < MANY_PIDS; i++)
+                pids[i] = getpid();
+        pids[MANY_PIDS] = gone;
+
+        assert(proc_get_smaps_many(pids, ELEMENTSOF(pids), SMAPS_MASK_RSS | SMAPS_MASK_SIZE,
+                                   4, results) == 0);
+
+        for (i = 0; i < MANY_PIDS; i++) {
+                assert(results[i].pid == getpid());
+                assert(results[i].error == 0);
+                assert(results[i].sum[SMAPS_ID_RSS] > 0);
+                assert(results[i].sum[SMAPS_ID_SIZE] >= results[i].sum[SMAPS_ID_RSS]);
+                assert(results[i].sum[SMAPS_ID_PSS] == 0);
+        }
+
+        assert(results[MANY_PIDS].pid == gone);
+        assert(results[MANY_PIDS].error == -ENOENT);
+
+        /* the number of CPUs */
+        assert(proc_get_smaps_many(pids, 1, SMAPS_MASK_RSS, 0, results) == 0);
+        assert(results[0].error == 0);
+
+        assert(proc_get_smaps_many(NULL, 0, SMAPS_MASK_RSS, 4, NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
 
         if (argc > 1) {
                 int i;
 
                 for (i = 1; i < argc; i++) {
-                        pid_t pid = (pid_t)atoi(argv[1]);
+                        pid_t pid = (pid_t)atoi(argv[i]);
                         test_get_pid_smaps(pid);
                 }
 
@@ -50,6 +179,10 @@ int main(int argc, char *argv[]) {
         }
 
         test_get_pid_smaps(getpid());
+        test_foreach_pid_smap(getpid());
+        test_pid_smaps_rollup(getpid());
+        test_pid_smaps_snapshot(getpid());
+        test_get_smaps_many();
 
         return 0;
 }
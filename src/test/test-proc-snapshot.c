@@ -0,0 +1,105 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <sys/prctl.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+#define TEST_COMM       "snapshot-test"
+
+static void test_snapshot_take(void) {
+        _cleanup_proc_snapshot_free_ struct proc_snapshot *s = NULL;
+        const struct proc_snapshot_entry *e;
+        size_t i;
+
+        /* not depend on the name of the binary */
+        assert(prctl(PR_SET_NAME, TEST_COMM) == 0);
+
+        assert(proc_snapshot_take(&s, PROC_SNAPSHOT_STATM) == 0);
+        assert(s->n_proc > 0);
+        assert(s->timestamp > 0);
+
+        for (i = 1; i < s->n_proc; i++)
+                assert(s->procs[i - 1].pid < s->procs[i].pid);
+
+        e = proc_snapshot_find(s, getpid());
+        assert(e);
+        assert(e->pid == getpid());
+        assert(e->ppid == getppid());
+        assert(e->state == 'R');
+        assert(streq(e->comm, TEST_COMM));
+        assert(e->num_threads == 1);
+        assert(e->rss > 0);
+        assert(e->vsize >= e->rss);
+        assert(e->shared > 0 && e->text > 0);
+
+        assert(!proc_snapshot_find(s, 0));
+}
+
+static void test_snapshot_diff(void) {
+        _cleanup_proc_snapshot_free_ struct proc_snapshot *a = NULL, *b = NULL;
+        _cleanup_free_ struct proc_snapshot_delta *delta = NULL;
+        _cleanup_free_ char *mem = NULL;
+        const size_t mem_size = 16 << 20;
+        uint64_t t;
+        size_t n, i;
+
+        assert(proc_snapshot_take(&a, 0) == 0);
+
+        /* fault pages in and spin a while */
+        mem = malloc(mem_size);
+        assert(mem);
+        memset(mem, 1, mem_size);
+
+        t = now_usec(CLOCK_MONOTONIC);
+        while (now_usec(CLOCK_MONOTONIC) - t < 300 * USEC_PER_MSEC)
+                ;
+
+        assert(proc_snapshot_take(&b, 0) == 0);
+        assert(proc_snapshot_diff(a, b, &delta, &n) == 0);
+        assert(n == b->n_proc);
+
+        for (i = 0; i < n; i++)
+                if (delta[i].pid == getpid())
+                        break;
+
+        assert(i < n);
+        assert(!delta[i].is_new);
+        assert(delta[i].cpu_usage > 0);
+        assert(delta[i].rss_delta >= (int64_t) (mem_size >> 10) / 2);
+
+        assert(proc_snapshot_diff(b, a, &delta, &n) == -EINVAL);
+}
+
+int main(int argc, char *argv[]) {
+        test_snapshot_take();
+        test_snapshot_diff();
+
+        return 0;
+}
@@ -0,0 +1,87 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/proc.h"
+#include "test.h"
+
+static void test_pid_get_status(void) {
+        struct proc_status st;
+        int i;
+
+        assert(proc_pid_get_status(getpid(), &st, PROC_STATUS_MASK_ALL) == 0);
+        assert(st.value[PROC_STATUS_ID_PID] == (uint64_t) getpid());
+        assert(st.value[PROC_STATUS_ID_TGID] == (uint64_t) getpid());
+        assert(st.value[PROC_STATUS_ID_PPID] == (uint64_t) getppid());
+        assert(st.value[PROC_STATUS_ID_THREADS] == 1);
+        assert(st.value[PROC_STATUS_ID_VM_RSS] > 0);
+        assert(st.value[PROC_STATUS_ID_VM_SIZE] >= st.value[PROC_STATUS_ID_VM_RSS]);
+        assert(st.value[PROC_STATUS_ID_VM_RSS] ==
+               st.value[PROC_STATUS_ID_RSS_ANON] +
+               st.value[PROC_STATUS_ID_RSS_FILE] +
+               st.value[PROC_STATUS_ID_RSS_SHMEM]);
+
+        assert(proc_pid_get_status(getpid(), &st, PROC_STATUS_MASK_VM_RSS | PROC_STATUS_MASK_THREADS) == 0);
+        assert(st.value[PROC_STATUS_ID_VM_RSS] > 0);
+        assert(st.value[PROC_STATUS_ID_THREADS] == 1);
+        assert(st.value[PROC_STATUS_ID_PID] == 0);
+        assert(st.value[PROC_STATUS_ID_VOLUNTARY_CTXT_SWITCHES] == 0);
+
+        assert(proc_pid_get_status(getpid(), &st, 0) == 0);
+        for (i = 0; i < PROC_STATUS_ID_MAX; i++)
+                assert(st.value[i] == 0);
+}
+
+static void test_pid_get_status_gone(void) {
+        struct proc_status st;
+        pid_t pid;
+
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+                _exit(EXIT_SUCCESS);
+        assert(waitpid(pid, NULL, 0) == pid);
+
+        assert(proc_pid_get_status(pid, &st, PROC_STATUS_MASK_VM_RSS) == -ENOENT);
+}
+
+static void test_status_keys(void) {
+        int i;
+
+        for (i = 0; i < PROC_STATUS_ID_MAX; i++)
+                assert(proc_status_string_to_id(proc_status_id_to_string(i)) == i);
+
+        assert(proc_status_string_to_id("NoSuchKey") == PROC_STATUS_ID_INVALID);
+}
+
+int main(int argc, char *argv[]) {
+        test_pid_get_status();
+        test_pid_get_status_gone();
+        test_status_keys();
+
+        return 0;
+}
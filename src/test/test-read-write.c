@@ -21,9 +21,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
+#include <dirent.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "libsystem/libsystem.h"
 
@@ -47,6 +53,140 @@ static void test_string_read_write(void) {
         assert(unlink(TEST_READ_WRITE_FILE) == 0 || errno == ENOENT);
 }
 
+#define LONG_LINE_LEN   (3 * LINE_MAX + 7)
+
+static void test_long_line(void) {
+        _cleanup_free_ char *long_line = NULL, *str = NULL, *str2 = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        size_t i;
+
+        long_line = new(char, LONG_LINE_LEN + 1);
+        assert(long_line);
+        for (i = 0; i < LONG_LINE_LEN; i++)
+                long_line[i] = 'a' + i % 26;
+        long_line[LONG_LINE_LEN] = 0;
+
+        /* longer than LINE_MAX is not truncated */
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, long_line, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(read_one_line_from_path(TEST_READ_WRITE_FILE, &str) == 0);
+        assert(streq(str, long_line));
+
+        f = fopen(TEST_READ_WRITE_FILE, "re");
+        assert(f);
+        assert(read_one_line_from_file(f, &str2) == 0);
+        assert(streq(str2, long_line));
+        free(str2);
+        assert(read_one_line_from_file(f, &str2) == 0);
+        assert(streq(str2, ""));
+        free(str);
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "", 0) == 0);
+        assert(read_one_line_from_path(TEST_READ_WRITE_FILE, &str) == 0);
+        assert(streq(str, ""));
+
+        assert(unlink(TEST_READ_WRITE_FILE) == 0);
+}
+
+static void test_read_full_file(void) {
+        _cleanup_free_ char *big = NULL;
+        _cleanup_fclose_ FILE *f = NULL;
+        char *buf, *buf2;
+        size_t len, len2, i;
+
+        /* regular file sized by fstat */
+        big = new(char, 1024 * 1024 + 1);
+        assert(big);
+        for (i = 0; i < 1024 * 1024; i++)
+                big[i] = i % 255 + 1;
+        big[1024 * 1024] = 0;
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, big, 0) == 0);
+        assert(read_full_file(TEST_READ_WRITE_FILE, &buf, &len) == 0);
+        assert(len == 1024 * 1024 && streq(buf, big));
+        free(buf);
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "", 0) == 0);
+        assert(read_full_file(TEST_READ_WRITE_FILE, &buf, &len) == 0);
+        assert(len == 0 && streq(buf, ""));
+        free(buf);
+
+        assert(unlink(TEST_READ_WRITE_FILE) == 0);
+        assert(read_full_file(TEST_READ_WRITE_FILE, &buf, &len) == -ENOENT);
+
+        /* procfs has no size, mostly longer than the first buffer */
+        assert(read_full_file("/proc/self/smaps", &buf, &len) == 0);
+        assert(len > 4096 && strlen(buf) == len);
+        free(buf);
+
+        f = fopen("/proc/self/stat", "re");
+        assert(f);
+        buf2 = NULL;
+        len2 = 0;
+        assert(getline(&buf2, &len2, f) > 0);
+        assert(read_full_file("/proc/self/stat", &buf, NULL) == 0);
+        /* only the times can be changed */
+        assert(strneq(buf, buf2, 20));
+        free(buf);
+        free(buf2);
+}
+
+static void test_line_reader(void) {
+        static const char * const lines[] = { "first", "", "third line", "no newline at end" };
+        _cleanup_close_ int fd = -1;
+        _cleanup_free_ char *long_line = NULL;
+        char small[8];
+        char *l;
+        size_t len, i;
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "first\n\nthird line\nno newline at end", 0) == 0);
+
+        fd = open(TEST_READ_WRITE_FILE, O_RDONLY | O_CLOEXEC);
+        assert(fd >= 0);
+
+        {
+                _cleanup_line_reader_done_ struct line_reader r = LINE_READER_INIT(fd);
+
+                for (i = 0; i < ELEMENTSOF(lines); i++) {
+                        assert(line_reader_next(&r, &l, &len) == 1);
+                        assert(len == strlen(lines[i]) && streq(l, lines[i]));
+                }
+
+                assert(line_reader_next(&r, &l, &len) == 0);
+                assert(line_reader_next(&r, &l, &len) == 0);
+        }
+
+        /* fixed buffer is not grown */
+        assert(lseek(fd, 0, SEEK_SET) == 0);
+        {
+                struct line_reader r = LINE_READER_INIT_BUF(fd, small, sizeof(small));
+
+                assert(line_reader_next(&r, &l, &len) == 1 && streq(l, "first"));
+                assert(line_reader_next(&r, &l, &len) == 1 && streq(l, ""));
+                assert(line_reader_next(&r, &l, &len) == -ENOBUFS);
+                line_reader_done(&r);
+        }
+
+        /* grown to the longest line */
+        long_line = new(char, LONG_LINE_LEN + 1);
+        assert(long_line);
+        memset(long_line, 'x', LONG_LINE_LEN);
+        long_line[LONG_LINE_LEN] = 0;
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, long_line, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "short", FILE_WRITE_APPEND) == 0);
+        assert(lseek(fd, 0, SEEK_SET) == 0);
+        {
+                _cleanup_line_reader_done_ struct line_reader r = LINE_READER_INIT(fd);
+
+                assert(line_reader_next(&r, &l, &len) == 1);
+                assert(len == LONG_LINE_LEN && streq(l, long_line));
+                assert(line_reader_next(&r, &l, &len) == 1 && streq(l, "short"));
+                assert(line_reader_next(&r, &l, &len) == 0);
+        }
+
+        assert(unlink(TEST_READ_WRITE_FILE) == 0);
+}
+
 static void test_int32_read_write(void) {
         int32_t i;
 
@@ -99,12 +239,301 @@ static void test_uint64_read_write(void) {
         assert(unlink(TEST_READ_WRITE_FILE) == 0 || errno == ENOENT);
 }
 
+/* The path functions parse without stdio, they have to be same with
+ * the FILE ones which use fscanf() */
+static void test_num_parse_compat(void) {
+        static const char * const inputs[] = {
+                "", " \n\t ", "abc", "-", "+", "0", "-0", "+7", "-5\n", "  42  \n",
+                "12abc", "2147483647", "2147483648", "-2147483649", "4294967295",
+                "4294967296", "-1", "9223372036854775807", "9223372036854775808",
+                "-9223372036854775809", "18446744073709551615", "18446744073709551616",
+                "99999999999999999999999999",
+                "-18446744073709551615", "-18446744073709551616", "-99999999999999999999999999",
+                /* not space nor digit in the "C" locale */
+                "\xa0" "12", "\xc2\xb2", "\xff\n", "\v\f\r 9",
+        };
+        int32_t v;
+        size_t i;
+
+        for (i = 0; i < ELEMENTSOF(inputs); i++) {
+                _cleanup_fclose_ FILE *f = NULL;
+                int32_t i32[2] = { 11, 11 };
+                uint32_t u32[2] = { 11, 11 };
+                int64_t i64[2] = { 11, 11 };
+                uint64_t u64[2] = { 11, 11 };
+                int r;
+
+                assert(write_str_to_path(TEST_READ_WRITE_FILE, inputs[i], 0) == 0);
+                f = fopen(TEST_READ_WRITE_FILE, "re");
+                assert(f);
+
+#define CHECK_PARSE(type, v)                                            \
+                do {                                                    \
+                        rewind(f);                                      \
+                        r = read_##type##_from_file(f, &v[0]);          \
+                        assert(read_##type##_from_path(TEST_READ_WRITE_FILE, &v[1]) == r); \
+                        assert(v[0] == v[1]);                           \
+                } while (0)
+
+                CHECK_PARSE(int32, i32);
+                CHECK_PARSE(uint32, u32);
+                CHECK_PARSE(int64, i64);
+                CHECK_PARSE(uint64, u64);
+#undef CHECK_PARSE
+        }
+
+        assert(read_int32_from_path("/no/such/file", &v) == -ENOENT);
+        assert(unlink(TEST_READ_WRITE_FILE) == 0);
+}
+
+static void test_num_write_format(void) {
+        _cleanup_free_ char *str = NULL;
+        struct stat st;
+
+        assert(write_int64_to_path(TEST_READ_WRITE_FILE, INT64_MIN, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(read_one_line_from_path(TEST_READ_WRITE_FILE, &str) == 0);
+        assert(streq(str, "-9223372036854775808"));
+        assert(stat(TEST_READ_WRITE_FILE, &st) == 0);
+        assert(st.st_size == 21);
+        free(str);
+
+        assert(write_uint32_to_path(TEST_READ_WRITE_FILE, 0, 0) == 0);
+        assert(write_uint32_to_path(TEST_READ_WRITE_FILE, UINT32_MAX, FILE_WRITE_APPEND) == 0);
+        assert(read_one_line_from_path(TEST_READ_WRITE_FILE, &str) == 0);
+        assert(streq(str, "04294967295"));
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "", FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(stat(TEST_READ_WRITE_FILE, &st) == 0);
+        assert(st.st_size == 1);
+
+        assert(write_str_to_path(TEST_READ_WRITE_FILE, "", 0) == 0);
+        assert(stat(TEST_READ_WRITE_FILE, &st) == 0);
+        assert(st.st_size == 0);
+
+        assert(unlink(TEST_READ_WRITE_FILE) == 0);
+}
+
+#define TEST_ATOMIC_DIR         "/tmp/test-read-write-atomic"
+
+static int count_dir_entries(const char *path) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        int n = 0;
+
+        d = opendir(path);
+        assert(d);
+
+        FOREACH_DIRENT(de, d, assert(false))
+                n++;
+
+        return n;
+}
+
+static void test_atomic_write(void) {
+        _cleanup_free_ char *str = NULL;
+        struct stat st;
+        uint64_t u;
+
+        (void) rmdir_recursive(TEST_ATOMIC_DIR);
+        assert(mkdir(TEST_ATOMIC_DIR, 0755) == 0);
+
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/str", TEST_STRING, FILE_WRITE_ATOMIC) == 0);
+        assert(read_one_line_from_path(TEST_ATOMIC_DIR "/str", &str) == 0);
+        assert(streq(str, TEST_STRING));
+
+        /* the mode of the replaced file is kept */
+        assert(chmod(TEST_ATOMIC_DIR "/str", 0600) == 0);
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/str", "new", FILE_WRITE_ATOMIC | FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(stat(TEST_ATOMIC_DIR "/str", &st) == 0);
+        assert((st.st_mode & 07777) == 0600);
+        assert(st.st_size == 4);
+
+        assert(write_uint64_to_path(TEST_ATOMIC_DIR "/u64", TEST_UINT64, FILE_WRITE_ATOMIC) == 0);
+        assert(read_uint64_from_path(TEST_ATOMIC_DIR "/u64", &u) >= 0);
+        assert(u == TEST_UINT64);
+
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/str", "x", FILE_WRITE_ATOMIC | FILE_WRITE_APPEND) == -EINVAL);
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/no/such/dir", "x", FILE_WRITE_ATOMIC) == -ENOENT);
+
+        /* the target of a link is replaced, the link is kept */
+        free(str);
+        assert(symlink("str", TEST_ATOMIC_DIR "/link") == 0);
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/link", "linked", FILE_WRITE_ATOMIC) == 0);
+        assert(lstat(TEST_ATOMIC_DIR "/link", &st) == 0 && S_ISLNK(st.st_mode));
+        assert(read_one_line_from_path(TEST_ATOMIC_DIR "/str", &str) == 0);
+        assert(streq(str, "linked"));
+        assert(stat(TEST_ATOMIC_DIR "/str", &st) == 0);
+        assert((st.st_mode & 07777) == 0600);
+
+        assert(symlink("none", TEST_ATOMIC_DIR "/dangling") == 0);
+        assert(write_str_to_path(TEST_ATOMIC_DIR "/dangling", "x", FILE_WRITE_ATOMIC) == -ENOENT);
+        assert(unlink(TEST_ATOMIC_DIR "/dangling") == 0);
+
+        /* no temporary file is left */
+        assert(count_dir_entries(TEST_ATOMIC_DIR) == 3);
+
+        assert(rmdir_recursive(TEST_ATOMIC_DIR) == 0);
+}
+
+static void test_atomic_write_batch(void) {
+        struct file_write_entry entries[] = {
+                { TEST_ATOMIC_DIR "/a", "a" },
+                { TEST_ATOMIC_DIR "/b", "b\n" },
+                { TEST_ATOMIC_DIR "/sub/c", "c" },
+                { TEST_ATOMIC_DIR "/a", "a2" },
+        };
+        struct file_write_entry bad[] = {
+                { TEST_ATOMIC_DIR "/b", "not written" },
+                { TEST_ATOMIC_DIR "/no/such/dir", "x" },
+        };
+        _cleanup_free_ char *str = NULL;
+        struct stat st;
+
+        (void) rmdir_recursive(TEST_ATOMIC_DIR);
+        assert(do_mkdir(TEST_ATOMIC_DIR "/sub", 0755) == 0);
+
+        assert(write_str_to_path_batch(entries, ELEMENTSOF(entries), FILE_WRITE_NEWLINE_IF_NOT) == 0);
+
+        assert(read_one_line_from_path(TEST_ATOMIC_DIR "/a", &str) == 0);
+        assert(streq(str, "a2"));
+        free(str);
+        assert(read_one_line_from_path(TEST_ATOMIC_DIR "/sub/c", &str) == 0);
+        assert(streq(str, "c"));
+        free(str);
+        str = NULL;
+
+        assert(stat(TEST_ATOMIC_DIR "/b", &st) == 0);
+        assert(st.st_size == 2);
+
+        /* nothing is replaced if one fails */
+        assert(write_str_to_path_batch(bad, ELEMENTSOF(bad), 0) == -ENOENT);
+        assert(read_one_line_from_path(TEST_ATOMIC_DIR "/b", &str) == 0);
+        assert(streq(str, "b"));
+
+        assert(count_dir_entries(TEST_ATOMIC_DIR) == 3);
+        assert(count_dir_entries(TEST_ATOMIC_DIR "/sub") == 1);
+
+        assert(rmdir_recursive(TEST_ATOMIC_DIR) == 0);
+}
+
+static void test_attrs_batch(enum file_write_flags flags) {
+        struct file_write_entry entries[] = {
+                { TEST_ATOMIC_DIR "/a/x", "1" },
+                { TEST_ATOMIC_DIR "/b/x", "2\n" },
+                { TEST_ATOMIC_DIR "/no/x", "3" },
+                { TEST_ATOMIC_DIR "/a/y", "4" },
+                { TEST_ATOMIC_DIR "/c", "5" },
+                { TEST_ATOMIC_DIR "/a/x", "6" },
+                { TEST_ATOMIC_DIR "/b", "7" },
+        };
+        int status[ELEMENTSOF(entries)];
+        int64_t i;
+
+        (void) rmdir_recursive(TEST_ATOMIC_DIR);
+        assert(do_mkdir(TEST_ATOMIC_DIR "/a", 0755) == 0);
+        assert(do_mkdir(TEST_ATOMIC_DIR "/b", 0755) == 0);
+
+        /* a failure does not stop the others */
+        assert(write_attrs_batch(entries, ELEMENTSOF(entries), flags | FILE_WRITE_NEWLINE_IF_NOT, status) == -ENOENT);
+        assert(status[0] == 0);
+        assert(status[1] == 0);
+        assert(status[2] == -ENOENT);
+        assert(status[3] == 0);
+        assert(status[4] == 0);
+        assert(status[5] == 0);
+        assert(status[6] == -EISDIR);
+
+        /* in order within a directory */
+        assert(read_int64_from_path(TEST_ATOMIC_DIR "/a/x", &i) == 1 && i == 6);
+        assert(read_int64_from_path(TEST_ATOMIC_DIR "/a/y", &i) == 1 && i == 4);
+        assert(read_int64_from_path(TEST_ATOMIC_DIR "/b/x", &i) == 1 && i == 2);
+        assert(read_int64_from_path(TEST_ATOMIC_DIR "/c", &i) == 1 && i == 5);
+        assert(count_dir_entries(TEST_ATOMIC_DIR "/b") == 1);
+
+        assert(write_attrs_batch(entries, 2, flags, NULL) == 0);
+        assert(write_attrs_batch(entries, ELEMENTSOF(entries), flags | FILE_WRITE_ATOMIC, NULL) == -EINVAL);
+        assert(write_attrs_batch(NULL, 0, flags, NULL) == 0);
+
+        assert(rmdir_recursive(TEST_ATOMIC_DIR) == 0);
+}
+
+#define STRESS_THREADS  8
+#define STRESS_LOOPS    2000
+
+static void *stress_thread(void *arg) {
+        char path[64];
+        long id = (long) arg;
+        int n;
+
+        snprintf(path, sizeof(path), TEST_READ_WRITE_FILE "-stress-%ld", id);
+
+        for (n = 0; n < STRESS_LOOPS; n++) {
+                _cleanup_fclose_ FILE *f = NULL, *r = NULL;
+                _cleanup_free_ char *line = NULL;
+                int64_t v = id * STRESS_LOOPS + n, i;
+                /* distinct errno of each thread, has to be kept */
+                int e = 1000 + id;
+
+                errno = e;
+                assert(write_int64_to_path(path, v, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+                assert(errno == e);
+                assert(read_int64_from_path(path, &i) == 1 && i == v);
+                assert(errno == e);
+
+                f = fopen(path, "r+e");
+                assert(f);
+                assert(write_int64_to_file(f, -v, FILE_WRITE_NEWLINE_IF_NOT | FILE_WRITE_WITH_FFLUSH) == 0);
+                assert(errno == e);
+                rewind(f);
+                assert(read_int64_from_file(f, &i) == 1 && i == -v);
+                assert(errno == e);
+                rewind(f);
+                assert(read_one_line_from_file(f, &line) == 0);
+                assert(errno == e);
+
+                /* failure paths restore errno too */
+                r = fopen(path, "re");
+                assert(r);
+                errno = e;
+                assert(write_int64_to_file(r, v, FILE_WRITE_WITH_FFLUSH) == -EBADF);
+                assert(errno == e);
+                assert(write_str_to_file(r, "x", FILE_WRITE_WITH_FFLUSH) == -EBADF);
+                assert(errno == e);
+        }
+
+        assert(unlink(path) == 0);
+
+        return NULL;
+}
+
+/* The helpers are called concurrently without any lock by callers */
+static void test_read_write_threads(void) {
+        pthread_t threads[STRESS_THREADS];
+        long n;
+
+        for (n = 0; n < STRESS_THREADS; n++)
+                assert(pthread_create(&threads[n], NULL, stress_thread, (void *) n) == 0);
+
+        for (n = 0; n < STRESS_THREADS; n++)
+                assert(pthread_join(threads[n], NULL) == 0);
+}
+
 int main(int argc, char *argv[]) {
         test_string_read_write();
+        test_long_line();
+        test_read_full_file();
+        test_line_reader();
         test_int32_read_write();
         test_uint32_read_write();
         test_int64_read_write();
         test_uint64_read_write();
+        test_num_parse_compat();
+        test_num_write_format();
+        test_atomic_write();
+        test_atomic_write_batch();
+        test_attrs_batch(0);
+        test_attrs_batch(FILE_WRITE_PARALLEL);
+        test_read_write_threads();
 
         return 0;
 }
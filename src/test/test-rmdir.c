@@ -0,0 +1,157 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "libsystem/libsystem.h"
+#include "test.h"
+
+#define TEST_DIR        "/tmp/test-rmdir"
+#define TEST_OUTSIDE    "/tmp/test-rmdir-outside"
+
+static void test_rmdir_tree(enum rmdir_flags flags) {
+        (void) rmdir_recursive(TEST_DIR);
+        (void) rmdir_recursive(TEST_OUTSIDE);
+
+        assert(do_mkdir(TEST_DIR "/a/b/c", 0755) == 0);
+        assert(mkdir(TEST_DIR "/empty", 0755) == 0);
+        assert(touch(TEST_DIR "/file") == 0);
+        assert(touch(TEST_DIR "/a/b/file") == 0);
+        assert(mkfifo(TEST_DIR "/a/fifo", 0600) == 0);
+
+        /* symlinks must be removed, not followed */
+        assert(mkdir(TEST_OUTSIDE, 0755) == 0);
+        assert(touch(TEST_OUTSIDE "/keep") == 0);
+        assert(symlink(TEST_OUTSIDE, TEST_DIR "/a/link-dir") == 0);
+        assert(symlink(TEST_OUTSIDE "/keep", TEST_DIR "/link-file") == 0);
+        assert(symlink("dangling", TEST_DIR "/a/b/c/dangling") == 0);
+
+        assert(rmdir_recursive_full(TEST_DIR, flags) == 0);
+        assert(access(TEST_DIR, F_OK) < 0 && errno == ENOENT);
+        assert(access(TEST_OUTSIDE "/keep", F_OK) == 0);
+
+        /* the top is a symlink */
+        assert(symlink(TEST_OUTSIDE, TEST_DIR) == 0);
+        assert(rmdir_recursive_full(TEST_DIR, flags) < 0);
+        assert(access(TEST_OUTSIDE "/keep", F_OK) == 0);
+        assert(unlink(TEST_DIR) == 0);
+
+        assert(rmdir_recursive(TEST_DIR) == -ENOENT);
+        assert(rmdir_recursive(TEST_OUTSIDE) == 0);
+}
+
+#define DEEP_DEPTH      600
+
+static void test_rmdir_deep(void) {
+        int fd, nfd, i;
+
+        (void) rmdir_recursive(TEST_DIR);
+
+        /* Deeper than PATH_MAX, can be made only relatively */
+        assert(mkdir(TEST_DIR, 0755) == 0);
+        fd = open(TEST_DIR, O_RDONLY | O_DIRECTORY);
+        assert(fd >= 0);
+
+        for (i = 0; i < DEEP_DEPTH; i++) {
+                assert(mkdirat(fd, "0123456789", 0755) == 0);
+                if (i % 10 == 0)
+                        assert(mknodat(fd, "file", S_IFREG | 0644, 0) == 0);
+
+                nfd = openat(fd, "0123456789", O_RDONLY | O_DIRECTORY);
+                assert(nfd >= 0);
+                close(fd);
+                fd = nfd;
+        }
+        close(fd);
+
+        assert(rmdir_recursive(TEST_DIR) == 0);
+        assert(access(TEST_DIR, F_OK) < 0 && errno == ENOENT);
+}
+
+#define WIDE_DIRS       2000
+
+static void test_rmdir_wide(enum rmdir_flags flags) {
+        char path[PATH_MAX];
+        int i;
+
+        (void) rmdir_recursive(TEST_DIR);
+
+        /* subdirectories and files mixed in one directory */
+        assert(mkdir(TEST_DIR, 0755) == 0);
+        for (i = 0; i < WIDE_DIRS; i++) {
+                snprintf(path, sizeof(path), TEST_DIR "/dir-%d", i);
+                assert(mkdir(path, 0755) == 0);
+
+                if (i % 2 == 0) {
+                        snprintf(path, sizeof(path), TEST_DIR "/dir-%d/file", i);
+                        assert(mknod(path, S_IFREG | 0644, 0) == 0);
+                }
+
+                snprintf(path, sizeof(path), TEST_DIR "/file-%d", i);
+                assert(mknod(path, S_IFREG | 0644, 0) == 0);
+        }
+
+        assert(rmdir_recursive_full(TEST_DIR, flags) == 0);
+        assert(access(TEST_DIR, F_OK) < 0 && errno == ENOENT);
+}
+
+#define MANY_FILES      20000
+
+static void make_many_tree(void) {
+        char path[PATH_MAX];
+        int i;
+
+        for (i = 0; i < MANY_FILES; i++) {
+                if (i % 100 == 0) {
+                        snprintf(path, sizeof(path), TEST_DIR "/%02d/%03d", i / 2000, i / 100);
+                        assert(do_mkdir(path, 0755) == 0);
+                }
+
+                snprintf(path, sizeof(path), TEST_DIR "/%02d/%03d/cache-%d", i / 2000, i / 100, i);
+                assert(mknod(path, S_IFREG | 0644, 0) == 0);
+        }
+}
+
+static void test_rmdir_many(void) {
+        /* more than the unlinks in flight */
+        (void) rmdir_recursive(TEST_DIR);
+        make_many_tree();
+        assert(rmdir_recursive_full(TEST_DIR, RMDIR_URING) == 0);
+        assert(access(TEST_DIR, F_OK) < 0 && errno == ENOENT);
+}
+
+int main(int argc, char *argv[]) {
+        test_rmdir_tree(0);
+        test_rmdir_tree(RMDIR_URING);
+        test_rmdir_deep();
+        test_rmdir_wide(0);
+        test_rmdir_wide(RMDIR_URING);
+        test_rmdir_many();
+
+        return 0;
+}
@@ -0,0 +1,216 @@
+/*-*- Mode: C; c-basic-offset: 8; indent-tabs-mode: nil -*-*/
+
+/*
+ * libsystem
+ *
+ * Copyright (c) 2017 Samsung Electronics Co., Ltd.
+ *
+ * Licensed under the Apache License, Version 2.0 (the License);
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "libsystem/libsystem.h"
+#include "libsystem/sysattr.h"
+#include "test.h"
+
+#define TEST_DIR        "/tmp/test-sysattr"
+#define TEST_FILE       TEST_DIR "/attr"
+#define TEST_CGROUP     "/sys/fs/cgroup/unified/test-sysattr"
+
+static void test_sysattr_file(void) {
+        _cleanup_sysattr_free_ struct sysattr *a = NULL;
+        char buf[64];
+        int64_t i;
+        uint64_t u;
+
+        (void) rmdir_recursive(TEST_DIR);
+        assert(mkdir(TEST_DIR, 0755) == 0);
+
+        assert(sysattr_open(TEST_FILE, &a) == 0);
+        assert(streq(sysattr_path(a), TEST_FILE));
+
+        /* opened lazily */
+        assert(sysattr_read_int64(a, &i) == -ENOENT);
+        assert(sysattr_write_int64(a, 0, 0) == -ENOENT);
+
+        assert(write_str_to_path(TEST_FILE, "", 0) == 0);
+        assert(sysattr_read_int64(a, &i) == -ENODATA);
+
+        assert(sysattr_write_int64(a, -12345, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(sysattr_read_int64(a, &i) == 0 && i == -12345);
+        assert(sysattr_read(a, buf, sizeof(buf)) == 7 && streq(buf, "-12345\n"));
+
+        /* shorter value truncates the file */
+        assert(sysattr_write_uint64(a, 7, 0) == 0);
+        assert(sysattr_read(a, buf, sizeof(buf)) == 1 && streq(buf, "7"));
+
+        assert(sysattr_write_uint64(a, UINT64_MAX, 0) == 0);
+        assert(sysattr_read_uint64(a, &u) == 0 && u == UINT64_MAX);
+
+        /* negated as strtoull(3), an overflow saturates */
+        assert(sysattr_write_str(a, "-1", 0) == 0);
+        assert(sysattr_read_uint64(a, &u) == 0 && u == UINT64_MAX);
+        assert(sysattr_write_str(a, "-18446744073709551615", 0) == 0);
+        assert(sysattr_read_uint64(a, &u) == 0 && u == 1);
+        assert(sysattr_write_str(a, "-18446744073709551616", 0) == 0);
+        assert(sysattr_read_uint64(a, &u) == 0 && u == UINT64_MAX);
+
+        assert(sysattr_write_str(a, "abc", FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(sysattr_read(a, buf, sizeof(buf)) == 4 && streq(buf, "abc\n"));
+        assert(sysattr_write_str(a, "abc\n", FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(sysattr_read(a, buf, sizeof(buf)) == 4 && streq(buf, "abc\n"));
+        assert(sysattr_read_int64(a, &i) == -EINVAL);
+
+        /* buffer is smaller than the contents */
+        assert(sysattr_read(a, buf, 3) == 2 && streq(buf, "ab"));
+        assert(sysattr_read(a, buf, 1) == -EINVAL);
+
+        assert(sysattr_write_str(a, "x", FILE_WRITE_APPEND) == -EINVAL);
+        assert(sysattr_write_int64(a, 1, FILE_WRITE_ATOMIC) == -EINVAL);
+
+        /* replaced by rename(2), the handle follows the path */
+        assert(write_int64_to_path(TEST_FILE, 42, FILE_WRITE_ATOMIC) == 0);
+        assert(sysattr_read_int64(a, &i) == 0 && i == 42);
+        assert(sysattr_write_int64(a, 43, 0) == 0);
+        assert(read_int64_from_path(TEST_FILE, &i) >= 0 && i == 43);
+
+        /* removed */
+        assert(unlink(TEST_FILE) == 0);
+        assert(sysattr_read_int64(a, &i) == -ENOENT);
+
+        assert(rmdir_recursive(TEST_DIR) == 0);
+}
+
+static void test_sysattr_cgroup(void) {
+        _cleanup_sysattr_free_ struct sysattr *a = NULL;
+        int64_t i;
+
+        (void) rmdir(TEST_CGROUP);
+        if (mkdir(TEST_CGROUP, 0755) < 0) {
+                printf("cgroup2 is not writable, skip %s\n", __func__);
+                return;
+        }
+
+        assert(sysattr_open(TEST_CGROUP "/cgroup.freeze", &a) == 0);
+        assert(sysattr_write_int64(a, 1, FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(sysattr_read_int64(a, &i) == 0 && i == 1);
+
+        /* descriptors of a removed cgroup return ENODEV */
+        assert(rmdir(TEST_CGROUP) == 0);
+        assert(sysattr_read_int64(a, &i) == -ENOENT);
+
+        /* and it comes back */
+        assert(mkdir(TEST_CGROUP, 0755) == 0);
+        assert(sysattr_read_int64(a, &i) == 0 && i == 0);
+        assert(rmdir(TEST_CGROUP) == 0);
+        assert(mkdir(TEST_CGROUP, 0755) == 0);
+        assert(sysattr_write_int64(a, 1, 0) == 0);
+        assert(sysattr_read_int64(a, &i) == 0 && i == 1);
+        assert(sysattr_write_int64(a, 0, 0) == 0);
+
+        assert(rmdir(TEST_CGROUP) == 0);
+}
+
+#define CACHE_FILES     40
+
+static void test_sysattr_cache(void) {
+        char path[PATH_MAX];
+        int64_t i;
+        int n, round;
+
+        (void) rmdir_recursive(TEST_DIR);
+        assert(mkdir(TEST_DIR, 0755) == 0);
+
+        for (n = 0; n < CACHE_FILES; n++) {
+                snprintf(path, sizeof(path), TEST_DIR "/attr-%d", n);
+                assert(touch(path) == 0);
+        }
+
+        /* more files than the cache, so handles are evicted */
+        for (round = 0; round < 3; round++) {
+                for (n = 0; n < CACHE_FILES; n++) {
+                        snprintf(path, sizeof(path), TEST_DIR "/attr-%d", n);
+                        assert(sysattr_write_int64_to_path(path, n * 10 + round, 0) == 0);
+                }
+
+                for (n = CACHE_FILES - 1; n >= 0; n--) {
+                        snprintf(path, sizeof(path), TEST_DIR "/attr-%d", n);
+                        assert(sysattr_read_int64_from_path(path, &i) == 0);
+                        assert(i == n * 10 + round);
+                        assert(read_int64_from_path(path, &i) >= 0 && i == n * 10 + round);
+                }
+        }
+
+        assert(sysattr_write_str_to_path(TEST_DIR "/attr-0", "5", FILE_WRITE_NEWLINE_IF_NOT) == 0);
+        assert(sysattr_read_int64_from_path(TEST_DIR "/attr-0", &i) == 0 && i == 5);
+
+        sysattr_cache_flush();
+        assert(sysattr_read_int64_from_path(TEST_DIR "/attr-0", &i) == 0 && i == 5);
+        assert(sysattr_read_int64_from_path(TEST_DIR "/none", &i) == -ENOENT);
+
+        assert(rmdir_recursive(TEST_DIR) == 0);
+}
+
+static void *cache_thread(void *arg) {
+        char path[PATH_MAX];
+        uint64_t u;
+        long id = (long) arg;
+        int n;
+
+        snprintf(path, sizeof(path), TEST_DIR "/thread-%ld", id);
+        assert(touch(path) == 0);
+
+        for (n = 0; n < 1000; n++) {
+                assert(sysattr_write_uint64_to_path(path, id * 10000 + n, 0) == 0);
+                assert(sysattr_read_uint64_from_path(path, &u) == 0);
+                assert(u == (uint64_t) (id * 10000 + n));
+        }
+
+        return NULL;
+}
+
+static void test_sysattr_threads(void) {
+        pthread_t threads[4];
+        long n;
+
+        (void) rmdir_recursive(TEST_DIR);
+        assert(mkdir(TEST_DIR, 0755) == 0);
+
+        /* each thread has its own cache, closed at thread exit */
+        for (n = 0; n < (long) ELEMENTSOF(threads); n++)
+                assert(pthread_create(&threads[n], NULL, cache_thread, (void *) n) == 0);
+
+        for (n = 0; n < (long) ELEMENTSOF(threads); n++)
+                assert(pthread_join(threads[n], NULL) == 0);
+
+        assert(rmdir_recursive(TEST_DIR) == 0);
+}
+
+int main(int argc, char *argv[]) {
+        test_sysattr_file();
+        test_sysattr_cgroup();
+        test_sysattr_cache();
+        test_sysattr_threads();
+
+        return 0;
+}
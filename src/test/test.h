@@ -18,4 +18,33 @@
  * limitations under the License.
  */
 
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+#include <mntent.h>
+
+#include "libsystem/libsystem.h"
+
 #define EXIT_TEST_SKIP 77
+
+/* The first cgroup2 mount point, has to be free-ed. NULL if none. */
+static inline char *cgroup2_mount_dir(void) {
+        struct mntent *ent;
+        char *dir = NULL;
+        FILE *f;
+
+        f = setmntent("/proc/self/mounts", "re");
+        if (!f)
+                return NULL;
+
+        while ((ent = getmntent(f)))
+                if (streq(ent->mnt_type, "cgroup2")) {
+                        dir = strdup(ent->mnt_dir);
+                        break;
+                }
+
+        endmntent(f);
+
+        return dir;
+}